@@ -0,0 +1,52 @@
+#include "net_bench.h"
+
+using namespace std;
+using namespace magio;
+using namespace magio::bench;
+
+// usage: bench-connect-storm [key=value ...], the common options are in net_bench.h
+// Every client connects, waits until the server that accepted it closes the connection,
+// closes its side and starts over. Latency is the whole cycle, ops/s connections per second.
+// The server closes first so TIME_WAIT piles up on its port rather than eating ephemeral ports.
+// size is not used
+
+Coro<> hang_up(net::Socket socket) {
+    co_return;
+}
+
+Coro<> client(size_t id, ClientStats& stats, Window window) {
+    while (window.running()) {
+        auto start = TimerClock::now();
+        error_code ec;
+        net::Socket socket;
+        co_await connect_tcp(socket, ec);
+        if (ec) {
+            stats.error("connect", ec);
+            break;
+        }
+        char ch;
+        size_t rd = co_await socket.receive(&ch, 1, ec);
+        if (ec || rd != 0) {
+            stats.error("wait for close", ec);
+            break;
+        }
+        socket.close();
+        stats.record(window, start, 0);
+    }
+}
+
+Coro<> amain() {
+    net::Acceptor acceptor;
+    listen_tcp(acceptor);
+    this_context::spawn(serve_tcp(acceptor, hang_up));
+
+    vector<NetResult> results;
+    results.push_back(co_await run_clients("connect+close", client));
+    print_results("bench-connect-storm", results);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    g_net_config = parse_net_args(argc, argv, 8804);
+    run_net_bench(amain());
+}
@@ -0,0 +1,283 @@
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+
+// usage: bench-file [key=value ...]
+//   rw=all       read, write, randread, randwrite or all of them
+//   bs=4096      block size in bytes, a multiple of 512 with direct=1
+//   qd=32        requests in flight per thread
+//   size=256     file size in MB, split evenly between the threads
+//   ops=100000   requests per case over all threads
+//   threads=1    contexts of the CoroContextPool
+//   direct=0     open with O_DIRECT
+//   file=path    the file to test, a temporary one in the working directory by default
+//   json=0       print one JSON object instead of a table
+
+constexpr size_t kAlignment = 4096;
+
+struct Config {
+    string rw = "all";
+    size_t bs = 4096;
+    size_t qd = 32;
+    size_t size = 256 << 20;
+    size_t ops = 100000;
+    size_t threads = 1;
+    bool direct = false;
+    string file;
+    bool json = false;
+};
+
+struct Case {
+    const char* name;
+    bool write;
+    bool random;
+};
+
+constexpr Case kCases[] = {
+    {"read", false, false},
+    {"write", true, false},
+    {"randread", false, true},
+    {"randwrite", true, true},
+};
+
+// what one thread did in one case
+struct ThreadResult {
+    vector<uint32_t> latencies;
+    string error;
+};
+
+struct Result {
+    const char* name;
+    double seconds;
+    size_t ops;
+    double iops;
+    double mbps;
+    // in microseconds
+    double p50, p90, p99, p999, max;
+};
+
+Config g_config;
+CoroContextPool* g_pool;
+
+Config parse_args(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == string::npos) {
+            M_FATAL("expected key=value, got {}", arg);
+        }
+        string key = arg.substr(0, eq);
+        string value = arg.substr(eq + 1);
+        if (key == "rw") {
+            config.rw = value;
+        } else if (key == "bs") {
+            config.bs = max<size_t>(stoull(value), 1);
+        } else if (key == "qd") {
+            config.qd = max<size_t>(stoull(value), 1);
+        } else if (key == "size") {
+            config.size = stoull(value) << 20;
+        } else if (key == "ops") {
+            config.ops = stoull(value);
+        } else if (key == "threads") {
+            config.threads = max<size_t>(stoull(value), 1);
+        } else if (key == "direct") {
+            config.direct = value == "1";
+        } else if (key == "file") {
+            config.file = value;
+        } else if (key == "json") {
+            config.json = value == "1";
+        } else {
+            M_FATAL("unknown option {}", key);
+        }
+    }
+    bool known = config.rw == "all";
+    for (const Case& c : kCases) {
+        known = known || config.rw == c.name;
+    }
+    if (!known) {
+        M_FATAL("unknown rw {}", config.rw);
+    }
+    if (config.direct && config.bs % 512 != 0) {
+        M_FATAL("bs {} is not a multiple of 512, which direct=1 needs", config.bs);
+    }
+    if (config.size / config.threads < config.bs) {
+        M_FATAL("size is too small for {} threads of bs {}", config.threads, config.bs);
+    }
+    return config;
+}
+
+// Writes the whole file once so reads hit real blocks rather than holes
+void prepare_file(const string& path) {
+    error_code ec;
+    size_t size = filesystem::file_size(path, ec);
+    if (!ec && size >= g_config.size) {
+        return;
+    }
+    if (!ec && !g_config.file.empty()) {
+        M_FATAL("{} has {} bytes, less than size", path, size);
+    }
+    ofstream out(path, ios::binary | ios::trunc);
+    string block(1 << 20, '\0');
+    mt19937_64 rng(1);
+    for (size_t written = 0; written < g_config.size; written += block.size()) {
+        for (auto& ch : block) {
+            ch = (char)rng();
+        }
+        out.write(block.data(), min(block.size(), g_config.size - written));
+    }
+}
+
+// one of the qd requests in flight of a thread
+Coro<> worker(RandomAccessFile& file, Case c, size_t begin, size_t blocks, size_t& next, size_t end, mt19937_64& rng, ThreadResult& result) {
+    char* buf = (char*)::operator new[](g_config.bs, align_val_t(kAlignment));
+    memset(buf, 'x', g_config.bs);
+    while (next < end && result.error.empty()) {
+        size_t i = next++;
+        size_t block = c.random ? rng() % blocks : i % blocks;
+        size_t offset = begin + block * g_config.bs;
+
+        error_code ec;
+        auto bg = TimerClock::now();
+        size_t len = 0;
+        if (c.write) {
+            len = co_await file.write_at(offset, buf, g_config.bs, ec);
+        } else {
+            len = co_await file.read_at(offset, buf, g_config.bs, ec);
+        }
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(TimerClock::now() - bg).count();
+        if (ec || len != g_config.bs) {
+            result.error = ec ? ec.message() : fmt::format("short {} of {} bytes at {}", c.name, len, offset);
+            break;
+        }
+        result.latencies.push_back((uint32_t)min<int64_t>(ns, UINT32_MAX));
+    }
+    ::operator delete[](buf, align_val_t(kAlignment));
+}
+
+Coro<> run_thread(const string& path, Case c, size_t id, ThreadResult& result, WaitGroup& wg) {
+    int mode = RandomAccessFile::ReadWrite | (g_config.direct ? RandomAccessFile::Direct : 0);
+    RandomAccessFile file;
+    error_code ec;
+    co_await file.open(path.c_str(), mode, ec);
+    if (ec) {
+        result.error = fmt::format("cannot open {}: {}", path, ec.message());
+    } else {
+        // every thread works on its own slice of the file
+        size_t slice = g_config.size / g_config.threads / g_config.bs * g_config.bs;
+        size_t ops = g_config.ops / g_config.threads + (id < g_config.ops % g_config.threads);
+        size_t next = 0;
+        mt19937_64 rng(id + 1);
+        result.latencies.reserve(ops);
+
+        vector<Coro<>> coros;
+        for (size_t i = 0; i < g_config.qd; ++i) {
+            coros.push_back(worker(file, c, id * slice, slice / g_config.bs, next, ops, rng, result));
+        }
+        co_await when_all(std::move(coros));
+        co_await file.close(ec);
+    }
+    wg.done();
+}
+
+double percentile(const vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = min(sorted.size() - 1, (size_t)(p / 100 * sorted.size()));
+    return sorted[idx] / 1e3;
+}
+
+Coro<Result> run_case(const string& path, Case c) {
+    vector<ThreadResult> results(g_config.threads);
+    WaitGroup wg(g_config.threads);
+    auto bg = TimerClock::now();
+    for (size_t i = 0; i < g_config.threads; ++i) {
+        g_pool->get(i).spawn(run_thread(path, c, i, results[i], wg));
+    }
+    co_await wg.async_wait();
+    chrono::duration<double> elapsed = TimerClock::now() - bg;
+
+    vector<uint32_t> latencies;
+    for (auto& r : results) {
+        if (!r.error.empty()) {
+            M_FATAL("{} failed: {}", c.name, r.error);
+        }
+        latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+    }
+    sort(latencies.begin(), latencies.end());
+
+    Result res;
+    res.name = c.name;
+    res.seconds = elapsed.count();
+    res.ops = latencies.size();
+    res.iops = res.ops / res.seconds;
+    res.mbps = res.iops * g_config.bs / 1e6;
+    res.p50 = percentile(latencies, 50);
+    res.p90 = percentile(latencies, 90);
+    res.p99 = percentile(latencies, 99);
+    res.p999 = percentile(latencies, 99.9);
+    res.max = latencies.empty() ? 0 : latencies.back() / 1e3;
+    co_return res;
+}
+
+void print_table(const vector<Result>& results) {
+    fmt::print("bs: {}, qd: {}, size: {} MB, ops: {}, threads: {}, direct: {}\n",
+        g_config.bs, g_config.qd, g_config.size >> 20, g_config.ops, g_config.threads, g_config.direct);
+    fmt::print("{:<11}{:>11}{:>10}{:>10}{:>10}{:>10}{:>10}{:>10}\n",
+        "case", "IOPS", "MB/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for (auto& r : results) {
+        fmt::print("{:<11}{:>11.0f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}\n",
+            r.name, r.iops, r.mbps, r.p50, r.p90, r.p99, r.p999, r.max);
+    }
+}
+
+void print_json(const vector<Result>& results) {
+    fmt::print("{{\"config\": {{\"bs\": {}, \"qd\": {}, \"size\": {}, \"ops\": {}, \"threads\": {}, \"direct\": {}}}, \"results\": [",
+        g_config.bs, g_config.qd, g_config.size, g_config.ops, g_config.threads, g_config.direct);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        fmt::print("{}{{\"rw\": \"{}\", \"seconds\": {:.6f}, \"ops\": {}, \"iops\": {:.1f}, \"bw_mbps\": {:.2f}, "
+            "\"lat_us\": {{\"p50\": {:.2f}, \"p90\": {:.2f}, \"p99\": {:.2f}, \"p99.9\": {:.2f}, \"max\": {:.2f}}}}}",
+            i == 0 ? "" : ", ", r.name, r.seconds, r.ops, r.iops, r.mbps, r.p50, r.p90, r.p99, r.p999, r.max);
+    }
+    fmt::print("]}}\n");
+}
+
+Coro<> amain() {
+    bool temporary = g_config.file.empty();
+    string path = temporary ? "bench-file.dat" : g_config.file;
+    prepare_file(path);
+
+    vector<Result> results;
+    for (const Case& c : kCases) {
+        if (g_config.rw == "all" || g_config.rw == c.name) {
+            results.push_back(co_await run_case(path, c));
+        }
+    }
+    if (g_config.json) {
+        print_json(results);
+    } else {
+        print_table(results);
+    }
+
+    if (temporary) {
+        error_code ec;
+        filesystem::remove(path, ec);
+    }
+    co_return this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    g_config = parse_args(argc, argv);
+
+    // every thread has qd requests in flight plus room for the rest
+    CoroContextPool pool(g_config.threads, max<size_t>(64, g_config.qd * 2));
+    g_pool = &pool;
+    pool.get(0).spawn(amain());
+    pool.start_all();
+}
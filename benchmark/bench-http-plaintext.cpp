@@ -0,0 +1,133 @@
+#include "net_bench.h"
+
+using namespace std;
+using namespace magio;
+using namespace magio::bench;
+
+// usage: bench-http-plaintext [pipeline=1] [key=value ...], the common options are in net_bench.h
+// A keep-alive HTTP/1.1 server answering every request with the 13 bytes of hello world, like the
+// plaintext test of the TechEmpower benchmarks. Every client writes pipeline requests at once and
+// then reads the responses, latency is the time of the whole batch. size is not used
+
+size_t g_pipeline = 1;
+
+constexpr string_view kRequest =
+    "GET /plaintext HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Accept: text/plain\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+constexpr string_view kResponse =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: magio\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 13\r\n"
+    "\r\n"
+    "Hello, World!";
+
+Coro<> serve(net::Socket socket) {
+    BufReader reader(socket);
+    BufWriter writer(socket);
+    for (; ;) {
+        error_code ec;
+        // only the end of the headers matters, requests have no body
+        string_view line = co_await reader.read_until('\n', ec);
+        if (ec || line.empty()) {
+            break;
+        }
+        if (line != "\r\n") {
+            continue;
+        }
+        co_await writer.write(kResponse.data(), kResponse.size(), ec);
+        // answers to pipelined requests go out together
+        if (!ec && reader.buffered().empty()) {
+            co_await writer.flush(ec);
+        }
+        if (ec) {
+            break;
+        }
+    }
+}
+
+// Reads one response, returns its size or 0 on error
+Coro<size_t> read_response(BufReader<net::Socket>& reader, error_code& ec) {
+    size_t total = 0;
+    size_t content_length = 0;
+    for (; ;) {
+        string_view line = co_await reader.read_until('\n', ec);
+        if (ec || line.empty()) {
+            co_return 0;
+        }
+        total += line.size();
+        if (line == "\r\n") {
+            break;
+        }
+        constexpr string_view kLength = "Content-Length: ";
+        if (line.starts_with(kLength)) {
+            content_length = stoull(string(line.substr(kLength.size())));
+        }
+    }
+    string_view body = co_await reader.read_exact(content_length, ec);
+    if (ec || body.size() != content_length) {
+        co_return 0;
+    }
+    co_return total + body.size();
+}
+
+Coro<> client(size_t id, ClientStats& stats, Window window) {
+    error_code ec;
+    net::Socket socket;
+    co_await connect_tcp(socket, ec);
+    if (ec) {
+        stats.error("connect", ec);
+        co_return;
+    }
+
+    string batch;
+    for (size_t i = 0; i < g_pipeline; ++i) {
+        batch += kRequest;
+    }
+    BufReader reader(socket);
+    while (window.running()) {
+        auto start = TimerClock::now();
+        bool sent = co_await send_all(socket, batch.data(), batch.size(), ec);
+        if (!sent) {
+            stats.error("send", ec);
+            break;
+        }
+        size_t bytes = batch.size();
+        for (size_t i = 0; i < g_pipeline && bytes; ++i) {
+            size_t len = co_await read_response(reader, ec);
+            bytes = len ? bytes + len : 0;
+        }
+        if (bytes == 0) {
+            stats.error("response", ec);
+            break;
+        }
+        stats.record(window, start, bytes, g_pipeline);
+    }
+    socket.shutdown(net::Socket::Both);
+}
+
+Coro<> amain() {
+    net::Acceptor acceptor;
+    listen_tcp(acceptor);
+    this_context::spawn(serve_tcp(acceptor, serve));
+
+    vector<NetResult> results;
+    results.push_back(co_await run_clients(fmt::format("pipeline {}", g_pipeline), client));
+    print_results("bench-http-plaintext", results);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    g_net_config = parse_net_args(argc, argv, 8802, [](const string& key, const string& value) {
+        if (key == "pipeline") {
+            g_pipeline = max<size_t>(stoull(value), 1);
+            return true;
+        }
+        return false;
+    });
+    run_net_bench(amain());
+}
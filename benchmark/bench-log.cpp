@@ -0,0 +1,69 @@
+// trace calls are compiled out in this file
+#define MAGIO_LOG_LEVEL 1
+
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+
+// usage: bench-log [iterations]
+
+size_t g_iters = 1e7;
+
+volatile size_t g_sink = 0;
+
+// What a log call costs when the level is checked after the arguments are built
+template<typename...Args>
+[[gnu::noinline]] void eager_log(LogLevel level, fmt::format_string<Args...> fmt, Args&&...args) {
+    if (!Logger::enabled(level)) {
+        return;
+    }
+    g_sink = g_sink + fmt::formatted_size(fmt::runtime(fmt::string_view(fmt)), args...);
+}
+
+template<typename Func>
+double measure(Func func) {
+    auto bg = chrono::steady_clock::now();
+    for (size_t i = 0; i < g_iters; ++i) {
+        func(i);
+        g_sink = g_sink + 1;
+    }
+    chrono::duration<double, nano> dif = chrono::steady_clock::now() - bg;
+    return dif.count() / g_iters;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        g_iters = std::stoull(argv[1]);
+    }
+
+    Logger::set_level(LogLevel::Info);
+
+    double empty = measure([](size_t) { });
+
+    double compiled_out = measure([](size_t i) {
+        M_TRACE("{} {}", i, to_string(i));
+    });
+
+    double runtime_off = measure([](size_t i) {
+        M_DEBUG("{} {}", i, to_string(i));
+    });
+
+    double eager_off = measure([](size_t i) {
+        eager_log(LogLevel::Debug, "{} {}", i, to_string(i));
+    });
+
+    Logger::start_async([](string_view) { });
+    double async_on = measure([](size_t i) {
+        M_INFO("{} {}", i, "enabled");
+    });
+    Logger::stop_async();
+
+    fmt::print("iterations: {}\n", g_iters);
+    fmt::print("{:<36}{:>10}\n", "case", "ns/call");
+    fmt::print("{:<36}{:>10.2f}\n", "empty loop", empty);
+    fmt::print("{:<36}{:>10.2f}\n", "compiled out (M_TRACE)", compiled_out);
+    fmt::print("{:<36}{:>10.2f}\n", "disabled at runtime (M_DEBUG)", runtime_off);
+    fmt::print("{:<36}{:>10.2f}\n", "disabled, eager arguments", eager_off);
+    fmt::print("{:<36}{:>10.2f}\n", "enabled, async backend (M_INFO)", async_on);
+}
@@ -0,0 +1,146 @@
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include "magio-v3/magio.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace magio;
+
+// usage: bench-mmap [file size in MB] [reads] [read size]
+// Random reads through read_at against views of a MappedFile, with the page cache warm and cold.
+// Cold runs drop the file from the page cache first, which only works on linux
+
+size_t g_file_size = 256 << 20;
+size_t g_reads = 100000;
+size_t g_read_size = 4096;
+
+const char* kPath = "bench-mmap.dat";
+
+volatile size_t g_sink = 0;
+
+void make_file() {
+    ofstream out(kPath, ios::binary | ios::trunc);
+    string block(1 << 20, '\0');
+    mt19937_64 rng(1);
+    for (size_t written = 0; written < g_file_size; written += block.size()) {
+        for (auto& ch : block) {
+            ch = (char)rng();
+        }
+        out.write(block.data(), min(block.size(), g_file_size - written));
+    }
+}
+
+bool drop_cache() {
+#ifdef __linux__
+    int fd = ::open(kPath, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    int ret = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    return ret == 0;
+#else
+    return false;
+#endif
+}
+
+vector<size_t> random_offsets() {
+    mt19937_64 rng(42);
+    uniform_int_distribution<size_t> dist(0, g_file_size / g_read_size - 1);
+    vector<size_t> offsets(g_reads);
+    for (auto& off : offsets) {
+        off = dist(rng) * g_read_size;
+    }
+    return offsets;
+}
+
+// ns per read
+Coro<double> bench_read_at(const vector<size_t>& offsets) {
+    error_code ec;
+    RandomAccessFile file;
+    co_await file.open(kPath, RandomAccessFile::ReadOnly, ec);
+    if (ec) {
+        M_FATAL("cannot open {}: {}", kPath, ec.message());
+    }
+    vector<char> buf(g_read_size);
+
+    auto bg = TimerClock::now();
+    for (size_t off : offsets) {
+        size_t rd = co_await file.read_at(off, buf.data(), buf.size(), ec);
+        g_sink = g_sink + rd + buf[0];
+    }
+    chrono::duration<double, nano> dif = TimerClock::now() - bg;
+    co_await file.close(ec);
+    co_return dif.count() / offsets.size();
+}
+
+Coro<double> bench_mapped(const vector<size_t>& offsets, bool prefetch) {
+    error_code ec;
+    MappedFile file(kPath, ec);
+    if (ec) {
+        M_FATAL("cannot map {}: {}", kPath, ec.message());
+    }
+    file.advise(MappedFile::Random, ec);
+    vector<char> buf(g_read_size);
+
+    auto bg = TimerClock::now();
+    if (prefetch) {
+        co_await file.prefetch(0, file.size(), ec);
+    }
+    for (size_t off : offsets) {
+        // copied out so both sides do the same work
+        auto view = file.view(off, g_read_size);
+        memcpy(buf.data(), view.data(), view.size());
+        g_sink = g_sink + view.size() + buf[0];
+    }
+    chrono::duration<double, nano> dif = TimerClock::now() - bg;
+    co_return dif.count() / offsets.size();
+}
+
+Coro<> bench() {
+    make_file();
+    auto offsets = random_offsets();
+
+    fmt::print("file: {} MB, reads: {}, read size: {}\n", g_file_size >> 20, g_reads, g_read_size);
+    fmt::print("{:<32}{:>12}\n", "case", "ns/read");
+
+    // one pass to warm the page cache
+    co_await bench_read_at(offsets);
+    fmt::print("{:<32}{:>12.0f}\n", "warm read_at", co_await bench_read_at(offsets));
+    fmt::print("{:<32}{:>12.0f}\n", "warm mapped", co_await bench_mapped(offsets, false));
+
+    if (drop_cache()) {
+        fmt::print("{:<32}{:>12.0f}\n", "cold read_at", co_await bench_read_at(offsets));
+        drop_cache();
+        fmt::print("{:<32}{:>12.0f}\n", "cold mapped", co_await bench_mapped(offsets, false));
+        drop_cache();
+        // includes the time the prefetch takes
+        fmt::print("{:<32}{:>12.0f}\n", "cold mapped, prefetched", co_await bench_mapped(offsets, true));
+    }
+
+    error_code ec;
+    filesystem::remove(kPath, ec);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        g_file_size = stoull(argv[1]) << 20;
+    }
+    if (argc > 2) {
+        g_reads = stoull(argv[2]);
+    }
+    if (argc > 3) {
+        g_read_size = max<size_t>(stoull(argv[3]), 1);
+    }
+    g_file_size = max(g_file_size, g_read_size);
+
+    CoroContext ctx(128);
+    this_context::spawn(bench());
+    ctx.start();
+}
@@ -0,0 +1,120 @@
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+// usage: bench-mutex [iterations] [contexts] [coros per context]
+
+size_t g_iters = 1e6;
+size_t g_coros = 4;
+
+CoroContextPool* g_pool;
+
+Coro<> uncontended(Channel<int>& done) {
+    Mutex mutex;
+    size_t counter = 0;
+    for (size_t i = 0; i < g_iters; ++i) {
+        auto lock = co_await mutex.lock_guard();
+        ++counter;
+    }
+    co_await done.send(0);
+}
+
+Coro<> contended(Mutex& mutex, size_t& counter, size_t iters, Channel<int>& done) {
+    for (size_t i = 0; i < iters; ++i) {
+        auto lock = co_await mutex.lock_guard();
+        ++counter;
+    }
+    co_await done.send(0);
+}
+
+// one write every 16 ops
+Coro<> read_mostly(SharedMutex& mutex, size_t& counter, size_t iters, Channel<int>& done) {
+    size_t sum = 0;
+    for (size_t i = 0; i < iters; ++i) {
+        if (i % 16 == 0) {
+            auto lock = co_await mutex.lock_guard();
+            ++counter;
+        } else {
+            auto lock = co_await mutex.shared_lock_guard();
+            sum += counter;
+        }
+    }
+    co_await done.send((int)(sum & 1));
+}
+
+// Spawns one coroutine per (context, slot) and waits for all of them
+template<typename Func>
+Coro<chrono::milliseconds> measure(size_t coros_per_ctx, Func func) {
+    size_t contexts = g_pool->size();
+    Channel<int> done;
+    auto bg = TimerClock::now();
+    for (size_t i = 0; i < contexts; ++i) {
+        for (size_t j = 0; j < coros_per_ctx; ++j) {
+            g_pool->get(i).spawn(func(done));
+        }
+    }
+    for (size_t i = 0; i < contexts * coros_per_ctx; ++i) {
+        co_await done.receive();
+    }
+    co_return chrono::duration_cast<chrono::milliseconds>(TimerClock::now() - bg);
+}
+
+void print_row(const char* name, size_t ops, chrono::milliseconds ms) {
+    fmt::print("{:<24}{:>12}{:>10}{:>14.2f}\n", name, ops, ms, ops / 1e3 / std::max<long>(1, ms.count()));
+}
+
+Coro<> amain() {
+    size_t contexts = g_pool->size();
+    size_t total = contexts * g_coros;
+    size_t iters = g_iters / g_coros;
+
+    auto t1 = co_await measure(1, [](Channel<int>& done) {
+        return uncontended(done);
+    });
+
+    Mutex mutex;
+    size_t counter = 0;
+    auto t2 = co_await measure(g_coros, [&](Channel<int>& done) {
+        return contended(mutex, counter, iters, done);
+    });
+    if (counter != total * iters) {
+        M_FATAL("lost updates: {} != {}", counter, total * iters);
+    }
+
+    SharedMutex shared_mutex;
+    size_t shared_counter = 0;
+    auto t3 = co_await measure(g_coros, [&](Channel<int>& done) {
+        return read_mostly(shared_mutex, shared_counter, iters, done);
+    });
+    if (shared_counter != total * ((iters + 15) / 16)) {
+        M_FATAL("lost updates: {} != {}", shared_counter, total * ((iters + 15) / 16));
+    }
+
+    fmt::print("contexts: {}, coros per context: {}\n", contexts, g_coros);
+    fmt::print("{:<24}{:>12}{:>10}{:>14}\n", "case", "ops", "time", "Mops/s");
+    print_row("mutex uncontended", contexts * g_iters, t1);
+    print_row("mutex contended", total * iters, t2);
+    print_row("shared mutex 1/16 write", total * iters, t3);
+
+    co_return this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    size_t contexts = std::thread::hardware_concurrency();
+    if (argc > 1) {
+        g_iters = std::stoull(argv[1]);
+    }
+    if (argc > 2) {
+        contexts = std::stoull(argv[2]);
+    }
+    if (argc > 3) {
+        g_coros = std::max<size_t>(1, std::stoull(argv[3]));
+    }
+
+    CoroContextPool pool(contexts, 64);
+    g_pool = &pool;
+    pool.get(0).spawn(amain());
+    pool.start_all();
+}
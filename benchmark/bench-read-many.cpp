@@ -0,0 +1,125 @@
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+
+// usage: bench-read-many [file size in MB] [reads per case] [block size]
+// Random reads at queue depths 1 to 256, issued by as many coroutines calling read_at
+// or by one read_many per batch. The adjacent columns read runs of neighbouring blocks
+// in shuffled order, as separate reads and coalesced into vectored reads
+
+size_t g_file_size = 256 << 20;
+size_t g_reads = 200000;
+size_t g_block_size = 4096;
+
+const char* kPath = "bench-read-many.dat";
+
+void make_file() {
+    ofstream out(kPath, ios::binary | ios::trunc);
+    string block(1 << 20, 'x');
+    for (size_t written = 0; written < g_file_size; written += block.size()) {
+        out.write(block.data(), min(block.size(), g_file_size - written));
+    }
+}
+
+size_t random_block(mt19937_64& rng) {
+    return rng() % (g_file_size / g_block_size) * g_block_size;
+}
+
+// reads per second
+double per_second(size_t reads, TimerClock::time_point bg) {
+    chrono::duration<double> dif = TimerClock::now() - bg;
+    return reads / dif.count();
+}
+
+Coro<> read_at_worker(RandomAccessFile& file, size_t reads, uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<char> buf(g_block_size);
+    for (size_t i = 0; i < reads; ++i) {
+        error_code ec;
+        co_await file.read_at(random_block(rng), buf.data(), buf.size(), ec);
+        if (ec) {
+            M_FATAL("read failed: {}", ec.message());
+        }
+    }
+}
+
+Coro<double> bench_read_at(RandomAccessFile& file, size_t depth) {
+    vector<Coro<>> coros;
+    for (size_t i = 0; i < depth; ++i) {
+        coros.push_back(read_at_worker(file, g_reads / depth, i));
+    }
+    auto bg = TimerClock::now();
+    co_await when_all(std::move(coros));
+    co_return per_second(g_reads / depth * depth, bg);
+}
+
+Coro<double> bench_read_many(RandomAccessFile& file, size_t depth, bool adjacent, bool coalesce) {
+    mt19937_64 rng(depth);
+    vector<char> bufs(depth * g_block_size);
+    vector<ReadRequest> requests(depth);
+    size_t batches = max<size_t>(g_reads / depth, 1);
+
+    auto bg = TimerClock::now();
+    for (size_t b = 0; b < batches; ++b) {
+        size_t base = random_block(rng) % (g_file_size - depth * g_block_size + 1) / g_block_size * g_block_size;
+        for (size_t i = 0; i < depth; ++i) {
+            size_t offset = adjacent ? base + i * g_block_size : random_block(rng);
+            requests[i] = {offset, bufs.data() + i * g_block_size, g_block_size};
+        }
+        if (adjacent) {
+            shuffle(requests.begin(), requests.end(), rng);
+        }
+
+        error_code ec;
+        co_await file.read_many(requests, ec, coalesce);
+        if (ec) {
+            M_FATAL("read_many failed: {}", ec.message());
+        }
+    }
+    co_return per_second(batches * depth, bg);
+}
+
+Coro<> bench() {
+    make_file();
+    error_code ec;
+    RandomAccessFile file;
+    co_await file.open(kPath, RandomAccessFile::ReadOnly, ec);
+    if (ec) {
+        M_FATAL("cannot open {}: {}", kPath, ec.message());
+    }
+
+    fmt::print("file: {} MB, reads per case: {}, block size: {}\n", g_file_size >> 20, g_reads, g_block_size);
+    fmt::print("{:>6}{:>14}{:>14}{:>16}{:>16}\n", "depth", "read_at/s", "read_many/s", "adjacent/s", "coalesced/s");
+    for (size_t depth = 1; depth <= 256; depth *= 2) {
+        double read_at = co_await bench_read_at(file, depth);
+        double read_many = co_await bench_read_many(file, depth, false, false);
+        double adjacent = co_await bench_read_many(file, depth, true, false);
+        double coalesced = co_await bench_read_many(file, depth, true, true);
+        fmt::print("{:>6}{:>14.0f}{:>14.0f}{:>16.0f}{:>16.0f}\n", depth, read_at, read_many, adjacent, coalesced);
+    }
+
+    co_await file.close(ec);
+    filesystem::remove(kPath, ec);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        g_file_size = stoull(argv[1]) << 20;
+    }
+    if (argc > 2) {
+        g_reads = stoull(argv[2]);
+    }
+    if (argc > 3) {
+        g_block_size = max<size_t>(stoull(argv[3]), 1);
+    }
+    g_file_size = max(g_file_size, 256 * g_block_size);
+
+    CoroContext ctx(128);
+    this_context::spawn(bench());
+    ctx.start();
+}
@@ -0,0 +1,81 @@
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+// usage: bench-sort [num] [threads]
+
+size_t g_num = 1e8;
+
+template<typename Func>
+Coro<chrono::milliseconds> measure(Func func) {
+    auto bg = TimerClock::now();
+    co_await func();
+    co_return chrono::duration_cast<chrono::milliseconds>(TimerClock::now() - bg);
+}
+
+Coro<> amain(ThreadPool& pool) {
+    vector<int> origin(g_num);
+    default_random_engine eng(42);
+    uniform_int_distribution<> uid;
+    for (auto& v : origin) {
+        v = uid(eng);
+    }
+
+    vector<int> expect = origin;
+    auto std_sort = co_await measure([&] {
+        return pool.spawn_blocking([&] {
+            sort(expect.begin(), expect.end());
+        });
+    });
+
+    vector<int> vec = origin;
+    auto par_sort = co_await measure([&] {
+        return parallel_sort(pool, vec.begin(), vec.end());
+    });
+    if (vec != expect) {
+        M_FATAL("{}", "parallel_sort result mismatch");
+    }
+
+    long long expect_sum = 0;
+    auto std_reduce = co_await measure([&] {
+        return pool.spawn_blocking([&] {
+            expect_sum = accumulate(origin.begin(), origin.end(), 0ll);
+        });
+    });
+
+    long long sum = 0;
+    auto par_reduce = co_await measure([&]() -> Coro<> {
+        sum = co_await parallel_reduce(pool, origin.begin(), origin.end(), 0ll);
+    });
+    if (sum != expect_sum) {
+        M_FATAL("{}", "parallel_reduce result mismatch");
+    }
+
+    fmt::print("ints: {}, threads: {}\n", g_num, pool.thread_num());
+    fmt::print("{:<20}{:>12}{:>12}{:>10}\n", "algorithm", "std", "parallel", "speedup");
+    fmt::print("{:<20}{:>12}{:>12}{:>9.2f}x\n", "sort", std_sort, par_sort, (double)std_sort.count() / std::max<long>(1, par_sort.count()));
+    fmt::print("{:<20}{:>12}{:>12}{:>9.2f}x\n", "reduce", std_reduce, par_reduce, (double)std_reduce.count() / std::max<long>(1, par_reduce.count()));
+
+    co_return this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    size_t threads = std::thread::hardware_concurrency();
+    if (argc > 1) {
+        g_num = std::stoull(argv[1]);
+    }
+    if (argc > 2) {
+        threads = std::stoull(argv[2]);
+    }
+
+    CoroContext ctx(128);
+    ThreadPool pool(threads);
+    ctx.spawn(amain(pool));
+    pool.start();
+    ctx.start();
+}
@@ -0,0 +1,126 @@
+#include "net_bench.h"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+using namespace std;
+using namespace magio;
+using namespace magio::bench;
+
+// usage: bench-tcp-echo [allocs=0] [key=value ...], the common options are in net_bench.h
+// Every client keeps one connection and sends size bytes, then waits until all of them
+// came back from the echo server before sending again. Latency is one round trip.
+// allocs=1 runs every context on a PoolAllocator and fails if anything uses the heap
+// while client 0 is measuring, the echo loops are expected not to allocate once warm
+
+bool g_check_allocs = false;
+
+atomic<uint64_t> g_heap_allocations{0};
+
+// heap allocations while client 0 was measuring
+uint64_t g_measured_allocations = 0;
+
+void* operator new(size_t size) {
+    g_heap_allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+Coro<> echo(net::Socket socket) {
+    vector<char> buf(64 * 1024);
+    for (; ;) {
+        error_code ec;
+        size_t rd = co_await socket.receive(buf.data(), buf.size(), ec);
+        if (ec || rd == 0) {
+            break;
+        }
+        bool sent = co_await send_all(socket, buf.data(), rd, ec);
+        if (!sent) {
+            break;
+        }
+    }
+}
+
+Coro<> client(size_t id, ClientStats& stats, Window window) {
+    error_code ec;
+    net::Socket socket;
+    co_await connect_tcp(socket, ec);
+    if (ec) {
+        stats.error("connect", ec);
+        co_return;
+    }
+
+    string msg(g_net_config.size, char('a' + id % 26));
+    vector<char> buf(msg.size());
+    bool measuring = false;
+    uint64_t heap_before = 0;
+    while (window.running()) {
+        auto start = TimerClock::now();
+        if (id == 0 && !measuring && start >= window.begin) {
+            measuring = true;
+            heap_before = g_heap_allocations.load(memory_order_relaxed);
+        }
+        bool sent = co_await send_all(socket, msg.data(), msg.size(), ec);
+        if (!sent) {
+            stats.error("send", ec);
+            break;
+        }
+        bool received = co_await receive_all(socket, buf.data(), buf.size(), ec);
+        if (!received) {
+            stats.error("receive", ec);
+            break;
+        }
+        stats.record(window, start, msg.size() * 2);
+    }
+    if (measuring) {
+        g_measured_allocations = g_heap_allocations.load(memory_order_relaxed) - heap_before;
+    }
+    socket.shutdown(net::Socket::Both);
+}
+
+Coro<> amain() {
+    net::Acceptor acceptor;
+    listen_tcp(acceptor);
+    this_context::spawn(serve_tcp(acceptor, echo));
+
+    vector<NetResult> results;
+    results.push_back(co_await run_clients("echo", client));
+    print_results("bench-tcp-echo", results);
+    if (g_check_allocs) {
+        fmt::print("heap allocations while measuring: {}\n", g_measured_allocations);
+        if (g_measured_allocations) {
+            exit(1);
+        }
+    }
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    g_net_config = parse_net_args(argc, argv, 8801, [](const string& key, const string& value) {
+        if (key == "allocs") {
+            g_check_allocs = value == "1";
+            return true;
+        }
+        return false;
+    });
+    vector<unique_ptr<PoolAllocator>> pools;
+    run_net_bench(amain(), [&pools](CoroContextPool& pool) {
+        if (g_check_allocs) {
+            for (size_t i = 0; i < pool.size(); ++i) {
+                pools.push_back(make_unique<PoolAllocator>());
+                pool.get(i).set_allocator(pools.back().get());
+            }
+        }
+    });
+}
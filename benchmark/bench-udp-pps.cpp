@@ -0,0 +1,81 @@
+#include "net_bench.h"
+
+using namespace std;
+using namespace magio;
+using namespace magio::bench;
+
+// usage: bench-udp-pps [key=value ...], the common options are in net_bench.h
+// Every context runs an echo server on its own port from port up. Every client has a socket
+// with one datagram of size bytes in flight, ops/s counts round trips, so twice as many packets
+// go through the stack. A datagram lost on the way stalls its client until the run ends
+
+Coro<> echo(net::Socket socket) {
+    vector<char> buf(64 * 1024);
+    for (; ;) {
+        error_code ec;
+        auto [rd, peer] = co_await socket.receive_from(buf.data(), buf.size(), ec);
+        if (ec) {
+            M_ERROR("receive error: {}", ec.message());
+            continue;
+        }
+        co_await socket.send_to(buf.data(), rd, peer, ec);
+    }
+}
+
+Coro<> client(size_t id, ClientStats& stats, Window window) {
+    error_code ec;
+    net::Socket socket;
+    socket.open(net::Ip::v4, net::Transport::Udp, ec);
+    if (ec) {
+        stats.error("open", ec);
+        co_return;
+    }
+    auto server = loopback(g_net_config.port + id % g_net_config.threads);
+
+    // wakes a client whose datagram got lost
+    auto timer = this_context::expires_until(window.end + chrono::seconds(1), [&socket](bool ok) {
+        if (ok) {
+            socket.cancel();
+        }
+    });
+
+    string msg(g_net_config.size, char('a' + id % 26));
+    vector<char> buf(msg.size() + 1);
+    while (window.running()) {
+        auto start = TimerClock::now();
+        co_await socket.send_to(msg.data(), msg.size(), server, ec);
+        if (ec) {
+            stats.error("send", ec);
+            break;
+        }
+        auto [rd, peer] = co_await socket.receive_from(buf.data(), buf.size(), ec);
+        if (ec) {
+            stats.error("receive", ec);
+            break;
+        }
+        if (rd != msg.size()) {
+            stats.error("short datagram", ec);
+            break;
+        }
+        stats.record(window, start, msg.size() * 2);
+    }
+    timer.cancel();
+}
+
+Coro<> amain() {
+    for (size_t i = 0; i < g_net_config.threads; ++i) {
+        net::Socket socket;
+        bind_udp(socket, g_net_config.port + i);
+        g_net_pool->get(i).spawn(echo(std::move(socket)));
+    }
+
+    vector<NetResult> results;
+    results.push_back(co_await run_clients("echo", client));
+    print_results("bench-udp-pps", results);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    g_net_config = parse_net_args(argc, argv, 8803);
+    run_net_bench(amain());
+}
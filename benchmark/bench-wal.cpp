@@ -0,0 +1,97 @@
+#include <filesystem>
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+
+// usage: bench-wal [max writers] [records per writer] [record size] [max delay in us]
+// Every append waits until its record is durable, so one writer is bound by the fdatasync latency
+// and the commit rate should grow with the writers sharing each sync
+
+size_t g_max_writers = 64;
+size_t g_records = 1000;
+size_t g_record_size = 100;
+chrono::microseconds g_max_delay{0};
+
+const char* kPath = "bench-wal.log";
+
+struct Result {
+    chrono::duration<double> elapsed{0};
+    chrono::duration<double, micro> latency{0};
+    Wal::Stats stats;
+};
+
+Coro<> writer(Wal& wal, Result& result) {
+    string record(g_record_size, 'x');
+    for (size_t i = 0; i < g_records; ++i) {
+        error_code ec;
+        auto bg = TimerClock::now();
+        co_await wal.append(record, ec);
+        if (ec) {
+            M_FATAL("append failed: {}", ec.message());
+        }
+        result.latency += TimerClock::now() - bg;
+    }
+}
+
+Coro<Result> run(size_t writers) {
+    std::error_code ec;
+    filesystem::remove(kPath, ec);
+
+    Wal wal(Wal::Options{.max_delay = g_max_delay});
+    co_await wal.open(kPath, ec);
+    if (ec) {
+        M_FATAL("cannot open {}: {}", kPath, ec.message());
+    }
+
+    Result result;
+    vector<Coro<>> coros;
+    for (size_t i = 0; i < writers; ++i) {
+        coros.push_back(writer(wal, result));
+    }
+    auto bg = TimerClock::now();
+    co_await when_all(std::move(coros));
+    result.elapsed = TimerClock::now() - bg;
+    result.stats = wal.stats();
+
+    co_await wal.close(ec);
+    co_return result;
+}
+
+Coro<> bench() {
+    fmt::print("record size: {}, records per writer: {}, max delay: {}us\n", g_record_size, g_records, g_max_delay.count());
+    fmt::print("{:>8}{:>14}{:>14}{:>14}{:>12}\n", "writers", "commits/s", "records/sync", "latency us", "MB/s");
+    for (size_t writers = 1; writers <= g_max_writers; writers *= 2) {
+        Result result = co_await run(writers);
+        double records = (double)result.stats.records;
+        fmt::print("{:>8}{:>14.0f}{:>14.1f}{:>14.1f}{:>12.2f}\n",
+            writers,
+            records / result.elapsed.count(),
+            records / max<double>((double)result.stats.groups, 1),
+            result.latency.count() / records,
+            result.stats.bytes / result.elapsed.count() / 1e6);
+    }
+
+    std::error_code ec;
+    filesystem::remove(kPath, ec);
+    this_context::stop();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        g_max_writers = max<size_t>(stoull(argv[1]), 1);
+    }
+    if (argc > 2) {
+        g_records = stoull(argv[2]);
+    }
+    if (argc > 3) {
+        g_record_size = stoull(argv[3]);
+    }
+    if (argc > 4) {
+        g_max_delay = chrono::microseconds(stoull(argv[4]));
+    }
+
+    CoroContext ctx(128);
+    this_context::spawn(bench());
+    ctx.start();
+}
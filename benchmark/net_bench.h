@@ -0,0 +1,313 @@
+#ifndef MAGIO_BENCHMARK_NET_BENCH_H_
+#define MAGIO_BENCHMARK_NET_BENCH_H_
+
+#include "magio-v3/magio.h"
+#include "magio-v3/core/histogram.h"
+
+// The load generator shared by the network benchmarks. The server and the clients run in
+// the same CoroContextPool and talk over loopback, clients are spread over the contexts.
+//
+// common options, key=value:
+//   conns=64     concurrent clients
+//   seconds=5    how long the measurement runs
+//   warmup=1     seconds of load before it, not recorded
+//   threads=1    contexts of the CoroContextPool
+//   size=64      payload bytes per request
+//   port=p       the port to listen on, every benchmark has its own default
+//   json=0       print one JSON object instead of a table
+
+namespace magio {
+
+namespace bench {
+
+struct NetConfig {
+    size_t conns = 64;
+    double seconds = 5;
+    double warmup = 1;
+    size_t threads = 1;
+    size_t size = 64;
+    uint16_t port = 0;
+    bool json = false;
+};
+
+// Parses the common options, extra gets the others and returns false for unknown keys
+template<typename Extra>
+inline NetConfig parse_net_args(int argc, char* argv[], uint16_t port, Extra&& extra) {
+    NetConfig config;
+    config.port = port;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) {
+            M_FATAL("expected key=value, got {}", arg);
+        }
+        std::string key = arg.substr(0, eq);
+        std::string value = arg.substr(eq + 1);
+        if (key == "conns") {
+            config.conns = std::max<size_t>(std::stoull(value), 1);
+        } else if (key == "seconds") {
+            config.seconds = std::max(std::stod(value), 0.1);
+        } else if (key == "warmup") {
+            config.warmup = std::max(std::stod(value), 0.0);
+        } else if (key == "threads") {
+            config.threads = std::max<size_t>(std::stoull(value), 1);
+        } else if (key == "size") {
+            config.size = std::max<size_t>(std::stoull(value), 1);
+        } else if (key == "port") {
+            config.port = (uint16_t)std::stoul(value);
+        } else if (key == "json") {
+            config.json = value == "1";
+        } else if (!extra(key, value)) {
+            M_FATAL("unknown option {}", key);
+        }
+    }
+    return config;
+}
+
+inline NetConfig parse_net_args(int argc, char* argv[], uint16_t port) {
+    return parse_net_args(argc, argv, port, [](const std::string&, const std::string&) {
+        return false;
+    });
+}
+
+// Requests started before begin are warmup, clients stop starting new ones at end
+struct Window {
+    TimerClock::time_point begin;
+    TimerClock::time_point end;
+
+    bool running() const {
+        return TimerClock::now() < end;
+    }
+};
+
+// What the clients of one context measured, only touched from that context
+struct ClientStats {
+    // nanoseconds per request
+    Histogram latency;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    std::string first_error;
+
+    void record(const Window& window, TimerClock::time_point start, uint64_t nbytes, uint64_t n = 1) {
+        if (start < window.begin) {
+            return;
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(TimerClock::now() - start).count();
+        latency.record((uint64_t)ns, n);
+        ops += n;
+        bytes += nbytes;
+    }
+
+    void error(std::string_view what, const std::error_code& ec) {
+        if (errors++ == 0) {
+            first_error = fmt::format("{}: {}", what, ec ? ec.message() : "EOF");
+        }
+    }
+};
+
+struct NetResult {
+    std::string name;
+    double seconds = 0;
+    Histogram latency;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    std::string first_error;
+
+    double ops_per_second() const {
+        return ops / seconds;
+    }
+
+    double mbps() const {
+        return bytes / seconds / 1e6;
+    }
+};
+
+inline NetConfig g_net_config;
+inline CoroContextPool* g_net_pool;
+
+namespace detail {
+
+inline Coro<> run_client(Coro<> client, WaitGroup& wg) {
+    co_await client;
+    wg.done();
+}
+
+}
+
+// Runs make_client(id, stats, window) for every one of conns clients and merges what they measured.
+// A client returns once window.running() turns false
+template<typename MakeClient>
+inline Coro<NetResult> run_clients(std::string name, MakeClient&& make_client) {
+    auto& config = g_net_config;
+    std::vector<ClientStats> stats(config.threads);
+    WaitGroup wg(config.conns);
+
+    Window window;
+    window.begin = TimerClock::now() + std::chrono::duration_cast<TimerClock::duration>(std::chrono::duration<double>(config.warmup));
+    window.end = window.begin + std::chrono::duration_cast<TimerClock::duration>(std::chrono::duration<double>(config.seconds));
+    for (size_t i = 0; i < config.conns; ++i) {
+        size_t ctx = i % config.threads;
+        g_net_pool->get(ctx).spawn(detail::run_client(make_client(i, stats[ctx], window), wg));
+    }
+    co_await wg.async_wait();
+
+    NetResult result;
+    result.name = std::move(name);
+    std::chrono::duration<double> elapsed = window.end - window.begin;
+    result.seconds = elapsed.count();
+    for (auto& s : stats) {
+        result.latency.merge(s.latency);
+        result.ops += s.ops;
+        result.bytes += s.bytes;
+        result.errors += s.errors;
+        if (result.first_error.empty()) {
+            result.first_error = s.first_error;
+        }
+    }
+    co_return result;
+}
+
+inline net::EndPoint loopback(uint16_t port) {
+    std::error_code ec;
+    return net::EndPoint(net::make_address("127.0.0.1", ec), port);
+}
+
+// Accepts on the configured port and runs handler(socket) for every connection,
+// the connections are handed to the contexts in turn
+template<typename Handler>
+inline Coro<> serve_tcp(net::Acceptor& acceptor, Handler handler) {
+    for (size_t n = 0; ; ++n) {
+        std::error_code ec;
+        auto [socket, peer] = co_await acceptor.accept(ec);
+        if (ec) {
+            M_ERROR("accept error: {}", ec.message());
+            continue;
+        }
+        g_net_pool->get(n).spawn(handler(std::move(socket)));
+    }
+}
+
+// The sockets of the previous run can outlive its process for a moment while the kernel
+// tears down its io_uring, so a busy port is retried for a second
+template<typename Bind>
+inline void bind_retrying(uint16_t port, Bind&& bind) {
+    std::error_code ec;
+    for (int i = 0; i < 50; ++i) {
+        ec.clear();
+        bind(loopback(port), ec);
+        if (ec != std::errc::address_in_use) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    if (ec) {
+        M_FATAL("cannot bind port {}: {}", port, ec.message());
+    }
+}
+
+inline void listen_tcp(net::Acceptor& acceptor) {
+    bind_retrying(g_net_config.port, [&](const net::EndPoint& ep, std::error_code& ec) {
+        acceptor.bind_and_listen(ep, ec);
+    });
+}
+
+inline void bind_udp(net::Socket& socket, uint16_t port) {
+    bind_retrying(port, [&](const net::EndPoint& ep, std::error_code& ec) {
+        socket.open(net::Ip::v4, net::Transport::Udp, ec);
+        if (!ec) {
+            socket.bind(ep, ec);
+        }
+    });
+}
+
+inline Coro<> connect_tcp(net::Socket& socket, std::error_code& ec) {
+    socket.open(net::Ip::v4, net::Transport::Tcp, ec);
+    if (ec) {
+        co_return;
+    }
+    co_await socket.connect(loopback(g_net_config.port), ec);
+}
+
+// Sends all of msg, a short send only happens when the peer goes away
+inline Coro<bool> send_all(net::Socket& socket, const char* msg, size_t len, std::error_code& ec) {
+    while (len > 0) {
+        size_t wr = co_await socket.send(msg, len, ec);
+        if (ec || wr == 0) {
+            co_return false;
+        }
+        msg += wr;
+        len -= wr;
+    }
+    co_return true;
+}
+
+inline Coro<bool> receive_all(net::Socket& socket, char* buf, size_t len, std::error_code& ec) {
+    while (len > 0) {
+        size_t rd = co_await socket.receive(buf, len, ec);
+        if (ec || rd == 0) {
+            co_return false;
+        }
+        buf += rd;
+        len -= rd;
+    }
+    co_return true;
+}
+
+inline void print_results(const std::string& title, const std::vector<NetResult>& results) {
+    auto& config = g_net_config;
+    auto us = [](uint64_t ns) {
+        return ns / 1e3;
+    };
+    if (config.json) {
+        fmt::print("{{\"benchmark\": \"{}\", \"config\": {{\"conns\": {}, \"seconds\": {}, \"warmup\": {}, \"threads\": {}, \"size\": {}}}, \"results\": [",
+            title, config.conns, config.seconds, config.warmup, config.threads, config.size);
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto& r = results[i];
+            fmt::print("{}{{\"case\": \"{}\", \"seconds\": {:.3f}, \"ops\": {}, \"ops_per_sec\": {:.1f}, \"mbps\": {:.2f}, \"errors\": {}, "
+                "\"lat_us\": {{\"p50\": {:.2f}, \"p99\": {:.2f}, \"p99.9\": {:.2f}, \"max\": {:.2f}}}}}",
+                i == 0 ? "" : ", ", r.name, r.seconds, r.ops, r.ops_per_second(), r.mbps(), r.errors,
+                us(r.latency.percentile(50)), us(r.latency.percentile(99)), us(r.latency.percentile(99.9)), us(r.latency.max()));
+        }
+        fmt::print("]}}\n");
+        return;
+    }
+
+    fmt::print("{}: conns: {}, seconds: {}, warmup: {}, threads: {}, size: {}\n",
+        title, config.conns, config.seconds, config.warmup, config.threads, config.size);
+    fmt::print("{:<16}{:>12}{:>10}{:>10}{:>10}{:>10}{:>10}{:>8}\n",
+        "case", "ops/s", "MB/s", "p50 us", "p99 us", "p99.9 us", "max us", "errors");
+    for (auto& r : results) {
+        fmt::print("{:<16}{:>12.0f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}{:>8}\n",
+            r.name, r.ops_per_second(), r.mbps(),
+            us(r.latency.percentile(50)), us(r.latency.percentile(99)), us(r.latency.percentile(99.9)), us(r.latency.max()), r.errors);
+    }
+    for (auto& r : results) {
+        if (r.errors) {
+            fmt::print("{}: {} errors, the first one {}\n", r.name, r.errors, r.first_error);
+        }
+    }
+}
+
+// Runs amain on the first context of a pool sized by the config, amain stops the context when done.
+// setup(pool) runs before anything else does
+template<typename Setup>
+inline void run_net_bench(Coro<> amain, Setup&& setup) {
+    // a full submission queue is flushed early, so the entries only need to cover the usual batch
+    CoroContextPool pool(g_net_config.threads, std::clamp<size_t>(g_net_config.conns * 2, 256, 4096));
+    g_net_pool = &pool;
+    setup(pool);
+    pool.get(0).spawn(std::move(amain));
+    pool.start_all();
+}
+
+inline void run_net_bench(Coro<> amain) {
+    run_net_bench(std::move(amain), [](CoroContextPool&) { });
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+Coro<> produce(Channel<int>& ch) {
+    for (int i = 0; i < 100; ++i) {
+        co_await ch.send(i);
+    }
+    ch.close();
+}
+
+Coro<> square(Channel<int>& in, Channel<int>& out) {
+    while (auto v = co_await in.receive()) {
+        co_await out.send(*v * *v);
+    }
+    out.close();
+}
+
+Coro<> consume(Channel<int>& ch) {
+    int sum = 0;
+    vector<int> batch;
+    while (co_await ch.receive_many(batch, 16)) {
+        for (int v : batch) {
+            sum += v;
+        }
+        batch.clear();
+    }
+    M_INFO("sum: {}", sum);
+    this_context::stop();
+}
+
+int main() {
+    CoroContextPool pool(3, 64);
+    Channel<int> numbers(8, ChannelMode::Spsc);
+    Channel<int> squares(8, ChannelMode::Spsc);
+    pool.get(1).spawn(produce(numbers));
+    pool.get(2).spawn(square(numbers, squares));
+    pool.get(0).spawn(consume(squares));
+    pool.start_all();
+}
@@ -28,6 +28,10 @@ Coro<> accept(net::Acceptor acceptor) {
     for (; ;) {
         error_code ec;
         auto [socket, peer] = co_await acceptor.accept(ec);
+        if (ec == errc::operation_canceled) {
+            // the context is shutting down
+            break;
+        }
         if (ec) {
             M_ERROR("accept error: {}", ec.message());
         } else {
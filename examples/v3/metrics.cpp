@@ -0,0 +1,34 @@
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+// curl http://127.0.0.1:9100/metrics
+
+Coro<> work() {
+    auto& ticks = metrics::Registry::global().counter("example_ticks_total", "Ticks of the example");
+    for (; ;) {
+        co_await this_coro::sleep_for(100ms);
+        ticks.add();
+    }
+}
+
+Coro<> amain() {
+    error_code ec;
+    net::EndPoint local(net::make_address("127.0.0.1", ec), 9100);
+    this_context::spawn(work());
+    co_await net::serve_metrics(local, ec);
+    if (ec) {
+        M_FATAL("cannot serve metrics: {}", ec.message());
+    }
+}
+
+int main() {
+    CoroContext ctx(128);
+    // magio_allocations_total and friends count only allocations made through an allocator
+    PoolAllocator pool;
+    ctx.set_allocator(&pool);
+    this_context::spawn(amain());
+    ctx.start();
+}
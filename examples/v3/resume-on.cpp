@@ -0,0 +1,52 @@
+#include "magio-v3/magio.h"
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+CoroContextPool* g_ctx_pool;
+ThreadPool* g_thread_pool;
+
+size_t count_primes(size_t n) {
+    size_t count = 0;
+    for (size_t i = 2; i < n; ++i) {
+        bool prime = true;
+        for (size_t j = 2; j * j <= i; ++j) {
+            if (i % j == 0) {
+                prime = false;
+                break;
+            }
+        }
+        count += prime;
+    }
+    return count;
+}
+
+Coro<> pipeline() {
+    for (size_t n = 100000; n <= 1000000; n *= 10) {
+        co_await this_coro::sleep_for(10ms);
+        M_INFO("read {} on thread {}", n, CurrentThread::get_id());
+
+        // the heavy part leaves the io threads alone
+        co_await this_coro::resume_on(*g_thread_pool);
+        size_t primes = count_primes(n);
+        M_INFO("{} primes below {} on thread {}", primes, n, CurrentThread::get_id());
+
+        co_await this_coro::resume_on(g_ctx_pool->get(1));
+        M_INFO("write {} on thread {}", primes, CurrentThread::get_id());
+
+        co_await this_coro::resume_on(g_ctx_pool->get(0));
+    }
+    this_context::stop();
+}
+
+int main() {
+    ThreadPool thread_pool(4);
+    thread_pool.start();
+    g_thread_pool = &thread_pool;
+
+    CoroContextPool ctx_pool(2, 64);
+    g_ctx_pool = &ctx_pool;
+    this_context::spawn(pipeline());
+    ctx_pool.start_all();
+}
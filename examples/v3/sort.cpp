@@ -6,27 +6,6 @@ using namespace std;
 using namespace magio;
 using namespace chrono_literals;
 
-template<typename Iter, typename Pred>
-Coro<> fork_join_sort(ThreadPool& exe, Iter bg, Iter ed, Pred pred, size_t times) {
-    if (bg >= ed) {
-        co_return;
-    }
-
-    if (times > 0) {
-        auto mid = bg + (ed - bg) / 2;
-        nth_element(bg, mid, ed, pred);
-        co_await join(
-            fork_join_sort(exe, bg, mid, pred, times - 1),
-            fork_join_sort(exe, mid + 1, ed, pred, times - 1)
-        );
-    } else {
-        co_await exe.spawn_blocking([bg, ed, pred] {
-            sort(bg, ed, pred);
-        });
-    }
-    co_return;
-}
-
 Coro<> amain(ThreadPool& pool) {
     vector<int> vec(1e8);
     random_device dev;
@@ -38,7 +17,7 @@ Coro<> amain(ThreadPool& pool) {
     
     auto bg = TimerClock::now();
     // sort(vec.begin(), vec.end(), greater<>());
-    co_await fork_join_sort(pool, vec.begin(), vec.end(), greater<>(), 3);
+    co_await parallel_sort(pool, vec.begin(), vec.end(), greater<>());
     auto dif = TimerClock::now() - bg;
     M_INFO("{}", chrono::duration_cast<chrono::milliseconds>(dif));
 
@@ -51,4 +30,4 @@ int main() {
     ctx.spawn(amain(pool));
     pool.start();
     ctx.start();
-}
\ No newline at end of file
+}
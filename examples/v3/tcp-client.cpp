@@ -24,19 +24,19 @@ Coro<> client() {
         M_FATAL("connect error: {}", ec.message());
     }
  
-    char buf[1024];
+    BufReader reader(socket);
     for (int i = 0; i < 5; ++i) {
-        co_await socket.send("hello server", 12, ec);
+        co_await socket.send("hello server\n", 13, ec);
         if (ec) {
             M_ERROR("send error: {}", ec.message());
             break;
         }
-        size_t rd = co_await socket.receive(buf, sizeof(buf), ec);
-        if (ec || rd == 0) {
+        string_view line = co_await reader.read_until('\n', ec);
+        if (ec || line.empty()) {
             M_ERROR("recv error: {}", ec ? ec.message() : "EOF");
             break;
         }
-        M_INFO("{}", string_view(buf, rd));
+        M_INFO("{}", line.substr(0, line.size() - 1));
     }
     this_context::stop();
 }
@@ -4,17 +4,23 @@ using namespace std;
 using namespace magio;
 using namespace chrono_literals;
 
+// echoes every line back
 Coro<> handle_connection(net::Socket sock) {
-    char buf[1024];
+    BufReader reader(sock);
+    BufWriter writer(sock);
     for (; ;) {
         error_code ec;
-        size_t rd = co_await sock.receive(buf, sizeof(buf), ec);
-        if (ec || rd == 0) {
+        string_view line = co_await reader.read_until('\n', ec);
+        if (ec || line.empty()) {
             M_ERROR("recv error: {}", ec ? ec.message() : "EOF");
             break;
         }
-        M_INFO("receive: {}", string_view(buf, rd));
-        co_await sock.send(buf, rd, ec);
+        M_INFO("receive: {}", line.substr(0, line.size() - 1));
+        co_await writer.write(line, ec);
+        // only pay for a send once the peer has nothing more queued
+        if (!ec && reader.buffered().empty()) {
+            co_await writer.flush(ec);
+        }
         if (ec) {
             M_ERROR("send error: {}", ec.message());
             break;
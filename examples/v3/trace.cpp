@@ -0,0 +1,42 @@
+#include "magio-v3/magio.h"
+
+#include <thread>
+#include <fstream>
+
+using namespace std;
+using namespace magio;
+using namespace chrono_literals;
+
+// xmake f --trace=y && xmake build trace && xmake run trace
+// then open trace.json in ui.perfetto.dev
+
+Coro<> tick() {
+    for (int i = 0; i < 20; ++i) {
+        co_await this_coro::sleep_for(10ms);
+    }
+}
+
+Coro<> blocking() {
+    co_await this_coro::sleep_for(50ms);
+    // every other coroutine of the context waits meanwhile, the watchdog reports this spawn site
+    this_thread::sleep_for(100ms);
+}
+
+Coro<> amain() {
+    auto begin = TimerClock::now();
+    TaskGroup group;
+    group.spawn(tick());
+    group.spawn(blocking());
+    co_await group.wait();
+
+    ofstream("trace.json") << trace::chrome_trace(begin, TimerClock::now());
+    this_context::stop();
+}
+
+int main() {
+    trace::start({.stall_threshold = 20ms});
+    CoroContext ctx(128);
+    this_context::spawn(amain());
+    ctx.start();
+    trace::stop();
+}
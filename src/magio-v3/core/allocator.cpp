@@ -0,0 +1,104 @@
+#include "magio-v3/core/allocator.h"
+
+#include <mutex>
+
+#include "magio-v3/core/metrics.h"
+
+namespace magio {
+
+namespace {
+
+// In front of every block, keeps the blocks aligned as operator new would.
+// A null allocator means the heap
+struct alignas(std::max_align_t) Header {
+    Allocator* allocator;
+    metrics::ContextMetrics* metrics;
+};
+
+}
+
+const char* alloc_category_name(AllocCategory category) {
+    switch (category) {
+    case AllocCategory::Frame: return "frame";
+    case AllocCategory::Timer: return "timer";
+    case AllocCategory::Io: return "io";
+    case AllocCategory::Queue: return "queue";
+    case AllocCategory::Buffer: return "buffer";
+    }
+    return "unknown";
+}
+
+PoolAllocator::~PoolAllocator() {
+    for (size_t i = 0; i < std::size(free_); ++i) {
+        for (auto block = free_[i]; block; ) {
+            auto next = block->next;
+            ::operator delete(block, (i + 1) * kGranularity);
+            block = next;
+        }
+    }
+}
+
+void* PoolAllocator::allocate(size_t size, AllocCategory category) {
+    if (size > kMaxPooled) {
+        return ::operator new(size);
+    }
+    size_t i = (size - 1) / kGranularity;
+    {
+        std::lock_guard lk(lock_);
+        if (auto block = free_[i]) {
+            free_[i] = block->next;
+            return block;
+        }
+    }
+    return ::operator new((i + 1) * kGranularity);
+}
+
+void PoolAllocator::deallocate(void* p, size_t size, AllocCategory category) {
+    if (size > kMaxPooled) {
+        ::operator delete(p, size);
+        return;
+    }
+    size_t i = (size - 1) / kGranularity;
+    auto block = static_cast<FreeBlock*>(p);
+    std::lock_guard lk(lock_);
+    block->next = free_[i];
+    free_[i] = block;
+}
+
+namespace detail {
+
+void* allocate(size_t size, AllocCategory category) {
+    return allocate(size, category, LocalAllocState);
+}
+
+void* allocate(size_t size, AllocCategory category, AllocState* state) {
+    if (!state || !state->allocator) {
+        auto header = static_cast<Header*>(::operator new(size + sizeof(Header)));
+        header->allocator = nullptr;
+        return header + 1;
+    }
+
+    auto header = static_cast<Header*>(state->allocator->allocate(size + sizeof(Header), category));
+    header->allocator = state->allocator;
+    header->metrics = state->metrics;
+    auto c = (size_t)category;
+    state->metrics->allocations[c].add();
+    state->metrics->allocated_bytes[c].add(size);
+    state->metrics->live_bytes[c].add((int64_t)size);
+    return header + 1;
+}
+
+void deallocate(void* p, size_t size, AllocCategory category) {
+    auto header = static_cast<Header*>(p) - 1;
+    if (!header->allocator) {
+        ::operator delete(header, size + sizeof(Header));
+        return;
+    }
+
+    header->metrics->live_bytes[(size_t)category].add(-(int64_t)size);
+    header->allocator->deallocate(header, size + sizeof(Header), category);
+}
+
+}
+
+}
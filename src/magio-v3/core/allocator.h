@@ -0,0 +1,158 @@
+#ifndef MAGIO_CORE_ALLOCATOR_H_
+#define MAGIO_CORE_ALLOCATOR_H_
+
+#include <new>
+#include <cstddef>
+#include <utility>
+
+#include "magio-v3/core/spin_lock.h"
+#include "magio-v3/core/noncopyable.h"
+
+namespace magio {
+
+namespace metrics {
+
+struct ContextMetrics;
+
+}
+
+// What the library allocates for, allocations are counted by category
+enum class AllocCategory {
+    // coroutine frames, those of user coroutines included
+    Frame,
+    // timers and the queue they wait in
+    Timer,
+    // io operations started through the callback apis
+    Io,
+    // run queues of the contexts
+    Queue,
+    // accept address buffers
+    Buffer,
+};
+
+inline constexpr size_t kAllocCategories = 5;
+
+const char* alloc_category_name(AllocCategory category);
+
+// Library allocations made on the thread of a context go through the allocator set with
+// CoroContext::set_allocator. A block may be freed on another thread than the one it came from,
+// the allocator and the context have to outlive every block allocated through them.
+// The library asks for a few more bytes than it uses, to remember where a block goes back to
+class Allocator {
+public:
+    virtual ~Allocator() = default;
+
+    virtual void* allocate(size_t size, AllocCategory category) = 0;
+
+    virtual void deallocate(void* p, size_t size, AllocCategory category) = 0;
+};
+
+// Keeps freed blocks in free lists by size instead of returning them to the heap,
+// so a workload in a steady state stops allocating. Blocks larger than kMaxPooled are not pooled,
+// the others go back to the heap when the pool is destroyed
+class PoolAllocator: public Allocator, Noncopyable {
+public:
+    static constexpr size_t kGranularity = 64;
+    static constexpr size_t kMaxPooled = 4096;
+
+    ~PoolAllocator();
+
+    void* allocate(size_t size, AllocCategory category) override;
+
+    void deallocate(void* p, size_t size, AllocCategory category) override;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    SpinLock lock_;
+    FreeBlock* free_[kMaxPooled / kGranularity]{};
+};
+
+namespace detail {
+
+// One per context, what its blocks return to
+struct AllocState {
+    Allocator* allocator = nullptr;
+    metrics::ContextMetrics* metrics = nullptr;
+};
+
+// Set on the thread of every context
+inline thread_local AllocState* LocalAllocState = nullptr;
+
+// Through the allocator of the context of this thread if it has one, the heap otherwise
+void* allocate(size_t size, AllocCategory category);
+
+// Through the allocator of the context state belongs to
+void* allocate(size_t size, AllocCategory category, AllocState* state);
+
+void deallocate(void* p, size_t size, AllocCategory category);
+
+template<typename T, typename...Args>
+inline T* make(AllocCategory category, Args&&...args) {
+    void* p = allocate(sizeof(T), category);
+    try {
+        return new (p) T(std::forward<Args>(args)...);
+    } catch (...) {
+        deallocate(p, sizeof(T), category);
+        throw;
+    }
+}
+
+template<typename T>
+inline void destroy(T* p, AllocCategory category) {
+    p->~T();
+    deallocate(p, sizeof(T), category);
+}
+
+// For the standard containers and std::allocate_shared
+template<typename T, AllocCategory Category>
+class CategoryAllocator {
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = CategoryAllocator<U, Category>;
+    };
+
+    CategoryAllocator() = default;
+
+    // a container other threads insert into, such as a run queue, belongs to one context
+    explicit CategoryAllocator(AllocState* state)
+        : state_(state) { }
+
+    template<typename U>
+    CategoryAllocator(const CategoryAllocator<U, Category>& other)
+        : state_(other.state()) { }
+
+    T* allocate(size_t n) {
+        if (state_) {
+            return static_cast<T*>(detail::allocate(n * sizeof(T), Category, state_));
+        }
+        return static_cast<T*>(detail::allocate(n * sizeof(T), Category));
+    }
+
+    void deallocate(T* p, size_t n) {
+        detail::deallocate(p, n * sizeof(T), Category);
+    }
+
+    AllocState* state() const {
+        return state_;
+    }
+
+    template<typename U>
+    bool operator==(const CategoryAllocator<U, Category>& other) const {
+        return state_ == other.state();
+    }
+
+private:
+    AllocState* state_ = nullptr;
+};
+
+}
+
+}
+
+#endif
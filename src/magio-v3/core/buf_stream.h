@@ -0,0 +1,229 @@
+#ifndef MAGIO_CORE_BUF_STREAM_H_
+#define MAGIO_CORE_BUF_STREAM_H_
+
+#include <system_error>
+
+#include "magio-v3/core/coro.h"
+#include "magio-v3/core/scan.h"
+#include "magio-v3/core/buffer.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+constexpr size_t kStreamBufferSize = 16 * 1024;
+
+namespace detail {
+
+// net::Socket names its operations send/receive, pipes and files read/write
+template<typename Stream>
+concept HasReceive = requires(Stream& s, char* buf, size_t len, std::error_code& ec) {
+    s.receive(buf, len, ec);
+};
+
+template<typename Stream>
+concept HasSend = requires(Stream& s, const char* msg, size_t len, std::error_code& ec) {
+    s.send(msg, len, ec);
+};
+
+template<typename Stream>
+inline Coro<size_t> stream_read(Stream& s, char* buf, size_t len, std::error_code& ec) {
+    if constexpr (HasReceive<Stream>) {
+        return s.receive(buf, len, ec);
+    } else {
+        return s.read(buf, len, ec);
+    }
+}
+
+template<typename Stream>
+inline Coro<size_t> stream_write(Stream& s, const char* msg, size_t len, std::error_code& ec) {
+    if constexpr (HasSend<Stream>) {
+        return s.send(msg, len, ec);
+    } else {
+        return s.write(msg, len, ec);
+    }
+}
+
+}
+
+// Reads from a net::Socket, ReadablePipe or File through a buffer, so small reads and
+// delimiter scans cost one syscall per capacity bytes.
+// Views returned by read_until and read_exact point into the buffer and stay valid until the next call.
+// An empty or short result with ec unset means the stream reached EOF.
+template<typename Stream>
+class BufReader: Noncopyable {
+public:
+    explicit BufReader(Stream& stream, size_t capacity = kStreamBufferSize)
+        : stream_(stream), capacity_(std::max<size_t>(capacity, 1)), buf_(capacity_)
+    { }
+
+    // Returns the bytes up to and including delim, the line grows the buffer if it does not fit
+    [[nodiscard]]
+    Coro<std::string_view> read_until(char delim, std::error_code& ec) {
+        release();
+        size_t scanned = 0;
+        for (; ;) {
+            size_t pos = find_byte(buf_.slice(scanned), delim);
+            if (pos != std::string_view::npos) {
+                co_return take(scanned + pos + 1);
+            }
+            scanned = buf_.size();
+
+            size_t rd = co_await fill(ec);
+            if (rd == 0) {
+                co_return take(buf_.size());
+            }
+        }
+    }
+
+    // Returns n bytes, or less if the stream ends first
+    [[nodiscard]]
+    Coro<std::string_view> read_exact(size_t n, std::error_code& ec) {
+        release();
+        while (buf_.size() < n) {
+            size_t rd = co_await fill(ec, n - buf_.size());
+            if (rd == 0) {
+                break;
+            }
+        }
+        co_return take(std::min(n, buf_.size()));
+    }
+
+    // Like the read of the stream, reads larger than the buffer bypass it when it is empty
+    [[nodiscard]]
+    Coro<size_t> read(char* buf, size_t len, std::error_code& ec) {
+        release();
+        if (buf_.size() == 0) {
+            if (len >= capacity_) {
+                co_return co_await detail::stream_read(stream_, buf, len, ec);
+            }
+            co_await fill(ec);
+        }
+        size_t cplen = std::min(len, buf_.size());
+        std::memcpy(buf, buf_.data(), cplen);
+        buf_.consume(cplen);
+        co_return cplen;
+    }
+
+    // The bytes read from the stream but not returned yet
+    std::string_view buffered() {
+        release();
+        return buf_.slice();
+    }
+
+    Stream& stream() {
+        return stream_;
+    }
+
+private:
+    // Reads at least once into the free space, asking for no less than least bytes of room
+    Coro<size_t> fill(std::error_code& ec, size_t least = 0) {
+        // a full buffer grows by another capacity
+        size_t room = buf_.size() < capacity_ ? capacity_ - buf_.size() : capacity_;
+        auto span = buf_.prepare(std::max(least, room));
+        size_t rd = co_await detail::stream_read(stream_, span.data(), span.size(), ec);
+        if (ec) {
+            co_return 0;
+        }
+        buf_.commit(rd);
+        co_return rd;
+    }
+
+    std::string_view take(size_t n) {
+        taken_ = n;
+        return buf_.slice(0, n);
+    }
+
+    // the view handed out last time is consumed lazily so it stays valid until the next call
+    void release() {
+        buf_.consume(taken_);
+        taken_ = 0;
+    }
+
+    Stream& stream_;
+    size_t capacity_;
+    Buffer<> buf_;
+    size_t taken_ = 0;
+};
+
+// Coalesces writes to a net::Socket, WritablePipe or File until capacity bytes are buffered.
+// Nothing is written on destruction, call flush before dropping the writer.
+template<typename Stream>
+class BufWriter: Noncopyable {
+public:
+    explicit BufWriter(Stream& stream, size_t capacity = kStreamBufferSize)
+        : stream_(stream), capacity_(std::max<size_t>(capacity, 1)), buf_(capacity_)
+    { }
+
+    // Returns len unless an error occurred, messages larger than the buffer are written directly
+    [[nodiscard]]
+    Coro<size_t> write(const char* msg, size_t len, std::error_code& ec) {
+        if (buf_.size() + len > capacity_) {
+            co_await flush(ec);
+            if (ec) {
+                co_return 0;
+            }
+        }
+
+        if (len >= capacity_) {
+            co_return co_await write_all(msg, len, ec);
+        }
+
+        buf_.append({msg, len});
+        co_return len;
+    }
+
+    [[nodiscard]]
+    Coro<size_t> write(std::string_view msg, std::error_code& ec) {
+        return write(msg.data(), msg.size(), ec);
+    }
+
+    // Writes everything buffered, what could not be written stays buffered on error
+    [[nodiscard]]
+    Coro<> flush(std::error_code& ec) {
+        while (buf_.size() != 0) {
+            size_t wr = co_await detail::stream_write(stream_, buf_.data(), buf_.size(), ec);
+            if (ec) {
+                co_return;
+            }
+            if (wr == 0) {
+                ec = std::make_error_code(std::errc::broken_pipe);
+                co_return;
+            }
+            buf_.consume(wr);
+        }
+    }
+
+    size_t buffered() const {
+        return buf_.size();
+    }
+
+    Stream& stream() {
+        return stream_;
+    }
+
+private:
+    Coro<size_t> write_all(const char* msg, size_t len, std::error_code& ec) {
+        size_t written = 0;
+        while (written < len) {
+            size_t wr = co_await detail::stream_write(stream_, msg + written, len - written, ec);
+            if (ec) {
+                break;
+            }
+            if (wr == 0) {
+                ec = std::make_error_code(std::errc::broken_pipe);
+                break;
+            }
+            written += wr;
+        }
+        co_return written;
+    }
+
+    Stream& stream_;
+    size_t capacity_;
+    Buffer<> buf_;
+};
+#endif
+
+}
+
+#endif
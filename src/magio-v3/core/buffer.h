@@ -1,10 +1,19 @@
 #ifndef MAGIO_CORE_BUFFER_H_
 #define MAGIO_CORE_BUFFER_H_
 
+#include <span>
+#include <deque>
+#include <memory>
 #include <string>
+#include <cstring>
+#include <utility>
+#include <optional>
+#include <algorithm>
 
 #include "fmt/core.h"
 
+#include "magio-v3/core/noncopyable.h"
+
 namespace magio {
 
 constexpr size_t kFormatBufferSize = 500;
@@ -57,6 +66,9 @@ private:
 };
 
 
+// Contiguous byte buffer, readable bytes are [data(), data() + size()).
+// Writers either append() or fill the span from prepare() and commit() what they wrote,
+// consumed space at the front is reused by compaction before the buffer grows.
 template<typename Alloc = std::allocator<char>>
 class Buffer {
     using AllocTraits = std::allocator_traits<Alloc>;
@@ -74,16 +86,15 @@ public:
     }
 
     ~Buffer() {
-        if (data_.buf) {
-            reset();
-        }
+        reset();
     }
 
     Buffer(const Buffer& other)
-        : data_(other.data_)
+        : data_({
+            .alloc = AllocTraits::select_on_container_copy_construction(other.data_.alloc)
+        })
     { 
-        data_.buf = AllocTraits::allocate(data_.alloc, data_.cap);
-        std::memcpy(data_.buf + data_.head, other.data_.buf + data_.head, size());
+        append(other.slice());
     }
 
     Buffer(Buffer&& other) noexcept 
@@ -96,26 +107,48 @@ public:
         if (this == &other) {
             return *this;
         }
-        reset();
-        data_ = other.data_;
-        data_.buf = AllocTraits::allocate(data_.alloc, data_.cap);
-        std::memcpy(data_.buf + data_.head, other.data_.buf + data_.head, size());
+        clear();
+        append(other.slice());
         return *this;
     }
 
     Buffer& operator=(Buffer&& other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+        reset();
         data_ = std::move(other.data_);
         other.bzero();
         return *this;
-    };
+    }
 
     void append(std::string_view msg) {
-        size_t diff = msg.length() - (data_.cap - data_.tail);
-        if (diff > 0) {
-            grow(diff);
+        if (msg.empty()) {
+            return;
         }
-        std::memcpy(data_.buf + data_.tail, msg.data(), msg.length());
-        data_.tail += msg.length();
+        std::memcpy(prepare(msg.length()).data(), msg.data(), msg.length());
+        commit(msg.length());
+    }
+
+    // Returns the whole writable region, which is at least n bytes
+    std::span<char> prepare(size_t n) {
+        if (writable() < n) {
+            make_room(n);
+        }
+        return {data_.buf + data_.tail, writable()};
+    }
+
+    // Makes n bytes written into the span from prepare() readable
+    void commit(size_t n) {
+        data_.tail += std::min(n, writable());
+    }
+
+    size_t writable() const {
+        return data_.cap - data_.tail;
+    }
+
+    const char* data() const {
+        return data_.buf + data_.head;
     }
 
     void consume(size_t len) {
@@ -126,12 +159,12 @@ public:
         }
     }
 
-    std::string_view slice(size_t pos = 0) {
+    std::string_view slice(size_t pos = 0) const {
         // pos -> buf + head + pos
         return slice(pos, size());
     }
 
-    std::string_view slice(size_t pos, size_t count) {
+    std::string_view slice(size_t pos, size_t count) const {
         if (data_.head + pos >= data_.tail) {
             return "";
         }
@@ -140,7 +173,7 @@ public:
     }
 
     void clear() {
-        data_.head_ = data_.tail_ = 0;
+        data_.head = data_.tail = 0;
     }
 
     void reserve(size_t cap) {
@@ -149,26 +182,52 @@ public:
         }
 
         char* new_buf = AllocTraits::allocate(data_.alloc, cap);
-        std::memcpy(new_buf + data_.head, data_.buf + data_.head, size());
-        AllocTraits::deallocate(data_.alloc, data_.buf, data_.cap);
+        size_t len = size();
+        if (len != 0) {
+            std::memcpy(new_buf, data_.buf + data_.head, len);
+        }
+        if (data_.buf) {
+            AllocTraits::deallocate(data_.alloc, data_.buf, data_.cap);
+        }
         data_.buf = new_buf;
         data_.cap = cap;
+        data_.head = 0;
+        data_.tail = len;
+    }
+
+    // Moves the readable bytes to the front
+    void compact() {
+        if (data_.head == 0) {
+            return;
+        }
+        size_t len = size();
+        std::memmove(data_.buf, data_.buf + data_.head, len);
+        data_.head = 0;
+        data_.tail = len;
+    }
+
+    void shrink_to_fit() {
+        if (size() == 0) {
+            reset();
+        }
     }
     
     void reset() {
-        AllocTraits::deallocate(data_.alloc, data_.buf, data_.cap);
+        if (data_.buf) {
+            AllocTraits::deallocate(data_.alloc, data_.buf, data_.cap);
+        }
         bzero();
     }
 
-    void swap(const Buffer& other) noexcept {
+    void swap(Buffer& other) noexcept {
         std::swap(data_, other.data_);
     }
     
-    size_t size() {
+    size_t size() const {
         return data_.tail - data_.head;
     }
 
-    size_t capacity() {
+    size_t capacity() const {
         return data_.cap;
     }
 
@@ -181,9 +240,14 @@ private:
         char* buf = nullptr;
     };
 
-    void grow(size_t least) {
-       size_t new_cap = (data_.cap + least) * 1.5;
-       reserve(new_cap);
+    void make_room(size_t n) {
+        size_t len = size();
+        // only slide when that frees at least half of the buffer, otherwise the copy is wasted
+        if (len + n <= data_.cap && data_.head >= data_.cap / 2) {
+            compact();
+            return;
+        }
+        reserve(std::max({len + n, data_.cap + data_.cap / 2, kMinCapacity}));
     }
 
     void bzero() {
@@ -191,9 +255,203 @@ private:
         data_.buf = nullptr;
     }
 
+    static constexpr size_t kMinCapacity = 64;
+
     Data data_;
 };
 
+// Byte buffer made of fixed size segments, so large messages never move once written.
+// prepare() hands out the free space of the last segment, front() the readable bytes of the first.
+template<typename Alloc = std::allocator<char>>
+class ChainBuffer: Noncopyable {
+    using AllocTraits = std::allocator_traits<Alloc>;
+
+    struct Segment {
+        char* buf;
+        size_t cap;
+        size_t head = 0;
+        size_t tail = 0;
+    };
+
+public:
+    ChainBuffer(size_t segment_size = kSmallBufferSize, Alloc alloc = Alloc{})
+        : alloc_(std::move(alloc)), segment_size_(std::max<size_t>(segment_size, 1))
+    { }
+
+    ~ChainBuffer() {
+        reset();
+    }
+
+    ChainBuffer(ChainBuffer&& other) noexcept
+        : alloc_(std::move(other.alloc_))
+        , segment_size_(other.segment_size_)
+        , segments_(std::move(other.segments_))
+        , spare_(std::exchange(other.spare_, std::nullopt))
+        , size_(std::exchange(other.size_, 0))
+    { }
+
+    ChainBuffer& operator=(ChainBuffer&& other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+        reset();
+        alloc_ = std::move(other.alloc_);
+        segment_size_ = other.segment_size_;
+        segments_ = std::move(other.segments_);
+        spare_ = std::exchange(other.spare_, std::nullopt);
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+
+    void append(std::string_view msg) {
+        while (!msg.empty()) {
+            auto span = prepare(1);
+            size_t cplen = std::min(span.size(), msg.length());
+            std::memcpy(span.data(), msg.data(), cplen);
+            commit(cplen);
+            msg.remove_prefix(cplen);
+        }
+    }
+
+    // Returns the free space of the last segment, which is at least n bytes.
+    // Requests larger than the segment size get a segment of their own
+    std::span<char> prepare(size_t n) {
+        if (segments_.empty() || free_of(segments_.back()) < n) {
+            segments_.push_back(new_segment(n));
+        }
+        Segment& seg = segments_.back();
+        return {seg.buf + seg.tail, free_of(seg)};
+    }
+
+    void commit(size_t n) {
+        if (segments_.empty()) {
+            return;
+        }
+        Segment& seg = segments_.back();
+        n = std::min(n, free_of(seg));
+        seg.tail += n;
+        size_ += n;
+    }
+
+    // The readable bytes of the first segment
+    std::string_view front() {
+        for (Segment& seg : segments_) {
+            if (seg.tail != seg.head) {
+                return {seg.buf + seg.head, seg.tail - seg.head};
+            }
+        }
+        return "";
+    }
+
+    void consume(size_t len) {
+        len = std::min(len, size_);
+        size_ -= len;
+        while (!segments_.empty()) {
+            Segment& seg = segments_.front();
+            size_t real = std::min(len, seg.tail - seg.head);
+            seg.head += real;
+            len -= real;
+            // keep the last segment for the next write
+            if (seg.head != seg.tail || segments_.size() == 1) {
+                if (seg.head == seg.tail) {
+                    seg.head = seg.tail = 0;
+                }
+                break;
+            }
+            release(seg);
+            segments_.pop_front();
+        }
+    }
+
+    // Copies up to len bytes starting at pos, used to parse headers split across segments
+    size_t copy_to(char* out, size_t len, size_t pos = 0) {
+        size_t copied = 0;
+        for (Segment& seg : segments_) {
+            size_t seg_len = seg.tail - seg.head;
+            if (pos >= seg_len) {
+                pos -= seg_len;
+                continue;
+            }
+            size_t cplen = std::min(len - copied, seg_len - pos);
+            std::memcpy(out + copied, seg.buf + seg.head + pos, cplen);
+            copied += cplen;
+            pos = 0;
+            if (copied == len) {
+                break;
+            }
+        }
+        return copied;
+    }
+
+    // Calls func with the readable bytes of every non-empty segment, e.g. to gather them for one write
+    template<typename Func>
+    void for_each_segment(Func&& func) {
+        for (Segment& seg : segments_) {
+            if (seg.tail != seg.head) {
+                func(std::string_view{seg.buf + seg.head, seg.tail - seg.head});
+            }
+        }
+    }
+
+    void clear() {
+        consume(size_);
+    }
+
+    void reset() {
+        for (Segment& seg : segments_) {
+            deallocate(seg);
+        }
+        segments_.clear();
+        if (spare_) {
+            deallocate(*spare_);
+            spare_.reset();
+        }
+        size_ = 0;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t segment_count() const {
+        return segments_.size();
+    }
+
+private:
+    static size_t free_of(Segment& seg) {
+        return seg.cap - seg.tail;
+    }
+
+    Segment new_segment(size_t least) {
+        if (least <= segment_size_ && spare_) {
+            Segment seg = *spare_;
+            spare_.reset();
+            return seg;
+        }
+        size_t cap = std::max(least, segment_size_);
+        return {AllocTraits::allocate(alloc_, cap), cap};
+    }
+
+    // one regular segment is kept around so a steady stream does not allocate
+    void release(Segment& seg) {
+        if (seg.cap == segment_size_ && !spare_) {
+            spare_ = Segment{seg.buf, seg.cap};
+        } else {
+            deallocate(seg);
+        }
+    }
+
+    void deallocate(Segment& seg) {
+        AllocTraits::deallocate(alloc_, seg.buf, seg.cap);
+    }
+
+    Alloc alloc_;
+    size_t segment_size_;
+    std::deque<Segment> segments_;
+    std::optional<Segment> spare_;
+    size_t size_ = 0;
+};
+
 namespace detail {
 
 using FormatBuffer = StaticBuffer<kFormatBufferSize>;
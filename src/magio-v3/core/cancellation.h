@@ -0,0 +1,69 @@
+#ifndef MAGIO_CORE_CANCELLATION_H_
+#define MAGIO_CORE_CANCELLATION_H_
+
+#include <mutex>
+#include <atomic>
+#include <optional>
+
+#include "magio-v3/core/spin_lock.h"
+#include "magio-v3/core/timer_queue.h"
+
+namespace magio {
+
+class CoroContext;
+
+struct IoContext;
+
+namespace detail {
+
+// Cancellation state of a spawned task, shared with every coroutine it awaits.
+// The task may run in another context than the one cancelling it, e.g. after this_coro::resume_on
+struct CancelState {
+    // Called in the context the task runs in, false if the task has been cancelled
+    bool attach_io(CoroContext* context, IoContext& ioc) {
+        std::lock_guard lk(lock);
+        if (cancelled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        ctx = context;
+        pending_io = &ioc;
+        return true;
+    }
+
+    bool attach_timer(CoroContext* context, const TimerHandle& timer) {
+        std::lock_guard lk(lock);
+        if (cancelled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        ctx = context;
+        pending_timer = timer;
+        return true;
+    }
+
+    // The task has been resumed
+    void detach() {
+        std::lock_guard lk(lock);
+        ctx = nullptr;
+        pending_io = nullptr;
+        pending_timer.reset();
+    }
+
+    std::atomic<bool> cancelled{false};
+    // guards the members below against the thread cancelling the task, set cancelled under it as well
+    SpinLock lock;
+    // the context the io or the timer belong to, only that one may cancel them
+    CoroContext* ctx = nullptr;
+    // the io operation the task is suspended on
+    IoContext* pending_io = nullptr;
+    // the timer the task is sleeping on, cancelling it wakes the task early
+    std::optional<TimerHandle> pending_timer;
+};
+
+// Set while a coroutine is suspending on io, so the io service can attach the operation to its task
+inline thread_local CancelState* SuspendingCancel = nullptr;
+
+}
+
+}
+
+#endif
@@ -0,0 +1,548 @@
+#ifndef MAGIO_CORE_CHANNEL_H_
+#define MAGIO_CORE_CHANNEL_H_
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include "magio-v3/core/spin_lock.h"
+#include "magio-v3/core/coro_context.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+enum class ChannelMode {
+    // any number of coroutines send and receive from any contexts, under a SpinLock
+    Shared,
+    // one coroutine sends and one receives at a time, from any contexts, through a lock-free ring.
+    // Needs a bounded capacity of at least 1, other capacities fall back to Shared
+    Spsc,
+    // every coroutine using the channel runs in the same context, nothing is locked
+    Local,
+};
+
+// Multi-producer multi-consumer queue between coroutines, which may live in different contexts.
+// Bounded channels suspend senders when full, capacity 0 makes every send wait for a receiver.
+// Values left in a closed channel can still be received. ChannelMode picks cheaper paths for
+// channels with a single sender and receiver or used from a single context.
+template<typename T>
+class Channel: Noncopyable {
+    // Lives in the awaiter of the suspended coroutine
+    struct Waiter {
+        CoroContext* ctx = nullptr;
+        std::coroutine_handle<> handle;
+        Waiter* next = nullptr;
+        // set on senders
+        T* value = nullptr;
+        // set on receivers, many is used by receive_many
+        std::optional<T>* slot = nullptr;
+        std::vector<T>* many = nullptr;
+        size_t count = 0;
+        bool ok = false;
+
+        void deliver(T&& val) {
+            if (many) {
+                many->push_back(std::move(val));
+            } else {
+                slot->emplace(std::move(val));
+            }
+            ++count;
+        }
+    };
+
+    struct WaiterQueue {
+        void push(Waiter* waiter) {
+            waiter->next = nullptr;
+            if (tail) {
+                tail->next = waiter;
+            } else {
+                head = waiter;
+            }
+            tail = waiter;
+        }
+
+        Waiter* pop() {
+            Waiter* waiter = head;
+            if (waiter) {
+                head = waiter->next;
+                if (!head) {
+                    tail = nullptr;
+                }
+            }
+            return waiter;
+        }
+
+        Waiter* head = nullptr;
+        Waiter* tail = nullptr;
+    };
+
+    // Takes the lock unless the channel is local
+    class Guard: Noncopyable {
+    public:
+        Guard(Channel& ch)
+            : ch_(ch)
+        {
+            if (ch_.mode_ != ChannelMode::Local) {
+                ch_.lock_.lock();
+            }
+        }
+
+        ~Guard() {
+            if (ch_.mode_ != ChannelMode::Local) {
+                ch_.lock_.unlock();
+            }
+        }
+
+    private:
+        Channel& ch_;
+    };
+
+public:
+    static constexpr size_t kUnbounded = (size_t)-1;
+
+    class SendAwaitable: Noncopyable {
+    public:
+        SendAwaitable(Channel& ch, T&& value)
+            : ch_(ch), value_(std::move(value))
+        { }
+
+        bool await_ready() {
+            if (ch_.mode_ == ChannelMode::Spsc) {
+                return ch_.spsc_send(value_, waiter_.ok);
+            }
+
+            Waiter* woken = nullptr;
+            bool done;
+            {
+                Guard lk(ch_);
+                done = ch_.send_locked(value_, waiter_.ok, woken);
+            }
+            wake(woken);
+            return done;
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h) {
+            waiter_.ctx = LocalContext;
+            waiter_.handle = prev_h;
+            if (ch_.mode_ == ChannelMode::Spsc) {
+                parked_ = true;
+                return ch_.park(ch_.parked_sender_, waiter_, [this] {
+                    return ch_.is_closed() || ch_.size() < ch_.capacity_;
+                });
+            }
+
+            Waiter* woken = nullptr;
+            bool done;
+            {
+                Guard lk(ch_);
+                done = ch_.send_locked(value_, waiter_.ok, woken);
+                if (!done) {
+                    waiter_.value = &value_;
+                    ch_.senders_.push(&waiter_);
+                }
+            }
+            wake(woken);
+            return !done;
+        }
+
+        // false if the channel was closed and the value was not sent
+        bool await_resume() {
+            if (parked_) {
+                // woken by the receiver freeing a slot, which stays free, or by close
+                ch_.spsc_send(value_, waiter_.ok);
+            }
+            return waiter_.ok;
+        }
+
+    private:
+        Channel& ch_;
+        T value_;
+        Waiter waiter_;
+        bool parked_ = false;
+    };
+
+    class ReceiveAwaitable: Noncopyable {
+    public:
+        ReceiveAwaitable(Channel& ch, std::vector<T>* many, size_t max)
+            : ch_(ch), max_(max)
+        {
+            waiter_.slot = &slot_;
+            waiter_.many = many;
+        }
+
+        bool await_ready() {
+            if (ch_.mode_ == ChannelMode::Spsc) {
+                return ch_.spsc_receive(waiter_, max_);
+            }
+
+            Waiter* woken = nullptr;
+            bool done;
+            {
+                Guard lk(ch_);
+                done = ch_.receive_locked(waiter_, max_, woken);
+            }
+            wake(woken);
+            return done;
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h) {
+            waiter_.ctx = LocalContext;
+            waiter_.handle = prev_h;
+            if (ch_.mode_ == ChannelMode::Spsc) {
+                parked_ = true;
+                return ch_.park(ch_.parked_receiver_, waiter_, [this] {
+                    return ch_.size() != 0 || ch_.is_closed();
+                });
+            }
+
+            Waiter* woken = nullptr;
+            bool done;
+            {
+                Guard lk(ch_);
+                done = ch_.receive_locked(waiter_, max_, woken);
+                if (!done) {
+                    ch_.receivers_.push(&waiter_);
+                }
+            }
+            wake(woken);
+            return !done;
+        }
+
+        // nullopt once the channel is closed and drained
+        std::optional<T> await_resume() {
+            resume_spsc();
+            return std::move(slot_);
+        }
+
+    protected:
+        void resume_spsc() {
+            if (parked_) {
+                // woken by the sender after a value was pushed, which stays there, or by close
+                ch_.spsc_receive(waiter_, max_);
+            }
+        }
+
+        Channel& ch_;
+        size_t max_;
+        std::optional<T> slot_;
+        Waiter waiter_;
+        bool parked_ = false;
+    };
+
+    class ReceiveManyAwaitable: public ReceiveAwaitable {
+    public:
+        using ReceiveAwaitable::ReceiveAwaitable;
+
+        // the number of values appended, 0 once the channel is closed and drained
+        size_t await_resume() {
+            this->resume_spsc();
+            return this->waiter_.count;
+        }
+    };
+
+    explicit Channel(size_t capacity = kUnbounded, ChannelMode mode = ChannelMode::Shared)
+        : mode_(mode)
+        , capacity_(capacity)
+    {
+        if (mode_ == ChannelMode::Spsc) {
+            if (capacity_ == 0 || capacity_ == kUnbounded) {
+                mode_ = ChannelMode::Shared;
+            } else {
+                slots_ = std::make_unique<std::optional<T>[]>(capacity_);
+            }
+        }
+    }
+
+    [[nodiscard]]
+    SendAwaitable send(T value) {
+        return {*this, std::move(value)};
+    }
+
+    [[nodiscard]]
+    ReceiveAwaitable receive() {
+        return {*this, nullptr, 1};
+    }
+
+    // Appends at least one and at most max values to out, suspends only when the channel is empty
+    [[nodiscard]]
+    ReceiveManyAwaitable receive_many(std::vector<T>& out, size_t max) {
+        return {*this, &out, std::max<size_t>(max, 1)};
+    }
+
+    // Never suspends, value is left untouched on failure
+    bool try_send(T&& value) {
+        bool ok = false;
+        if (mode_ == ChannelMode::Spsc) {
+            spsc_send(value, ok);
+            return ok;
+        }
+
+        Waiter* woken = nullptr;
+        {
+            Guard lk(*this);
+            send_locked(value, ok, woken);
+        }
+        wake(woken);
+        return ok;
+    }
+
+    std::optional<T> try_receive() {
+        std::optional<T> slot;
+        Waiter waiter;
+        waiter.slot = &slot;
+        if (mode_ == ChannelMode::Spsc) {
+            spsc_pop(waiter, 1);
+            return slot;
+        }
+
+        Waiter* woken = nullptr;
+        {
+            Guard lk(*this);
+            receive_locked(waiter, 1, woken);
+        }
+        wake(woken);
+        return slot;
+    }
+
+    // Wakes all waiting coroutines, further sends fail
+    void close() {
+        if (mode_ == ChannelMode::Spsc) {
+            closed_.store(true, std::memory_order_seq_cst);
+            unpark(parked_sender_, [] { return true; });
+            unpark(parked_receiver_, [] { return true; });
+            return;
+        }
+
+        Waiter* woken = nullptr;
+        {
+            Guard lk(*this);
+            closed_.store(true, std::memory_order_relaxed);
+            while (Waiter* waiter = senders_.pop()) {
+                waiter->ok = false;
+                waiter->next = woken;
+                woken = waiter;
+            }
+            while (Waiter* waiter = receivers_.pop()) {
+                waiter->next = woken;
+                woken = waiter;
+            }
+        }
+        wake(woken);
+    }
+
+    bool is_closed() {
+        if (mode_ == ChannelMode::Spsc) {
+            return closed_.load(std::memory_order_seq_cst);
+        }
+        Guard lk(*this);
+        return closed_.load(std::memory_order_relaxed);
+    }
+
+    size_t size() {
+        if (mode_ == ChannelMode::Spsc) {
+            return send_pos_.load(std::memory_order_seq_cst) - recv_pos_.load(std::memory_order_seq_cst);
+        }
+        Guard lk(*this);
+        return size_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    ChannelMode mode() const {
+        return mode_;
+    }
+
+private:
+    // Returns false if the sender has to wait, woken collects the receiver to resume
+    bool send_locked(T& value, bool& ok, Waiter*& woken) {
+        if (closed_.load(std::memory_order_relaxed)) {
+            ok = false;
+            return true;
+        }
+
+        if (Waiter* receiver = receivers_.pop()) {
+            receiver->deliver(std::move(value));
+            receiver->ok = true;
+            receiver->next = woken;
+            woken = receiver;
+        } else if (size_ < capacity_) {
+            push(std::move(value));
+        } else {
+            return false;
+        }
+
+        ok = true;
+        return true;
+    }
+
+    // Returns false if the receiver has to wait, woken collects the senders to resume
+    bool receive_locked(Waiter& receiver, size_t max, Waiter*& woken) {
+        while (receiver.count < max) {
+            if (size_ != 0) {
+                receiver.deliver(pop());
+                // a slot is free now
+                if (Waiter* sender = senders_.pop()) {
+                    push(std::move(*sender->value));
+                    sender->ok = true;
+                    sender->next = woken;
+                    woken = sender;
+                }
+            } else if (Waiter* sender = senders_.pop()) {
+                receiver.deliver(std::move(*sender->value));
+                sender->ok = true;
+                sender->next = woken;
+                woken = sender;
+            } else {
+                break;
+            }
+        }
+
+        receiver.ok = receiver.count != 0;
+        return receiver.ok || closed_.load(std::memory_order_relaxed);
+    }
+
+    // Spsc: called by the sending coroutine, returns false if it has to wait
+    bool spsc_send(T& value, bool& ok) {
+        ok = false;
+        if (closed_.load(std::memory_order_seq_cst)) {
+            return true;
+        }
+
+        size_t tail = send_pos_.load(std::memory_order_relaxed);
+        if (tail - recv_pos_.load(std::memory_order_seq_cst) == capacity_) {
+            return false;
+        }
+        slots_[tail % capacity_].emplace(std::move(value));
+        send_pos_.store(tail + 1, std::memory_order_seq_cst);
+        unpark(parked_receiver_, [this] {
+            return size() != 0;
+        });
+        ok = true;
+        return true;
+    }
+
+    // Spsc: called by the receiving coroutine, returns false if it has to wait
+    bool spsc_receive(Waiter& receiver, size_t max) {
+        if (spsc_pop(receiver, max)) {
+            return true;
+        }
+        if (!closed_.load(std::memory_order_seq_cst)) {
+            return false;
+        }
+        // values sent right before close
+        spsc_pop(receiver, max);
+        return true;
+    }
+
+    bool spsc_pop(Waiter& receiver, size_t max) {
+        size_t head = recv_pos_.load(std::memory_order_relaxed);
+        size_t tail = send_pos_.load(std::memory_order_seq_cst);
+        if (head == tail) {
+            return false;
+        }
+
+        for (; head != tail && receiver.count < max; ++head) {
+            auto& slot = slots_[head % capacity_];
+            receiver.deliver(std::move(*slot));
+            slot.reset();
+        }
+        recv_pos_.store(head, std::memory_order_seq_cst);
+        unpark(parked_sender_, [this] {
+            return size() < capacity_;
+        });
+        return true;
+    }
+
+    // Spsc: publishes the waiter, then checks ready again. Either that check or the other side,
+    // which updates the ring before looking for a waiter, sees the update, all being seq_cst
+    template<typename Ready>
+    static bool park(std::atomic<Waiter*>& parked, Waiter& waiter, Ready&& ready) {
+        waiter.next = nullptr;
+        parked.store(&waiter, std::memory_order_seq_cst);
+        if (!ready()) {
+            return true;
+        }
+        // if the other side took the waiter meanwhile, it is queued to resume
+        return parked.exchange(nullptr, std::memory_order_acq_rel) != &waiter;
+    }
+
+    // Wakes the waiter of the other side if ready holds. A waiter taken out of parked does not
+    // touch the ring, so ready only changes by the caller or by close
+    template<typename Ready>
+    void unpark(std::atomic<Waiter*>& parked, Ready&& ready) {
+        while (parked.load(std::memory_order_seq_cst)) {
+            Waiter* waiter = parked.exchange(nullptr, std::memory_order_acq_rel);
+            if (!waiter) {
+                return;
+            }
+            if (ready() || closed_.load(std::memory_order_seq_cst)) {
+                wake(waiter);
+                return;
+            }
+            // the waiter parked again after the update this call is for, put it back.
+            // close may have found no waiter meanwhile, then look again
+            parked.store(waiter, std::memory_order_seq_cst);
+            if (!closed_.load(std::memory_order_seq_cst)) {
+                return;
+            }
+        }
+    }
+
+    static void wake(Waiter* waiter) {
+        while (waiter) {
+            // the waiter may be gone as soon as it is queued
+            Waiter* next = waiter->next;
+            waiter->ctx->queue_in_context(waiter->handle);
+            waiter = next;
+        }
+    }
+
+    void push(T&& value) {
+        if (size_ == ring_.size()) {
+            std::vector<std::optional<T>> ring(std::min(capacity_, std::max<size_t>(16, ring_.size() * 2)));
+            for (size_t i = 0; i < size_; ++i) {
+                ring[i] = std::move(ring_[(head_ + i) % ring_.size()]);
+            }
+            ring_.swap(ring);
+            head_ = 0;
+        }
+
+        ring_[(head_ + size_) % ring_.size()].emplace(std::move(value));
+        ++size_;
+    }
+
+    T pop() {
+        T value = std::move(*ring_[head_]);
+        ring_[head_].reset();
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+        return value;
+    }
+
+    ChannelMode mode_;
+    SpinLock lock_;
+    size_t capacity_;
+    std::atomic<bool> closed_{false};
+    std::vector<std::optional<T>> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    WaiterQueue senders_;
+    WaiterQueue receivers_;
+
+    // the lock-free ring of Spsc channels, positions only grow
+    std::unique_ptr<std::optional<T>[]> slots_;
+    alignas(64) std::atomic<size_t> recv_pos_{0};
+    alignas(64) std::atomic<size_t> send_pos_{0};
+    std::atomic<Waiter*> parked_sender_{nullptr};
+    std::atomic<Waiter*> parked_receiver_{nullptr};
+};
+#endif
+
+}
+
+#endif
@@ -1,12 +1,19 @@
 #ifndef MAGIO_CORE_CORO_H_
 #define MAGIO_CORE_CORO_H_
 
+#include <vector>
+#include <utility>
 #include <optional>
 #include <exception>
 
+#include "magio-v3/core/trace.h"
 #include "magio-v3/core/utils.h"
+#include "magio-v3/core/traits.h"
+#include "magio-v3/core/allocator.h"
+#include "magio-v3/core/logger.h"
 #include "magio-v3/core/this_context.h"
 #include "magio-v3/core/noncopyable.h"
+#include "magio-v3/core/cancellation.h"
 
 namespace magio {
 
@@ -14,6 +21,9 @@ namespace detail {
 
 inline thread_local size_t CoroId = 0;
 
+// ctx.execute(task), for the parts of a coroutine that run before CoroContext is complete
+void execute_in(CoroContext& ctx, Task&& task);
+
 }
 
 #ifdef MAGIO_USE_CORO
@@ -35,6 +45,14 @@ public:
     template<typename PT>
     void await_suspend(std::coroutine_handle<PT> prev_h) {
         handle_.promise().prev_handle = prev_h;
+        if constexpr (requires { prev_h.promise().cancel_state; }) {
+            handle_.promise().cancel_state = prev_h.promise().cancel_state;
+        }
+#ifdef MAGIO_TRACE
+        if constexpr (requires { prev_h.promise().trace; }) {
+            detail::await_trace(prev_h.promise().trace, handle_.promise().trace);
+        }
+#endif
         this_context::queue_in_context(handle_); // wake main then prev
     }
 
@@ -63,14 +81,35 @@ public:
         return false; 
     }
 
-    void await_suspend(std::coroutine_handle<> prev_h) {
+    template<typename PT>
+    void await_suspend(std::coroutine_handle<PT> prev_h) {
+        if constexpr (requires { prev_h.promise().cancel_state; }) {
+            cancel_state_ = prev_h.promise().cancel_state;
+        }
+        auto prev = std::exchange(detail::SuspendingCancel, cancel_state_);
+#ifdef MAGIO_TRACE
+        detail::CoroTrace* trace = nullptr;
+        if constexpr (requires { prev_h.promise().trace; }) {
+            trace = &prev_h.promise().trace;
+        }
+        auto prev_trace = std::exchange(detail::SuspendingTrace, trace);
+#endif
         func_(prev_h);
+        detail::SuspendingCancel = prev;
+#ifdef MAGIO_TRACE
+        detail::SuspendingTrace = prev_trace;
+#endif
     }
 
-    void await_resume() { }
+    void await_resume() {
+        if (cancel_state_) {
+            cancel_state_->detach();
+        }
+    }
 
 private:
     Func func_;
+    detail::CancelState* cancel_state_ = nullptr;
 };
 
 template<typename Func>
@@ -86,18 +125,22 @@ public:
     }
 
     void await_suspend(CoroutineHandle self_h) noexcept {
+#ifdef MAGIO_TRACE
+        detail::end_trace(self_h.promise().trace);
+#endif
         if (self_h.promise().prev_handle) {
             self_h.promise().prev_handle.resume();
         } else if (self_h.promise().callback) {
-            if constexpr (std::is_void_v<T>) {
-                self_h.promise().callback(self_h.promise().eptr, Unit{});
-            } else {
-                if (self_h.promise().eptr) {
-                    self_h.promise().callback(self_h.promise().eptr, {});
-                } else {
-                    self_h.promise().callback(self_h.promise().eptr, std::move(self_h.promise().value.value()));
-                }
+            CoroContext* ctx = self_h.promise().spawn_ctx;
+            if (ctx && ctx != LocalContext) {
+                // moved away by resume_on, the callback shares state with the spawner so it runs where that lives
+                detail::execute_in(*ctx, [self_h] {
+                    complete(self_h);
+                });
+                return;
             }
+            complete(self_h);
+            return;
         }
 
         self_h.destroy();
@@ -108,12 +151,26 @@ public:
     }
 
 private:
+    static void complete(CoroutineHandle self_h) noexcept {
+        if constexpr (std::is_void_v<T>) {
+            self_h.promise().callback(self_h.promise().eptr, Unit{});
+        } else {
+            if (self_h.promise().eptr) {
+                self_h.promise().callback(self_h.promise().eptr, {});
+            } else {
+                self_h.promise().callback(self_h.promise().eptr, std::move(self_h.promise().value.value()));
+            }
+        }
+
+        self_h.destroy();
+    }
 };
 
 template<typename Return>
 class Coro {
     friend class CoroContext;
-    friend void this_context::spawn(Coro<Return> coro, CoroCompletionHandler<Return> &&handler);
+    template<typename T>
+    friend void this_context::spawn(Coro<T> coro, CoroCompletionHandler<T> &&handler, std::source_location loc);
 
 public:
     struct promise_type;
@@ -128,12 +185,27 @@ public:
     struct promise_type {
         Coro get_return_object() {
             id = ++detail::CoroId;
+#ifdef MAGIO_TRACE
+            detail::init_trace(trace, id);
+#endif
             return {CoroutineHandle::from_promise(*this)};
         }
 
+#ifdef MAGIO_TRACE
+        detail::TracedInitialSuspend initial_suspend() { 
+            return {trace};
+        }
+
+        // site is where the co_await is
+        template<typename A>
+        auto await_transform(A&& a, std::source_location site = std::source_location::current()) {
+            return detail::traced(std::forward<A>(a), trace, site);
+        }
+#else
         std::suspend_always initial_suspend() { 
             return {};
         };
+#endif
 
         FinalSuspend<Return> final_suspend() noexcept {
             return {};
@@ -147,11 +219,26 @@ public:
             eptr = std::current_exception();
         }
 
+        // frames go through the allocator of the context
+        static void* operator new(size_t size) {
+            return detail::allocate(size, AllocCategory::Frame);
+        }
+
+        static void operator delete(void* p, size_t size) {
+            detail::deallocate(p, size, AllocCategory::Frame);
+        }
+
         size_t id;
         std::coroutine_handle<> prev_handle;
         std::exception_ptr eptr;
         std::optional<Return> value;
         CoroCompletionHandler<Return> callback;
+        // where callback runs
+        CoroContext* spawn_ctx = nullptr;
+        detail::CancelState* cancel_state = nullptr;
+#ifdef MAGIO_TRACE
+        detail::CoroTrace trace;
+#endif
     };
 
     CoroutineHandle handle() const {
@@ -163,8 +250,9 @@ public:
     }
 
 private:
-    void set_callback(CoroCompletionHandler<Return>&& handler) const {
+    void set_callback(CoroCompletionHandler<Return>&& handler, CoroContext* ctx) const {
         handle_.promise().callback = std::move(handler);
+        handle_.promise().spawn_ctx = ctx;
     }
 
     CoroutineHandle handle_;
@@ -173,7 +261,7 @@ private:
 template<>
 class Coro<void> {
     friend class CoroContext;
-    friend void this_context::spawn(Coro<> coro, CoroCompletionHandler<void> &&handler);
+    friend void this_context::spawn(Coro<> coro, CoroCompletionHandler<void> &&handler, std::source_location loc);
 
 public:
     struct promise_type;
@@ -188,12 +276,27 @@ public:
     struct promise_type {
         Coro get_return_object() {
             id = ++detail::CoroId;
+#ifdef MAGIO_TRACE
+            detail::init_trace(trace, id);
+#endif
             return {CoroutineHandle::from_promise(*this)};
         }
 
+#ifdef MAGIO_TRACE
+        detail::TracedInitialSuspend initial_suspend() { 
+            return {trace};
+        }
+
+        // site is where the co_await is
+        template<typename A>
+        auto await_transform(A&& a, std::source_location site = std::source_location::current()) {
+            return detail::traced(std::forward<A>(a), trace, site);
+        }
+#else
         std::suspend_always initial_suspend() { 
             return {};
         };
+#endif
 
         FinalSuspend<> final_suspend() noexcept {
             return {};
@@ -204,11 +307,26 @@ public:
         void unhandled_exception() {
             eptr = std::current_exception();
         }
+
+        // frames go through the allocator of the context
+        static void* operator new(size_t size) {
+            return detail::allocate(size, AllocCategory::Frame);
+        }
+
+        static void operator delete(void* p, size_t size) {
+            detail::deallocate(p, size, AllocCategory::Frame);
+        }
         
         size_t id;
         std::coroutine_handle<> prev_handle;
         std::exception_ptr eptr;
         CoroCompletionHandler<void> callback;
+        // where callback runs
+        CoroContext* spawn_ctx = nullptr;
+        detail::CancelState* cancel_state = nullptr;
+#ifdef MAGIO_TRACE
+        detail::CoroTrace trace;
+#endif
     };
 
     CoroutineHandle handle() const {
@@ -220,13 +338,26 @@ public:
     }
 
 private:
-    void set_callback(CoroCompletionHandler<void>&& handler) const {
+    void set_callback(CoroCompletionHandler<void>&& handler, CoroContext* ctx) const {
         handle_.promise().callback = std::move(handler);
+        handle_.promise().spawn_ctx = ctx;
     }
 
     CoroutineHandle handle_;
 };
 
+namespace detail {
+
+// Makes the coroutine the start of a task spawned at loc, for magio::trace
+template<typename T>
+inline void mark_spawned(const Coro<T>& coro, const std::source_location& loc) {
+#ifdef MAGIO_TRACE
+    set_spawn_site(coro.handle().promise().trace, loc);
+#endif
+}
+
+}
+
 template<typename...Ts>
 inline Coro<RemoveVoidTuple<Ts...>> join(Coro<Ts>...coros);
 
@@ -236,6 +367,25 @@ inline Coro<> select(Coro<Ts>...coros);
 template<typename...Ts>
 inline Coro<RemoveVoidTuple<Ts...>> series(Coro<Ts>...coros);
 
+template<typename T>
+using WhenAnyResult = std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, VoidToUnit<T>>>;
+
+// Runs all coros concurrently and waits for every one of them, then rethrows the first exception if any
+template<typename T>
+requires (!std::is_void_v<T>)
+inline Coro<std::vector<T>> when_all(std::vector<Coro<T>> coros);
+
+inline Coro<> when_all(std::vector<Coro<>> coros);
+
+// Returns the index (and the value) of the first completed coro, the others are cancelled
+template<typename T>
+inline Coro<WhenAnyResult<T>> when_any(std::vector<Coro<T>> coros);
+
+// Calls func on every element and awaits the returned coros, with at most limit of them running at once.
+// Once func or a coro throws, no more are started, the running ones are awaited and the exception is rethrown
+template<typename Range, typename Func>
+inline Coro<> for_each_concurrent(Range&& range, size_t limit, Func func);
+
 namespace this_coro {
 
 class Yield {
@@ -258,8 +408,9 @@ public:
     }
 
     template<typename PH>
-    void await_suspend(std::coroutine_handle<PH> prev_h) {
+    bool await_suspend(std::coroutine_handle<PH> prev_h) {
         id_ = prev_h.promise().id;
+        return false;
     }
 
     size_t await_resume() { 
@@ -270,10 +421,88 @@ private:
     size_t id_ = 0;
 };
 
+class IsCancelled {
+public:
+    bool await_ready() { 
+        return false; 
+    }
+
+    template<typename PH>
+    bool await_suspend(std::coroutine_handle<PH> prev_h) {
+        auto state = prev_h.promise().cancel_state;
+        cancelled_ = state && state->cancelled;
+        return false;
+    }
+
+    bool await_resume() { 
+        return cancelled_;
+    }
+
+private:
+    bool cancelled_ = false;
+};
+
+class ResumeOnContext {
+public:
+    ResumeOnContext(CoroContext& ctx)
+        : ctx_(ctx) { }
+
+    bool await_ready() {
+        return LocalContext == &ctx_;
+    }
+
+    void await_suspend(std::coroutine_handle<> prev_h);
+
+    void await_resume() { }
+
+private:
+    CoroContext& ctx_;
+};
+
+class ResumeOnExecutor {
+public:
+    ResumeOnExecutor(Executor& executor)
+        : executor_(executor) { }
+
+    bool await_ready() {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> prev_h) {
+        // a handle fits in the small buffer of Task
+        executor_.execute([prev_h] {
+            prev_h.resume();
+        });
+    }
+
+    void await_resume() { }
+
+private:
+    Executor& executor_;
+};
+
 inline Yield yield;
 
 inline GetId get_id;
 
+// co_await this_coro::resume_on(ctx) goes on running the coroutine in ctx, so does whoever awaits it
+// once it returns. Nothing happens if it already runs there
+inline ResumeOnContext resume_on(CoroContext& ctx) {
+    return {ctx};
+}
+
+// co_await this_coro::resume_on(pool) goes on running the coroutine on a thread of an executor
+// such as ThreadPool, which has no context, so it can only compute until it resumes on a context again.
+// A spawned coroutine finishing there still has its completion handler run in the context it was spawned in
+inline ResumeOnExecutor resume_on(Executor& executor) {
+    return {executor};
+}
+
+// co_await this_coro::is_cancelled() tells whether the task running this coroutine has been cancelled
+inline IsCancelled is_cancelled() {
+    return {};
+}
+
 template<typename Rep, typename Per>
 inline Coro<> sleep_for(const std::chrono::duration<Rep, Per>& dur);
 
@@ -13,6 +13,7 @@ namespace magio {
 
 CoroContext::CoroContext(size_t entries)
     : thread_id_(CurrentThread::get_id()) 
+    , pending_handles_(decltype(pending_handles_)::allocator_type(&alloc_state_))
 {
     if (LocalContext != nullptr) {
         M_FATAL("{}", "This thread already has a context");
@@ -23,9 +24,26 @@ CoroContext::CoroContext(size_t entries)
     }
 
     p_io_service_ = IOSERVICE(entries);
+    p_io_service_->set_metrics(&metrics_);
+    metrics::Registry::global().add_context(&metrics_);
+    alloc_state_.metrics = &metrics_;
+    detail::LocalAllocState = &alloc_state_;
+#ifdef MAGIO_TRACE
+    detail::add_context(this);
+#endif
     LocalContext = this;
 }
 
+CoroContext::~CoroContext() {
+#ifdef MAGIO_TRACE
+    detail::remove_context(this);
+#endif
+    metrics::Registry::global().remove_context(&metrics_);
+    if (detail::LocalAllocState == &alloc_state_) {
+        detail::LocalAllocState = nullptr;
+    }
+}
+
 void CoroContext::start() {
     if (!assert_in_context_thread()) {
         M_FATAL("{}", "You can't start the context on another thread");
@@ -36,14 +54,20 @@ void CoroContext::start() {
     }
 
     state_ = Running;
-    decltype(pending_handles_) handles;
-    std::vector<TimerTask> timer_tasks;
+    decltype(pending_handles_) handles(pending_handles_.get_allocator());
+    std::vector<TimerTask, detail::CategoryAllocator<TimerTask, AllocCategory::Timer>> timer_tasks;
 
+    auto now = [] {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(TimerClock::now().time_since_epoch()).count();
+    };
+    auto begin = now();
     for (; state_ != Stopping;) {
         {
             std::lock_guard lk(mutex_);
             handles.swap(pending_handles_);
         }
+        metrics_.loop_iterations.add();
+        metrics_.run_queue.set((int64_t)handles.size());
 
         for (auto& h : handles) {
 #ifdef MAGIO_USE_CORO
@@ -52,17 +76,36 @@ void CoroContext::start() {
             h();
 #endif
         }
+        metrics_.resumed.add(handles.size());
+        metrics_.resumed_per_iteration.record(handles.size());
         // TODO shrink
         handles.clear();
+        auto resumed = now();
+        metrics_.resume_ns.add(resumed - begin);
 
         timer_queue_.get_expired(timer_tasks);
         for (auto& task : timer_tasks) {
             task(true);
         }
+        metrics_.timers_fired.add(timer_tasks.size());
+        metrics_.timers_pending.set((int64_t)timer_queue_.size());
         // TODO shrink
         timer_tasks.clear();
+        auto timed = now();
+        metrics_.timer_ns.add(timed - resumed);
 
         handle_io_poller();
+        begin = now();
+        metrics_.poll_ns.add(begin - timed);
+
+        if (state_ == Draining && drained()) {
+            state_ = Stopping;
+        }
+    }
+
+    if (drain_timer_) {
+        drain_timer_->cancel();
+        drain_timer_.reset();
     }
 }
 
@@ -74,6 +117,34 @@ void CoroContext::stop() {
     state_ = Stopping;
 }
 
+void CoroContext::shutdown(const TimerClock::time_point& deadline) {
+    if (!assert_in_context_thread()) {
+        M_FATAL("{}", "You can't shut the context down on another thread");
+    }
+
+    if (state_ != Running) {
+        return;
+    }
+
+    state_ = Draining;
+    cancelled_all_ = false;
+    p_io_service_->stop_accepting();
+    // shutting down right away cancels without a word
+    bool warn = deadline > TimerClock::now();
+    drain_timer_ = expires_until(deadline, [this, warn](bool expired) {
+        if (!expired || state_ != Draining) {
+            return;
+        }
+        // sleeping coroutines are given up on from now on
+        drain_timer_.reset();
+        if (size_t n = p_io_service_->in_flight(); n && warn) {
+            M_WARN("{} io operations are still in flight at the deadline, cancelling them", n);
+        }
+        p_io_service_->cancel_all();
+        cancelled_all_ = true;
+    });
+}
+
 void CoroContext::execute(Task &&task) {
 #ifdef MAGIO_USE_CORO
     auto coro = [](Task task) mutable -> Coro<> {
@@ -86,6 +157,7 @@ void CoroContext::execute(Task &&task) {
         pending_handles_.push_back(std::move(task));
     }
     if (!assert_in_context_thread()) {
+        metrics_.remote_wakeups.add();
         wake_up();
     }
 #endif
@@ -118,6 +190,22 @@ void CoroContext::handle_io_poller() {
     }
 }
 
+bool CoroContext::drained() {
+    if (cancelled_all_) {
+        // refused operations complete at once, a coroutine retrying them would never let the run queue empty
+        return p_io_service_->in_kernel() == 0;
+    }
+    if (p_io_service_->in_flight() != 0) {
+        return false;
+    }
+    // until the deadline, timers other than drain_timer_ are work as well, e.g. a sleeping coroutine
+    if (drain_timer_ && timer_queue_.live() > 1) {
+        return false;
+    }
+    std::lock_guard lk(mutex_);
+    return pending_handles_.empty();
+}
+
 #ifdef MAGIO_USE_CORO
 void CoroContext::wake_in_context(std::coroutine_handle<> h) {
     if (assert_in_context_thread()) {
@@ -133,11 +221,16 @@ void CoroContext::queue_in_context(std::coroutine_handle<> h) {
         pending_handles_.push_back(h);
     }
     if (!assert_in_context_thread()) {
+        metrics_.remote_wakeups.add();
         wake_up();
     }
 }
 #endif
 
+void CoroContext::set_allocator(Allocator* allocator) {
+    alloc_state_.allocator = allocator;
+}
+
 void CoroContext::wake_up() {
     p_io_service_->wake_up();
 }
@@ -2,8 +2,10 @@
 #define MAGIO_CORE_CO_CONTEXT_H_
 
 #include <mutex>
+#include <optional>
 
 #include "magio-v3/core/coro.h"
+#include "magio-v3/core/metrics.h"
 #include "magio-v3/core/timer_queue.h"
 
 namespace magio {
@@ -11,28 +13,39 @@ namespace magio {
 class CoroContext: Noncopyable, public Executor {
 public:
     enum State {
-        Running, Stopping, 
+        Running, Draining, Stopping, 
     };
 
     CoroContext(size_t entries);
 
+    ~CoroContext();
+
     void start();
 
     void stop();
 
+    // Stops once the io in flight, the pending coroutines and the timers have run out. Accepts fail with
+    // operation_canceled from now on, the rest still runs, so does what it starts meanwhile.
+    // What is left at deadline is cancelled, the context never stops under an operation of the kernel.
+    // Once the cancelled operations have completed the context stops, timers pending and coroutines
+    // that keep retrying a refused operation are abandoned
+    void shutdown(const TimerClock::time_point& deadline);
+
     void execute(Task&& task) override;
 
     void dispatch(Task&& task);
 
 #ifdef MAGIO_USE_CORO
     template<typename T>
-    void spawn(Coro<T> coro) {
+    void spawn(Coro<T> coro, std::source_location loc = std::source_location::current()) {
+        detail::mark_spawned(coro, loc);
         queue_in_context(coro.handle());
     }
 
     template<typename T>
-    void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler) {
-        coro.set_callback(std::move(handler));
+    void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler, std::source_location loc = std::source_location::current()) {
+        detail::mark_spawned(coro, loc);
+        coro.set_callback(std::move(handler), this);
         queue_in_context(coro.handle());
     }
 
@@ -54,21 +67,38 @@ public:
 
     IoService& get_service() const;
 
+    // Readable from any thread, also exported through metrics::Registry::global()
+    const metrics::ContextMetrics& metrics() const {
+        return metrics_;
+    }
+
+    // Library allocations made on the thread of this context go through allocator from now on and
+    // are counted in metrics(), nullptr goes back to the heap. Set it before the context runs
+    void set_allocator(Allocator* allocator);
+
 private:
     void wake_up();
 
     void handle_io_poller();
 
+    bool drained();
+
     std::mutex mutex_;
 
     State state_ = Stopping;
     size_t thread_id_;
+    // before everything allocating through them
+    metrics::ContextMetrics metrics_;
+    detail::AllocState alloc_state_;
 #ifdef MAGIO_USE_CORO
-    std::vector<std::coroutine_handle<>> pending_handles_;
+    std::vector<std::coroutine_handle<>, detail::CategoryAllocator<std::coroutine_handle<>, AllocCategory::Queue>> pending_handles_;
 #else
-    std::vector<Task> pending_handles_;
+    std::vector<Task, detail::CategoryAllocator<Task, AllocCategory::Queue>> pending_handles_;
 #endif
     TimerQueue timer_queue_;
+    std::optional<TimerHandle> drain_timer_;
+    // the deadline of shutdown has passed and cancel_all was called
+    bool cancelled_all_ = false;
     std::unique_ptr<IoService> p_io_service_;
 };
 
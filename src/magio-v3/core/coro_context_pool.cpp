@@ -26,11 +26,8 @@ CoroContextPool::CoroContextPool(size_t num, size_t every)
 
 CoroContextPool::~CoroContextPool() {
     state_ = PendingDestroy;
-    for (size_t i = 0; i < contexts_.size(); ++i) {
-        contexts_[i]->execute([this, i] {
-            contexts_[i]->stop();
-        });
-    }
+    // the io still in flight is cancelled and waited for, unless shutdown came first
+    shutdown(TimerClock::now());
 
     for (size_t i = 0; i < threads_.size(); ++i) {
         if (threads_[i].joinable()) {
@@ -53,6 +50,14 @@ void CoroContextPool::start_all() {
     contexts_[0]->start();
 }
 
+void CoroContextPool::shutdown(const TimerClock::time_point& deadline) {
+    for (size_t i = 0; i < contexts_.size(); ++i) {
+        contexts_[i]->execute([this, i, deadline] {
+            contexts_[i]->shutdown(deadline);
+        });
+    }
+}
+
 CoroContext& CoroContextPool::next_context() {
     size_t old = next_idx_;
     next_idx_ = (next_idx_ + 1) % contexts_.size();
@@ -19,10 +19,18 @@ public:
 
     void start_all();
 
+    // Shuts every context down as CoroContext::shutdown does, from any thread. start_all returns
+    // once the first context stopped, the destructor waits for the others
+    void shutdown(const TimerClock::time_point& deadline);
+
     CoroContext& next_context();
 
     CoroContext& get(size_t i);
 
+    size_t size() const {
+        return contexts_.size();
+    }
+
 private:
     void run_in_background(size_t id);
 
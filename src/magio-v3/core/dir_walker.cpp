@@ -0,0 +1,102 @@
+#include "magio-v3/core/dir_walker.h"
+
+#include "magio-v3/core/thread_pool.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+namespace {
+
+std::vector<DirEntry> list_dir(const std::string& dir, std::error_code& ec) {
+    std::vector<DirEntry> entries;
+    std::filesystem::directory_iterator it(dir, std::filesystem::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        // the type comes from the listing itself where the filesystem reports it, so this rarely stats
+        std::error_code type_ec;
+        auto type = it->symlink_status(type_ec).type();
+        entries.push_back({it->path().string(), type_ec ? std::filesystem::file_type::unknown : type});
+    }
+    return entries;
+}
+
+}
+
+DirWalker::DirWalker(std::string root, ThreadPool* pool)
+    : pool_(pool)
+{
+    dirs_.push_back(std::move(root));
+}
+
+Coro<std::optional<DirEntry>> DirWalker::next(std::error_code& ec) {
+    while (pos_ == entries_.size()) {
+        if (dirs_.empty()) {
+            co_return std::nullopt;
+        }
+        co_await list_next(ec);
+        if (ec) {
+            co_return std::nullopt;
+        }
+    }
+
+    DirEntry& entry = entries_[pos_++];
+    if (entry.type == std::filesystem::file_type::directory) {
+        dirs_.push_back(entry.path);
+    }
+    co_return std::move(entry);
+}
+
+Coro<> DirWalker::list_next(std::error_code& ec) {
+    std::string dir = std::move(dirs_.back());
+    dirs_.pop_back();
+    entries_.clear();
+    pos_ = 0;
+
+    if (pool_) {
+        auto [entries, list_ec] = co_await pool_->spawn_blocking([&dir] {
+            std::error_code ec;
+            auto entries = list_dir(dir, ec);
+            return std::make_pair(std::move(entries), ec);
+        });
+        entries_ = std::move(entries);
+        ec = list_ec;
+    } else {
+        // give other coroutines of the context a turn between listings
+        co_await this_coro::yield;
+        entries_ = list_dir(dir, ec);
+    }
+}
+
+namespace detail {
+
+Coro<> walk_files(std::string root, Channel<std::string>& paths, size_t& count, std::error_code& ec, ThreadPool* pool) {
+    DirWalker walker(std::move(root), pool);
+    for (; ;) {
+        std::error_code list_ec;
+        auto entry = co_await walker.next(list_ec);
+        if (list_ec) {
+            if (!ec) {
+                ec = list_ec;
+            }
+            continue;
+        }
+        if (!entry) {
+            break;
+        }
+        if (entry->type != std::filesystem::file_type::regular) {
+            continue;
+        }
+
+        ++count;
+        bool sent = co_await paths.send(std::move(entry->path));
+        if (!sent) {
+            // a worker failed and closed the channel
+            break;
+        }
+    }
+    paths.close();
+}
+
+}
+#endif
+
+}
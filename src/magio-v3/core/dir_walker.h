@@ -0,0 +1,85 @@
+#ifndef MAGIO_CORE_DIR_WALKER_H_
+#define MAGIO_CORE_DIR_WALKER_H_
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <filesystem>
+
+#include "magio-v3/core/coro.h"
+#include "magio-v3/core/channel.h"
+
+namespace magio {
+
+class ThreadPool;
+
+#ifdef MAGIO_USE_CORO
+struct DirEntry {
+    std::string path;
+    // from the directory listing, symlinks are reported but not followed
+    std::filesystem::file_type type;
+};
+
+// Walks a directory tree depth first, listing one directory at a time,
+// so memory is bounded by the directories still to visit rather than by the number of files.
+// Listings block, they run on pool when one is given, otherwise in the context between yields.
+class DirWalker: Noncopyable {
+public:
+    explicit DirWalker(std::string root, ThreadPool* pool = nullptr);
+
+    // nullopt once the tree is exhausted.
+    // A directory that cannot be listed sets ec, the walk goes on with the next call
+    [[nodiscard]]
+    Coro<std::optional<DirEntry>> next(std::error_code& ec);
+
+private:
+    Coro<> list_next(std::error_code& ec);
+
+    ThreadPool* pool_;
+    std::vector<std::string> dirs_;
+    std::vector<DirEntry> entries_;
+    size_t pos_ = 0;
+};
+
+namespace detail {
+
+Coro<> walk_files(std::string root, Channel<std::string>& paths, size_t& count, std::error_code& ec, ThreadPool* pool);
+
+template<typename Func>
+inline Coro<> consume_files(Channel<std::string>& paths, Func& func) {
+    while (auto path = co_await paths.receive()) {
+        try {
+            co_await func(std::move(*path));
+        } catch (...) {
+            // stops the walker and the other workers
+            paths.close();
+            throw;
+        }
+    }
+}
+
+}
+
+// Calls func(std::string path) -> Coro<> for every regular file under root, with at most concurrency calls in flight.
+// Paths flow from the walker through a channel of the same capacity, so memory stays flat on any tree size.
+// Returns the number of files found, ec holds the first listing error
+template<typename Func>
+[[nodiscard]]
+inline Coro<size_t> for_each_file(std::string root, size_t concurrency, Func func, std::error_code& ec, ThreadPool* pool = nullptr) {
+    concurrency = std::max<size_t>(concurrency, 1);
+    Channel<std::string> paths(concurrency);
+    size_t count = 0;
+
+    std::vector<Coro<>> coros;
+    coros.push_back(detail::walk_files(std::move(root), paths, count, ec, pool));
+    for (size_t i = 0; i < concurrency; ++i) {
+        coros.push_back(detail::consume_files(paths, func));
+    }
+    co_await when_all(std::move(coros));
+    co_return count;
+}
+#endif
+
+}
+
+#endif
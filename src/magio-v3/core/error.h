@@ -13,6 +13,11 @@ public:
 
     std::string message(int code) const override;
 
+    // so the codes compare equal to std::errc values
+    std::error_condition default_error_condition(int code) const noexcept override {
+        return std::system_category().default_error_condition(code);
+    }
+
     static std::error_category& get() {
         static SocketSystemError error;
         return error;
@@ -0,0 +1,45 @@
+#include "magio-v3/core/event.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+namespace detail {
+
+void wake_all(Waiter* waiter) {
+    while (waiter) {
+        // the waiter may be gone as soon as it is queued
+        Waiter* next = waiter->next;
+        waiter->ctx->queue_in_context(waiter->handle);
+        waiter = next;
+    }
+}
+
+bool Event::Awaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    waiter_.ctx = LocalContext;
+    waiter_.handle = prev_h;
+    std::uintptr_t state = ev_.state_.load(std::memory_order_acquire);
+    do {
+        if (state == kSet) {
+            return false;
+        }
+        waiter_.next = reinterpret_cast<Waiter*>(state);
+    } while (!ev_.state_.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(&waiter_), std::memory_order_release, std::memory_order_acquire));
+    return true;
+}
+
+void Event::set() {
+    std::uintptr_t state = state_.exchange(kSet, std::memory_order_acq_rel);
+    if (state != kSet) {
+        wake_all(reinterpret_cast<Waiter*>(state));
+    }
+}
+
+void Event::reset() {
+    std::uintptr_t state = kSet;
+    state_.compare_exchange_strong(state, kNotSet, std::memory_order_relaxed);
+}
+
+}
+#endif
+
+}
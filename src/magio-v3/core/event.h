@@ -0,0 +1,76 @@
+#ifndef MAGIO_CORE_EVENT_H_
+#define MAGIO_CORE_EVENT_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "magio-v3/core/coro_context.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+namespace detail {
+
+// A suspended coroutine, linked into the wait list of a primitive
+struct Waiter {
+    CoroContext* ctx = nullptr;
+    std::coroutine_handle<> handle;
+    Waiter* next = nullptr;
+};
+
+// Resumes every waiter of the list in its own context
+void wake_all(Waiter* waiter);
+
+// Manual reset event, the base of Latch and WaitGroup.
+// The state is either kSet or the top of a lock-free stack of waiters.
+class Event: Noncopyable {
+public:
+    class Awaitable: Noncopyable {
+    public:
+        Awaitable(Event& ev)
+            : ev_(ev)
+        { }
+
+        bool await_ready() {
+            return ev_.is_set();
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h);
+
+        void await_resume() { }
+
+    private:
+        Event& ev_;
+        Waiter waiter_;
+    };
+
+    Event(bool set = false)
+        : state_(set ? kSet : kNotSet)
+    { }
+
+    [[nodiscard]]
+    Awaitable wait() {
+        return {*this};
+    }
+
+    void set();
+
+    void reset();
+
+    bool is_set() const {
+        return state_.load(std::memory_order_acquire) == kSet;
+    }
+
+private:
+    static constexpr std::uintptr_t kNotSet = 0;
+    static constexpr std::uintptr_t kSet = 1;
+
+    std::atomic<std::uintptr_t> state_;
+};
+
+}
+#endif
+
+}
+
+#endif
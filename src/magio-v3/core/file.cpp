@@ -1,19 +1,219 @@
 #include "magio-v3/core/file.h"
 
+#include "magio-v3/core/error.h"
 #include "magio-v3/core/logger.h"
 #include "magio-v3/core/coro_context.h"
 #include "magio-v3/core/io_context.h"
 
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
 #ifdef _WIN32
 
 #elif defined (__linux__)
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 namespace magio {
 
+namespace {
+
+#ifdef _WIN32
+std::chrono::system_clock::time_point to_time_point(FILETIME ft) {
+    // FILETIME counts 100ns since 1601
+    constexpr uint64_t kUnixEpoch = 116444736000000000ULL;
+    uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    auto since_epoch = std::chrono::duration<int64_t, std::ratio<1, 10000000>>((int64_t)(ticks - kUnixEpoch));
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+}
+
+FileStat to_file_stat(DWORD attributes, DWORD size_high, DWORD size_low, FILETIME modified) {
+    FileStat st;
+    st.size = ((size_t)size_high << 32) | size_low;
+    if (attributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+        st.type = std::filesystem::file_type::symlink;
+    } else if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+        st.type = std::filesystem::file_type::directory;
+    } else {
+        st.type = std::filesystem::file_type::regular;
+    }
+    st.modified = to_time_point(modified);
+    return st;
+}
+
+#elif defined (__linux__)
+// -1 if the mode has no valid access part
+int to_open_flags(int mode) {
+    int flag = 0;
+    switch (mode & 0b000111) {
+    case RandomAccessFile::ReadOnly:
+        flag = O_RDONLY;
+        break;
+    case RandomAccessFile::WriteOnly:
+        flag = O_WRONLY;
+        break;
+    case RandomAccessFile::ReadWrite:
+        flag = O_RDWR;
+        break;
+    default:
+        return -1;
+    }
+
+    if (mode & RandomAccessFile::Create) {
+        flag |= O_CREAT;
+    }
+    if (mode & RandomAccessFile::Truncate) {
+        flag |= O_TRUNC;
+    }
+    if (mode & RandomAccessFile::Append) {
+        flag |= O_APPEND;
+    }
+    if (mode & RandomAccessFile::Direct) {
+        flag |= O_DIRECT;
+    }
+    return flag;
+}
+
+FileStat to_file_stat(const struct statx& stx) {
+    using std::filesystem::file_type;
+
+    FileStat st;
+    st.size = stx.stx_size;
+    switch (stx.stx_mode & S_IFMT) {
+    case S_IFREG:
+        st.type = file_type::regular;
+        break;
+    case S_IFDIR:
+        st.type = file_type::directory;
+        break;
+    case S_IFLNK:
+        st.type = file_type::symlink;
+        break;
+    case S_IFIFO:
+        st.type = file_type::fifo;
+        break;
+    case S_IFSOCK:
+        st.type = file_type::socket;
+        break;
+    case S_IFCHR:
+        st.type = file_type::character;
+        break;
+    case S_IFBLK:
+        st.type = file_type::block;
+        break;
+    default:
+        st.type = file_type::unknown;
+        break;
+    }
+    auto since_epoch = std::chrono::seconds(stx.stx_mtime.tv_sec) + std::chrono::nanoseconds(stx.stx_mtime.tv_nsec);
+    st.modified = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+    return st;
+}
+
+#ifdef MAGIO_USE_CORO
+// For the operations whose only result is an error code
+template<typename Func>
+Coro<> run_file_op(int fd, std::error_code& ec, Func submit) {
+    ResumeHandle rhandle;
+    IoContext ioc{
+        .handle = fd,
+        .ptr = &rhandle,
+        .cb = completion_callback
+    };
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        rhandle.handle = h;
+        submit(ioc);
+    });
+
+    ec = rhandle.ec;
+}
+
+// path is relative to dfd, an empty path stats dfd itself
+Coro<FileStat> statx_at(int dfd, const char* path, std::error_code& ec) {
+    struct statx stx;
+    ResumeHandle rhandle;
+    IoContext ioc{
+        .handle = dfd,
+        .buf = io_buf((char*)path, 0),
+        .ptr = &rhandle,
+        .cb = completion_callback
+    };
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        rhandle.handle = h;
+        this_context::get_service().stat_file(ioc, &stx);
+    });
+
+    ec = rhandle.ec;
+    if (ec) {
+        co_return FileStat{};
+    }
+    co_return to_file_stat(stx);
+}
+#endif
+#endif
+
+#ifdef MAGIO_USE_CORO
+// IOV_MAX on linux
+constexpr size_t kMaxReadIovs = 1024;
+
+// One IoContext per read, or per run of adjacent reads when coalescing
+struct ReadBatch {
+    std::span<ReadRequest> requests;
+    // the requests by offset when coalescing, otherwise as given
+    std::vector<size_t> order;
+    // iocs[i] reads order[first[i]] up to order[first[i + 1]]
+    std::vector<size_t> first;
+    std::vector<IoContext> iocs;
+    std::vector<bool> done;
+#ifdef __linux__
+    std::vector<iovec> iovs;
+#endif
+    size_t submitted = 0;
+    // one more than the reads in flight while they are being submitted
+    size_t pending = 0;
+    std::error_code ec;
+    std::coroutine_handle<> handle;
+};
+
+void fill_run(ReadBatch& batch, size_t i, size_t len, std::error_code ec) {
+    // a short read fills the requests of a run in order
+    for (size_t k = batch.first[i]; k < batch.first[i + 1]; ++k) {
+        ReadRequest& req = batch.requests[batch.order[k]];
+        req.result = std::min(req.len, len);
+        req.ec = ec;
+        len -= req.result;
+    }
+}
+
+void read_batch_callback(std::error_code ec, IoContext* ioc, void* ptr) {
+    auto batch = (ReadBatch*)ptr;
+    size_t i = ioc - batch->iocs.data();
+    batch->done[i] = true;
+    fill_run(*batch, i, ec ? 0 : ioc->buf.len, ec);
+
+    if (ec && !batch->ec) {
+        batch->ec = ec;
+        for (size_t j = 0; j < batch->submitted; ++j) {
+            if (!batch->done[j]) {
+                this_context::get_service().cancel_one(batch->iocs[j]);
+            }
+        }
+    }
+    if (--batch->pending == 0) {
+        batch->handle.resume();
+    }
+}
+#endif
+
+}
+
 RandomAccessFile::RandomAccessFile() {
     reset();
 }
@@ -85,6 +285,10 @@ void RandomAccessFile::open(const char *path, int mode, int x) {
     if (mode & Append) {
         enable_app = true;
     }
+    DWORD flags = FILE_FLAG_OVERLAPPED;
+    if (mode & Direct) {
+        flags |= FILE_FLAG_NO_BUFFERING;
+    }
 
     LPCTSTR ppath = TEXT(path);
     HANDLE handle = CreateFile(
@@ -93,7 +297,7 @@ void RandomAccessFile::open(const char *path, int mode, int x) {
         FILE_SHARE_READ,
         NULL, 
         createion_disposition, 
-        FILE_FLAG_OVERLAPPED, 
+        flags, 
         NULL
     );
 
@@ -113,35 +317,11 @@ void RandomAccessFile::open(const char *path, int mode, int x) {
     enable_app_ = enable_app;
 
 #elif defined (__linux__)
-    int flag = 0;
-    int first = mode & 0b000111;
-    if (!(first)) {
-        return;
-    }
-    switch (first) {
-    case ReadOnly:
-        flag = O_RDONLY;
-        break;
-    case WriteOnly:
-        flag = O_WRONLY;
-        break;
-    case ReadWrite:
-        flag = O_RDWR;
-        break;
-    default:
+    int flag = to_open_flags(mode);
+    if (-1 == flag) {
         return;
     }
 
-    if (mode & Create) {
-        flag |= O_CREAT;
-    }
-    if (mode & Truncate) {
-        flag |= O_TRUNC;
-    }
-    if (mode & Append) {
-        flag |= O_APPEND;
-    }
-
     int fd = ::open(path, flag, x);
     if (-1 == fd) {
         return;
@@ -186,6 +366,90 @@ void RandomAccessFile::sync_data() {
 }
 
 #ifdef MAGIO_USE_CORO
+Coro<> RandomAccessFile::open(const char* path, int mode, std::error_code& ec, int x) {
+    if (handle_ != (Handle)-1) {
+        // a failed close can mean lost writes of the old file, report it instead of opening
+        co_await close(ec);
+        if (ec) {
+            co_return;
+        }
+    }
+
+#ifdef _WIN32
+    open(path, mode, x);
+    if (handle_ == (Handle)-1) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+#elif defined (__linux__)
+    int flag = to_open_flags(mode);
+    if (-1 == flag) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        co_return;
+    }
+
+    ResumeHandle rhandle;
+    IoContext ioc{
+        .handle = AT_FDCWD,
+        .buf = io_buf((char*)path, 0),
+        .ptr = &rhandle,
+        .cb = completion_callback
+    };
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        rhandle.handle = h;
+        this_context::get_service().open_file(ioc, flag, x);
+    });
+
+    ec = rhandle.ec;
+    if (!ec) {
+        handle_ = ioc.handle;
+    }
+#endif
+    co_return;
+}
+
+Coro<> RandomAccessFile::close(std::error_code& ec) {
+    if (handle_ == (Handle)-1) {
+        co_return;
+    }
+
+#ifdef _WIN32
+    if (!::CloseHandle(handle_)) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+    reset();
+#elif defined (__linux__)
+    ResumeHandle rhandle;
+    IoContext ioc{
+        .handle = handle_,
+        .ptr = &rhandle,
+        .cb = completion_callback
+    };
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        rhandle.handle = h;
+        this_context::get_service().close_file(ioc);
+    });
+
+    // the descriptor is released even if the close reports an error
+    reset();
+    ec = rhandle.ec;
+#endif
+}
+
+Coro<FileStat> RandomAccessFile::stat(std::error_code& ec) {
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!::GetFileInformationByHandle(handle_, &info)) {
+        ec = SYSTEM_ERROR_CODE;
+        co_return FileStat{};
+    }
+    co_return to_file_stat(info.dwFileAttributes, info.nFileSizeHigh, info.nFileSizeLow, info.ftLastWriteTime);
+#elif defined (__linux__)
+    co_return co_await statx_at(handle_, "", ec);
+#endif
+}
+
 Coro<size_t> RandomAccessFile::read_at(size_t offset, char *buf, size_t len, std::error_code &ec) {
     ResumeHandle rhandle;
     IoContext ioc{
@@ -204,6 +468,90 @@ Coro<size_t> RandomAccessFile::read_at(size_t offset, char *buf, size_t len, std
     co_return ioc.buf.len;
 }
 
+Coro<> RandomAccessFile::read_many(std::span<ReadRequest> requests, std::error_code& ec, bool coalesce) {
+#ifdef _WIN32
+    // see IoCompletionPort::read_file_vectored
+    coalesce = false;
+#endif
+    ReadBatch batch;
+    batch.requests = requests;
+    batch.order.resize(requests.size());
+    std::iota(batch.order.begin(), batch.order.end(), 0);
+    if (coalesce) {
+        std::stable_sort(batch.order.begin(), batch.order.end(), [&](size_t l, size_t r) {
+            return requests[l].offset < requests[r].offset;
+        });
+    }
+    for (auto& req : requests) {
+        req.result = 0;
+        req.ec.clear();
+    }
+
+    for (size_t k = 0; k < batch.order.size(); ++k) {
+        bool adjacent = false;
+        if (coalesce && k != 0 && k - batch.first.back() < kMaxReadIovs) {
+            const ReadRequest& prev = requests[batch.order[k - 1]];
+            adjacent = prev.offset + prev.len == requests[batch.order[k]].offset;
+        }
+        if (!adjacent) {
+            batch.first.push_back(k);
+        }
+    }
+    size_t runs = batch.first.size();
+    if (runs == 0) {
+        ec.clear();
+        co_return;
+    }
+    batch.first.push_back(batch.order.size());
+    batch.iocs.resize(runs);
+    batch.done.assign(runs, false);
+#ifdef __linux__
+    if (coalesce) {
+        batch.iovs.resize(batch.order.size());
+        for (size_t k = 0; k < batch.order.size(); ++k) {
+            const ReadRequest& req = requests[batch.order[k]];
+            batch.iovs[k] = {req.buf, req.len};
+        }
+    }
+#endif
+    batch.pending = runs + 1;
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        batch.handle = h;
+        auto& service = this_context::get_service();
+        for (size_t i = 0; i < runs; ++i) {
+            if (batch.ec) {
+                // an earlier read failed as it was submitted
+                fill_run(batch, i, 0, std::make_error_code(std::errc::operation_canceled));
+                --batch.pending;
+                continue;
+            }
+
+            IoContext& ioc = batch.iocs[i];
+            ioc.handle = decltype(IoContext::handle)(handle_);
+            ioc.ptr = &batch;
+            ioc.cb = read_batch_callback;
+            const ReadRequest& req = requests[batch.order[batch.first[i]]];
+            size_t count = batch.first[i + 1] - batch.first[i];
+            batch.submitted = i + 1;
+            if (count == 1) {
+                ioc.buf = io_buf(req.buf, req.len);
+                service.read_file(ioc, req.offset);
+            } else {
+#ifdef __linux__
+                ioc.buf = io_buf((char*)&batch.iovs[batch.first[i]], count);
+                service.read_file_vectored(ioc, req.offset);
+#endif
+            }
+        }
+        if (--batch.pending == 0) {
+            h.resume();
+        }
+    });
+
+    ec = batch.ec;
+}
+
 Coro<size_t> RandomAccessFile::write_at(size_t offset, const char *msg, size_t len, std::error_code &ec) {
     ResumeHandle rhandle;
     IoContext ioc{
@@ -229,38 +577,156 @@ Coro<size_t> RandomAccessFile::write_at(size_t offset, const char *msg, size_t l
     ec = rhandle.ec;
     co_return ioc.buf.len;
 }
+
+Coro<size_t> RandomAccessFile::write_and_sync_at(size_t offset, const char* msg, size_t len, std::error_code& ec) {
+    size_t written = 0;
+#ifdef __linux__
+    struct LinkedResume {
+        std::coroutine_handle<> handle;
+        std::error_code write_ec;
+        std::error_code sync_ec;
+        int pending = 2;
+    } state;
+
+    IoContext write_ioc{
+        .handle = handle_,
+        .buf = io_buf((char*)msg, len),
+        .ptr = &state,
+        .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
+            auto state = (LinkedResume*)ptr;
+            state->write_ec = ec;
+            if (--state->pending == 0) {
+                state->handle.resume();
+            }
+        }
+    };
+    IoContext sync_ioc{
+        .handle = handle_,
+        .ptr = &state,
+        .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
+            auto state = (LinkedResume*)ptr;
+            state->sync_ec = ec;
+            if (--state->pending == 0) {
+                state->handle.resume();
+            }
+        }
+    };
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
+        this_context::get_service().write_and_sync_file(write_ioc, sync_ioc, offset, true);
+    });
+
+    if (state.write_ec) {
+        ec = state.write_ec;
+        co_return 0;
+    }
+    written = write_ioc.buf.len;
+    if (written == len) {
+        ec = state.sync_ec;
+        co_return written;
+    }
+    // a short write cancelled the linked sync
+#endif
+
+    while (written < len) {
+        size_t wr = co_await write_at(offset + written, msg + written, len - written, ec);
+        if (ec) {
+            co_return written;
+        }
+        if (wr == 0) {
+            ec = std::make_error_code(std::errc::io_error);
+            co_return written;
+        }
+        written += wr;
+    }
+    co_await sync_data(ec);
+    co_return written;
+}
+
+Coro<> RandomAccessFile::sync_all(std::error_code& ec) {
+#ifdef _WIN32
+    if (!::FlushFileBuffers(handle_)) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+    co_return;
+#elif defined (__linux__)
+    co_await run_file_op(handle_, ec, [](IoContext& ioc) {
+        this_context::get_service().sync_file(ioc, false);
+    });
+#endif
+}
+
+Coro<> RandomAccessFile::sync_data(std::error_code& ec) {
+#ifdef _WIN32
+    if (!::FlushFileBuffers(handle_)) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+    co_return;
+#elif defined (__linux__)
+    co_await run_file_op(handle_, ec, [](IoContext& ioc) {
+        this_context::get_service().sync_file(ioc, true);
+    });
+#endif
+}
+
+Coro<> RandomAccessFile::allocate(size_t offset, size_t len, std::error_code& ec) {
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = offset + len;
+    if (!::SetFileInformationByHandle(handle_, FileAllocationInfo, &info, sizeof(info))) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+    co_return;
+#elif defined (__linux__)
+    co_await run_file_op(handle_, ec, [offset, len](IoContext& ioc) {
+        this_context::get_service().allocate_file(ioc, offset, len);
+    });
+#endif
+}
+
+Coro<> RandomAccessFile::sync_range(size_t offset, size_t len, std::error_code& ec) {
+#ifdef _WIN32
+    // no ranged writeback on windows, the next flush does all the work
+    co_return;
+#elif defined (__linux__)
+    co_await run_file_op(handle_, ec, [offset, len](IoContext& ioc) {
+        this_context::get_service().sync_file_range(ioc, offset, len);
+    });
+#endif
+}
 #endif
 
 void RandomAccessFile::read_at(size_t offset, char *buf, size_t len, std::function<void (std::error_code, size_t)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
-    auto ioc = new IoContext{
+    auto ioc = detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = decltype(IoContext::handle)(handle_),
         .buf= io_buf(buf, len),
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete ioc;
-            delete cb;
+            detail::destroy(ioc, AllocCategory::Io);
+            detail::destroy(cb, AllocCategory::Io);
         }
-    };
+    });
 
     this_context::get_service().read_file(*ioc, offset);
 }
 
 void RandomAccessFile::write_at(size_t offset, const char *msg, size_t len, std::function<void (std::error_code, size_t)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
-    auto ioc = new IoContext{
+    auto ioc = detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = decltype(IoContext::handle)(handle_),
         .buf = io_buf((char*)msg, len),
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete ioc;
-            delete cb;
+            detail::destroy(ioc, AllocCategory::Io);
+            detail::destroy(cb, AllocCategory::Io);
         }
-    };
+    });
 
 #ifdef _WIN32
     if (enable_app_) {
@@ -317,6 +783,20 @@ void File::close() {
 }
 
 #ifdef MAGIO_USE_CORO
+Coro<> File::open(const char* path, int mode, std::error_code& ec, int x) {
+    read_offset_ = 0;
+    write_offset_ = 0;
+    co_await file_.open(path, mode, ec, x);
+}
+
+Coro<> File::close(std::error_code& ec) {
+    co_await file_.close(ec);
+}
+
+Coro<FileStat> File::stat(std::error_code& ec) {
+    co_return co_await file_.stat(ec);
+}
+
 Coro<size_t> File::read(char *buf, size_t len, std::error_code &ec) {
     size_t rd = co_await file_.read_at(read_offset_, buf, len, ec);
     read_offset_ += rd;
@@ -328,6 +808,28 @@ Coro<size_t> File::write(const char *buf, size_t len, std::error_code &ec) {
     write_offset_ += wl;
     co_return wl;
 }
+
+Coro<size_t> File::write_and_sync(const char* buf, size_t len, std::error_code& ec) {
+    size_t wl = co_await file_.write_and_sync_at(write_offset_, buf, len, ec);
+    write_offset_ += wl;
+    co_return wl;
+}
+
+Coro<> File::sync_all(std::error_code& ec) {
+    co_await file_.sync_all(ec);
+}
+
+Coro<> File::sync_data(std::error_code& ec) {
+    co_await file_.sync_data(ec);
+}
+
+Coro<> File::allocate(size_t offset, size_t len, std::error_code& ec) {
+    co_await file_.allocate(offset, len, ec);
+}
+
+Coro<> File::sync_range(size_t offset, size_t len, std::error_code& ec) {
+    co_await file_.sync_range(offset, len, ec);
+}
 #endif
 
 void File::read(char *buf, size_t len, std::function<void (std::error_code, size_t)> &&completion_cb) {
@@ -352,4 +854,19 @@ void File::sync_data() {
     file_.sync_data();
 }
 
+#ifdef MAGIO_USE_CORO
+Coro<FileStat> stat_file(const char* path, std::error_code& ec) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!::GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        ec = SYSTEM_ERROR_CODE;
+        co_return FileStat{};
+    }
+    co_return to_file_stat(data.dwFileAttributes, data.nFileSizeHigh, data.nFileSizeLow, data.ftLastWriteTime);
+#elif defined (__linux__)
+    co_return co_await statx_at(AT_FDCWD, path, ec);
+#endif
+}
+#endif
+
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #ifndef MAGIO_CORE_FILE_H_
 #define MAGIO_CORE_FILE_H_
 
+#include <span>
+#include <chrono>
 #include <functional>
+#include <filesystem>
 #include <system_error>
 #include "magio-v3/core/noncopyable.h"
 
@@ -10,6 +13,22 @@ namespace magio {
 template<typename>
 class Coro;
 
+struct FileStat {
+    size_t size = 0;
+    // symlinks are not followed
+    std::filesystem::file_type type = std::filesystem::file_type::none;
+    std::chrono::system_clock::time_point modified;
+};
+
+struct ReadRequest {
+    size_t offset;
+    char* buf;
+    size_t len;
+    // filled in by read_many, a short result means the file ended
+    size_t result = 0;
+    std::error_code ec;
+};
+
 class RandomAccessFile: Noncopyable {
     friend class File;
 
@@ -28,7 +47,10 @@ public:
 
         Create    = 0b001000,
         Truncate  = 0b010000,
-        Append    = 0b100000
+        Append    = 0b100000,
+
+        // bypasses the page cache, buffers, offsets and lengths must be aligned to the logical block size
+        Direct    = 0b1000000
     };
 
     RandomAccessFile();
@@ -48,12 +70,47 @@ public:
     void close();
 
 #ifdef MAGIO_USE_CORO
+    // Opens without blocking the context where io_uring is available
+    [[nodiscard]]
+    Coro<void> open(const char* path, int mode, std::error_code& ec, int x = 0744);
+
+    [[nodiscard]]
+    Coro<void> close(std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<FileStat> stat(std::error_code& ec);
+
     [[nodiscard]]
     Coro<size_t> read_at(size_t offset, char* buf, size_t len, std::error_code& ec);
 
+    // Submits every read at once and completes when all of them have.
+    // The first failure cancels the reads still in flight and is reported in ec, each request has its own result.
+    // With coalesce, requests covering adjacent ranges of the file are read by one vectored read
+    [[nodiscard]]
+    Coro<void> read_many(std::span<ReadRequest> requests, std::error_code& ec, bool coalesce = false);
+
     [[nodiscard]]
     Coro<size_t> write_at(size_t offset, const char* msg, size_t len, std::error_code& ec);
 
+    // Writes the whole message and syncs its data, submitted as one linked write and fdatasync where possible
+    [[nodiscard]]
+    Coro<size_t> write_and_sync_at(size_t offset, const char* msg, size_t len, std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> sync_all(std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> sync_data(std::error_code& ec);
+
+    // Reserves disk space for the range, later writes into it cannot fail with ENOSPC
+    [[nodiscard]]
+    Coro<void> allocate(size_t offset, size_t len, std::error_code& ec);
+
+    // Starts writeback of the range without waiting for it.
+    // Not durable by itself, it makes the next sync_data cheaper
+    [[nodiscard]]
+    Coro<void> sync_range(size_t offset, size_t len, std::error_code& ec);
+
 #endif
     void read_at(size_t offset, char* buf, size_t len, std::function<void(std::error_code, size_t)>&& completion_cb);
 
@@ -84,7 +141,10 @@ public:
 
         Create    = 0b001000,
         Truncate  = 0b010000,
-        Append    = 0b100000
+        Append    = 0b100000,
+
+        // bypasses the page cache, buffers, offsets and lengths must be aligned to the logical block size
+        Direct    = 0b1000000
     };
 
     File();
@@ -102,12 +162,36 @@ public:
     void close();
 
 #ifdef MAGIO_USE_CORO
+    [[nodiscard]]
+    Coro<void> open(const char* path, int mode, std::error_code& ec, int x = 0744);
+
+    [[nodiscard]]
+    Coro<void> close(std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<FileStat> stat(std::error_code& ec);
+
     [[nodiscard]]
     Coro<size_t> read(char* buf, size_t len, std::error_code& ec);
     
     [[nodiscard]]
     Coro<size_t> write(const char* buf, size_t len, std::error_code& ec);
 
+    [[nodiscard]]
+    Coro<size_t> write_and_sync(const char* buf, size_t len, std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> sync_all(std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> sync_data(std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> allocate(size_t offset, size_t len, std::error_code& ec);
+
+    [[nodiscard]]
+    Coro<void> sync_range(size_t offset, size_t len, std::error_code& ec);
+
 #endif
     void read(char* buf, size_t len, std::function<void(std::error_code, size_t)>&& completion_cb);
     
@@ -129,6 +213,12 @@ private:
     size_t write_offset_ = 0;
 };
 
+#ifdef MAGIO_USE_CORO
+// Stats a path without opening it
+[[nodiscard]]
+Coro<FileStat> stat_file(const char* path, std::error_code& ec);
+#endif
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,128 @@
+#ifndef MAGIO_CORE_HISTOGRAM_H_
+#define MAGIO_CORE_HISTOGRAM_H_
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace magio {
+
+// Counts non-negative integers the way HdrHistogram does: exact below 2^kSubBucketBits,
+// above that every power of two is split into 2^kSubBucketBits linear buckets,
+// so a percentile is off by less than 1% however large the values get.
+// Recording is a few instructions and never allocates, merge to combine threads
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBuckets = kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+
+    Histogram()
+        : counts_(kBuckets)
+    { }
+
+    void record(uint64_t value, uint64_t n = 1) {
+        counts_[index(value)] += n;
+        count_ += n;
+        sum_ += value * n;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+        sum_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+    }
+
+    // The smallest recorded bucket holding at least p percent of the values, as its highest value
+    uint64_t percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(p / 100 * count_ + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::clamp(highest(i), min_, max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    uint64_t sum() const {
+        return sum_;
+    }
+
+    uint64_t min() const {
+        return count_ ? min_ : 0;
+    }
+
+    uint64_t max() const {
+        return max_;
+    }
+
+    double mean() const {
+        return count_ ? double(sum_) / count_ : 0;
+    }
+
+    // Buckets are visited in increasing order, func(highest value of the bucket, count)
+    template<typename Func>
+    void for_each(Func&& func) const {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            if (counts_[i]) {
+                func(highest(i), counts_[i]);
+            }
+        }
+    }
+
+    static size_t index(uint64_t value) {
+        if (value < kSubBuckets) {
+            return (size_t)value;
+        }
+        // the bits below the leading one select the linear bucket
+        int exp = std::bit_width(value) - 1;
+        int shift = exp - kSubBucketBits;
+        size_t sub = (size_t)(value >> shift) & (kSubBuckets - 1);
+        return kSubBuckets + (size_t)shift * kSubBuckets + sub;
+    }
+
+    static uint64_t highest(size_t idx) {
+        if (idx < kSubBuckets) {
+            return idx;
+        }
+        size_t shift = (idx - kSubBuckets) / kSubBuckets;
+        uint64_t sub = (idx - kSubBuckets) % kSubBuckets;
+        uint64_t lowest = (kSubBuckets + sub) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+}
+
+#endif
@@ -4,25 +4,189 @@
 namespace magio {
 
 #ifdef MAGIO_USE_CORO
-template<typename...Ts>
-inline Coro<> select(Coro<Ts>...coros) {
-    auto flag = std::make_shared<bool>(false);
+namespace detail {
+
+// Wakes the task of state from the io or the timer it waits for, in the context they belong to
+inline void cancel_pending(CancelState& state) {
+    IoContext* io;
+    std::optional<TimerHandle> timer;
+    {
+        std::lock_guard lk(state.lock);
+        if (state.ctx != LocalContext) {
+            // resumed meanwhile
+            return;
+        }
+        io = state.pending_io;
+        timer = state.pending_timer;
+    }
+    if (io) {
+        this_context::get_service().cancel_one(*io);
+    }
+    if (timer) {
+        timer->cancel();
+    }
+}
+
+// Cancels the task of state from any context. If it waits in another one, hold is called to keep
+// state alive until that context has woken the task and returns the function releasing it
+template<typename Hold>
+inline void cancel_task(CancelState& state, Hold&& hold) {
+    CoroContext* ctx;
+    {
+        std::lock_guard lk(state.lock);
+        if (state.cancelled.exchange(true, std::memory_order_relaxed)) {
+            return;
+        }
+        ctx = state.ctx;
+    }
+    if (!ctx) {
+        // running or queued, its next io or sleep fails at once
+        return;
+    }
+    if (ctx == LocalContext) {
+        cancel_pending(state);
+        return;
+    }
+    execute_in(*ctx, [&state, release = hold()] {
+        cancel_pending(state);
+        release();
+    });
+}
+
+// Lives in the frame of the joining coroutine, every child callback only captures its address
+template<typename Result = Unit>
+struct JoinState {
+    void complete(std::exception_ptr ep) {
+        if (ep && !eptr) {
+            eptr = ep;
+        }
+        if (--count == 0) {
+            handle.resume();
+        }
+    }
+
+    size_t count;
     std::exception_ptr eptr;
+    Result result;
+    std::coroutine_handle<> handle;
+};
+
+// Shared by the waiter and the children, the last one to leave frees it
+template<typename T>
+struct WhenAnyState {
+    WhenAnyState(size_t n)
+        : refs(n + 1), cancels(n)
+    { }
 
-    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) mutable {
-        (this_context::spawn(coros, [flag, h, &eptr](std::exception_ptr ep, VoidToUnit<Ts> ret) mutable {
-            if (*flag) {
-                return;
+    template<typename U>
+    void spawn(size_t idx, Coro<U> coro) {
+        coro.handle().promise().cancel_state = &cancels[idx];
+        this_context::spawn(coro, [this, idx](std::exception_ptr ep, VoidToUnit<U> ret) {
+            if constexpr (std::is_void_v<T>) {
+                complete(idx, ep, Unit{});
+            } else {
+                complete(idx, ep, std::move(ret));
             }
+        }, std::source_location{});
+    }
 
-            *flag = true;
-            if (ep) {
-                eptr = ep;
+    void complete(size_t idx, std::exception_ptr ep, VoidToUnit<T>&& ret) {
+        if (!done) {
+            done = true;
+            index = idx;
+            eptr = ep;
+            value.emplace(std::move(ret));
+            cancel_losers();
+            handle.resume();
+        }
+        release();
+    }
+
+    void cancel_losers() {
+        for (size_t i = 0; i < cancels.size(); ++i) {
+            if (i != index) {
+                cancel_task(cancels[i], [this] {
+                    refs.fetch_add(1, std::memory_order_relaxed);
+                    return [this] {
+                        release();
+                    };
+                });
             }
-            h.resume();
-        }), ...);
+        }
+    }
+
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            detail::destroy(this, AllocCategory::Frame);
+        }
+    }
+
+    // the children and the cancellations running in other contexts
+    std::atomic<size_t> refs;
+    bool done = false;
+    size_t index = 0;
+    std::exception_ptr eptr;
+    std::optional<VoidToUnit<T>> value;
+    std::vector<CancelState> cancels;
+    std::coroutine_handle<> handle;
+};
+
+template<typename Iter, typename Func>
+struct ForEachConcurrentState {
+    // Also runs in the final suspend of a child, which must not throw, so an exception of func
+    // stops the launching like a failed child does
+    void launch() {
+        try {
+            auto coro = func(*next);
+            ++next;
+            this_context::spawn(std::move(coro), [this](std::exception_ptr ep, auto&&) {
+                complete(ep);
+            }, std::source_location{});
+            ++running;
+        } catch (...) {
+            if (!eptr) {
+                eptr = std::current_exception();
+            }
+        }
+    }
+
+    void complete(std::exception_ptr ep) {
+        --running;
+        if (ep && !eptr) {
+            eptr = ep;
+        }
+        if (!eptr && next != last) {
+            launch();
+        }
+        if (running == 0) {
+            handle.resume();
+        }
+    }
+
+    Iter next;
+    Iter last;
+    Func& func;
+    size_t running = 0;
+    std::exception_ptr eptr;
+    std::coroutine_handle<> handle;
+};
+
+}
+
+template<typename...Ts>
+inline Coro<> select(Coro<Ts>...coros) {
+    auto state = detail::make<detail::WhenAnyState<void>>(AllocCategory::Frame, sizeof...(coros));
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state->handle = h;
+        [&]<size_t...Idx>(std::index_sequence<Idx...>) {
+            (state->spawn(Idx, coros), ...);
+        }(std::index_sequence_for<Ts...>{});
     });
 
+    std::exception_ptr eptr = state->eptr;
+    state->release();
+
     if (eptr) {
         std::rethrow_exception(eptr);
     }
@@ -30,41 +194,27 @@ inline Coro<> select(Coro<Ts>...coros) {
 
 template<typename...Ts>
 inline Coro<RemoveVoidTuple<Ts...>> join(Coro<Ts>...coros) {
-    auto count = std::make_shared<size_t>(sizeof...(coros));
-    std::exception_ptr eptr;
-    RemoveVoidTuple<Ts...> result;
+    detail::JoinState<RemoveVoidTuple<Ts...>> state{sizeof...(coros)};
 
     co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
         [&]<size_t...Idx>(std::index_sequence<Idx...>) {
-            
-            (this_context::spawn(coros, [&eptr, &result, count, h](std::exception_ptr ep, VoidToUnit<Ts> ret) mutable {
-                if (*count == 0) {
-                    return;
-                }
-
-                *count = *count - 1;
-                if (ep) {
-                    eptr = ep;
-                    *count = 0;
-                    h.resume();
-                } else {
+            (this_context::spawn(coros, [ps = &state](std::exception_ptr ep, VoidToUnit<Ts> ret) {
+                if (!ep) {
                     if constexpr (Idx != (size_t)-1) {
-                        std::get<Idx>(result) = std::move(ret);  
-                    }
-                    
-                    if (*count == 0) {
-                        h.resume();
+                        std::get<Idx>(ps->result) = std::move(ret);
                     }
                 }
-            }), ...);
+                ps->complete(ep);
+            }, std::source_location{}), ...);
         }(NonVoidPlaceSequence<Ts...>{});
     });
 
-    if (eptr) {
-        std::rethrow_exception(eptr);
+    if (state.eptr) {
+        std::rethrow_exception(state.eptr);
     }
 
-    co_return result;
+    co_return std::move(state.result);
 }
 
 template<typename...Ts>
@@ -84,29 +234,169 @@ inline Coro<RemoveVoidTuple<Ts...>> series(Coro<Ts>...coros) {
     co_return result;
 }
 
+template<typename T>
+requires (!std::is_void_v<T>)
+inline Coro<std::vector<T>> when_all(std::vector<Coro<T>> coros) {
+    detail::JoinState<std::vector<std::optional<T>>> state{coros.size()};
+    state.result.resize(coros.size());
+    if (coros.empty()) {
+        co_return {};
+    }
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
+        for (size_t i = 0; i < coros.size(); ++i) {
+            this_context::spawn(coros[i], [ps = &state, i](std::exception_ptr ep, T ret) {
+                if (!ep) {
+                    ps->result[i].emplace(std::move(ret));
+                }
+                ps->complete(ep);
+            }, std::source_location{});
+        }
+    });
+
+    if (state.eptr) {
+        std::rethrow_exception(state.eptr);
+    }
+
+    std::vector<T> result;
+    result.reserve(state.result.size());
+    for (auto& ret : state.result) {
+        result.push_back(std::move(ret.value()));
+    }
+    co_return result;
+}
+
+inline Coro<> when_all(std::vector<Coro<>> coros) {
+    detail::JoinState<> state{coros.size()};
+    if (coros.empty()) {
+        co_return;
+    }
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
+        for (auto& coro : coros) {
+            this_context::spawn(coro, [ps = &state](std::exception_ptr ep, Unit) {
+                ps->complete(ep);
+            }, std::source_location{});
+        }
+    });
+
+    if (state.eptr) {
+        std::rethrow_exception(state.eptr);
+    }
+}
+
+template<typename T>
+inline Coro<WhenAnyResult<T>> when_any(std::vector<Coro<T>> coros) {
+    if (coros.empty()) {
+        M_FATAL("{}", "when_any requires at least one coro");
+    }
+
+    auto state = detail::make<detail::WhenAnyState<T>>(AllocCategory::Frame, coros.size());
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state->handle = h;
+        for (size_t i = 0; i < coros.size(); ++i) {
+            state->spawn(i, coros[i]);
+        }
+    });
+
+    size_t index = state->index;
+    std::exception_ptr eptr = state->eptr;
+    std::optional<VoidToUnit<T>> value = std::move(state->value);
+    state->release();
+
+    if (eptr) {
+        std::rethrow_exception(eptr);
+    }
+
+    if constexpr (std::is_void_v<T>) {
+        co_return index;
+    } else {
+        co_return {index, std::move(value.value())};
+    }
+}
+
+template<typename Range, typename Func>
+inline Coro<> for_each_concurrent(Range&& range, size_t limit, Func func) {
+    static_assert(IsRange<Range>::value, "for_each_concurrent requires a range");
+
+    detail::ForEachConcurrentState<decltype(range.begin()), Func> state{
+        range.begin(), range.end(), func
+    };
+    if (state.next == state.last) {
+        co_return;
+    }
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
+        for (size_t i = 0; i < std::max<size_t>(limit, 1) && state.next != state.last && !state.eptr; ++i) {
+            state.launch();
+        }
+        if (state.running == 0) {
+            // the first func threw
+            this_context::queue_in_context(h);
+        }
+    });
+
+    if (state.eptr) {
+        std::rethrow_exception(state.eptr);
+    }
+}
+
+namespace detail {
+
+// A cancelled task wakes up from its sleep through the run queue, a sleep dropped with its context never does
+inline void sleep_until(const TimerClock::time_point& tp, std::coroutine_handle<> h) {
+    CancelState* state = SuspendingCancel;
+    if (state && state->cancelled) {
+        this_context::queue_in_context(h);
+        return;
+    }
+
+    auto timer = this_context::expires_until(tp, [h, state](bool flag) mutable {
+        if (flag) {
+            h.resume();
+        } else if (state && state->cancelled) {
+            this_context::queue_in_context(h);
+        }
+    });
+    if (state && !state->attach_timer(LocalContext, timer)) {
+        // cancelled since the check above
+        timer.cancel();
+    }
+}
+
+}
+
 namespace this_coro {
 
 template<typename Rep, typename Per>
 inline Coro<> sleep_for(const std::chrono::duration<Rep, Per>& dur) {
     co_await GetCoroutineHandle([&](std::coroutine_handle<> h)  {
-        this_context::expires_after(dur, [h](bool flag) mutable {
-            if (flag) {
-                h.resume();
-            }
-        });
+        detail::sleep_until(TimerClock::now() + dur, h);
     });
 }
 
 inline Coro<> sleep_until(const TimerClock::time_point& tp) {
     co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
-        this_context::expires_until(tp, [h](bool flag) mutable {
-            if (flag) {
-                h.resume();
-            }
-        });
+        detail::sleep_until(tp, h);
     });
 }
 
+inline void ResumeOnContext::await_suspend(std::coroutine_handle<> prev_h) {
+    ctx_.queue_in_context(prev_h);
+}
+
+}
+
+namespace detail {
+
+inline void execute_in(CoroContext& ctx, Task&& task) {
+    ctx.execute(std::move(task));
+}
+
 }
 #endif
 
@@ -13,6 +13,10 @@ inline void stop() {
     LocalContext->stop();
 }
 
+inline void shutdown(const TimerClock::time_point& deadline) {
+    LocalContext->shutdown(deadline);
+}
+
 inline void execute(Task&& task) {
     LocalContext->execute(std::move(task));
 }
@@ -23,7 +27,8 @@ inline void dispatch(Task &&task) {
 
 #ifdef MAGIO_USE_CORO
 template<typename T>
-inline void spawn(Coro<T> coro) {
+inline void spawn(Coro<T> coro, std::source_location loc) {
+    detail::mark_spawned(coro, loc);
     queue_in_context(coro.handle());
 }
 
@@ -33,8 +38,9 @@ inline void spawn(Coro<T> coro, detail::UseCoro) {
 }
 
 template<typename T>
-inline void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler) {
-    coro.set_callback(std::move(handler));
+inline void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler, std::source_location loc) {
+    detail::mark_spawned(coro, loc);
+    coro.set_callback(std::move(handler), LocalContext);
     queue_in_context(coro.handle());
 }
 
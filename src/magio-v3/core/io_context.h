@@ -19,10 +19,19 @@ enum class Operation {
     WakeUp,
     ReadFile,
     WriteFile,
+    ReadFileVectored,
     Accept,
     Connect,
     Receive,
     Send,
+    Cancel,
+    OpenFile,
+    StatFile,
+    CloseFile,
+    SyncFile,
+    AllocateFile,
+    SyncFileRange,
+    AdviseMemory,
 };
 
 // for linux
@@ -49,6 +58,58 @@ struct IoContext {
     socklen_t addr_len;
     void* ptr;
     void(*cb)(std::error_code, IoContext*, void*);
+    // links of the IoList the io service keeps the operation in while it is in flight
+    IoContext* prev = nullptr;
+    IoContext* next = nullptr;
+};
+
+// Intrusive list of in-flight operations, tracking one allocates nothing
+class IoList {
+public:
+    void push(IoContext* ioc) {
+        ioc->prev = nullptr;
+        ioc->next = head_;
+        if (head_) {
+            head_->prev = ioc;
+        }
+        head_ = ioc;
+        ++size_;
+    }
+
+    // does nothing if ioc is not in the list
+    void erase(IoContext* ioc) {
+        if (!ioc->prev && head_ != ioc) {
+            return;
+        }
+
+        if (ioc->prev) {
+            ioc->prev->next = ioc->next;
+        } else {
+            head_ = ioc->next;
+        }
+        if (ioc->next) {
+            ioc->next->prev = ioc->prev;
+        }
+        ioc->prev = nullptr;
+        ioc->next = nullptr;
+        --size_;
+    }
+
+    // func must not erase from the list
+    template<typename Func>
+    void for_each(Func&& func) {
+        for (IoContext* ioc = head_; ioc; ioc = ioc->next) {
+            func(ioc);
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    IoContext* head_ = nullptr;
+    size_t size_ = 0;
 };
 
 #ifdef MAGIO_USE_CORO
@@ -15,6 +15,10 @@ class IpAddress;
 
 struct IoContext;
 
+namespace metrics {
+struct ContextMetrics;
+}
+
 class IoService {
 public:
     virtual ~IoService() = default;
@@ -23,6 +27,32 @@ public:
 
     virtual void write_file(IoContext& ioc, size_t offset) = 0;
 
+    // ioc.buf.buf points at ioc.buf.len iovecs filled from one contiguous range of the file
+    virtual void read_file_vectored(IoContext& ioc, size_t offset) = 0;
+
+    // ioc.buf.buf holds the path, relative to the directory ioc.handle, which becomes the opened file
+    virtual void open_file(IoContext& ioc, int flags, int mode) = 0;
+
+    // fills the platform stat buffer for the path in ioc.buf.buf, or ioc.handle itself if the path is empty
+    virtual void stat_file(IoContext& ioc, void* stat_buf) = 0;
+
+    virtual void close_file(IoContext& ioc) = 0;
+
+    // fdatasync instead of fsync if data_only
+    virtual void sync_file(IoContext& ioc, bool data_only) = 0;
+
+    virtual void allocate_file(IoContext& ioc, size_t offset, size_t len) = 0;
+
+    // starts writeback of the range without waiting for it
+    virtual void sync_file_range(IoContext& ioc, size_t offset, size_t len) = 0;
+
+    // the sync runs only if the whole write succeeded, otherwise it completes with operation_canceled.
+    // Both contexts complete separately
+    virtual void write_and_sync_file(IoContext& write_ioc, IoContext& sync_ioc, size_t offset, bool data_only) = 0;
+
+    // madvise on the memory range ioc.buf, e.g. MADV_WILLNEED starts reading a mapped file in
+    virtual void advise_memory(IoContext& ioc, int advice) = 0;
+
     virtual void connect(IoContext& ioc) = 0;
 
     virtual void accept(net::Socket& listener, IoContext& ioc) = 0;
@@ -35,14 +65,38 @@ public:
 
     virtual void receive_from(IoContext& ioc) = 0;
 
+    // cancel all operations on ioc.handle
     virtual void cancel(IoContext& ioc) = 0;
 
+    // cancel the in-flight operation ioc
+    virtual void cancel_one(IoContext& ioc) = 0;
+
+    // cancel the in-flight accepts, the later ones complete with operation_canceled
+    virtual void stop_accepting() = 0;
+
+    // cancel every in-flight operation, the later ones complete with operation_canceled
+    virtual void cancel_all() = 0;
+
+    // operations whose completion has not been handled yet
+    virtual size_t in_flight() const = 0;
+
+    // in_flight() without the refused operations, which complete with operation_canceled right away
+    virtual size_t in_kernel() const = 0;
+
     virtual void relate(void* handle, std::error_code& ec) = 0;
 
     // -1->big error, 0->wait timeout; 1->io; 2->continue
     virtual int poll(bool block, std::error_code& ec) = 0;
 
     virtual void wake_up() = 0;
+
+    // where submissions and completions are counted, the owning context sets it
+    void set_metrics(metrics::ContextMetrics* metrics) {
+        metrics_ = metrics;
+    }
+
+protected:
+    metrics::ContextMetrics* metrics_ = nullptr;
 };
 
 }
@@ -0,0 +1,38 @@
+#include "magio-v3/core/latch.h"
+
+#include "magio-v3/core/logger.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+Barrier::Barrier(size_t count)
+    : count_(count), remaining_(count)
+{
+    if (count == 0) {
+        M_FATAL("{}", "the count of a barrier must be greater than 0");
+    }
+}
+
+bool Barrier::Awaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    detail::Waiter* woken;
+    {
+        std::lock_guard lk(barrier_.lock_);
+        if (--barrier_.remaining_ != 0) {
+            waiter_.ctx = LocalContext;
+            waiter_.handle = prev_h;
+            waiter_.next = barrier_.waiters_;
+            barrier_.waiters_ = &waiter_;
+            return true;
+        }
+
+        // next phase
+        barrier_.remaining_ = barrier_.count_;
+        woken = std::exchange(barrier_.waiters_, nullptr);
+    }
+
+    detail::wake_all(woken);
+    return false;
+}
+#endif
+
+}
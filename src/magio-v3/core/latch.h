@@ -0,0 +1,83 @@
+#ifndef MAGIO_CORE_LATCH_H_
+#define MAGIO_CORE_LATCH_H_
+
+#include "magio-v3/core/event.h"
+#include "magio-v3/core/spin_lock.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+// Single use, coroutines waiting on it are resumed once the count reaches zero
+class Latch: Noncopyable {
+public:
+    explicit Latch(size_t count)
+        : count_(count), event_(count == 0)
+    { }
+
+    void count_down(size_t n = 1) {
+        if (count_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+            event_.set();
+        }
+    }
+
+    bool try_wait() const {
+        return event_.is_set();
+    }
+
+    [[nodiscard]]
+    detail::Event::Awaitable wait() {
+        return event_.wait();
+    }
+
+    [[nodiscard]]
+    detail::Event::Awaitable arrive_and_wait(size_t n = 1) {
+        count_down(n);
+        return event_.wait();
+    }
+
+private:
+    std::atomic<size_t> count_;
+    detail::Event event_;
+};
+
+// Reusable, every phase completes when count coroutines have arrived.
+// The last one to arrive does not suspend.
+class Barrier: Noncopyable {
+public:
+    class Awaitable: Noncopyable {
+    public:
+        Awaitable(Barrier& barrier)
+            : barrier_(barrier)
+        { }
+
+        bool await_ready() {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h);
+
+        void await_resume() { }
+
+    private:
+        Barrier& barrier_;
+        detail::Waiter waiter_;
+    };
+
+    explicit Barrier(size_t count);
+
+    [[nodiscard]]
+    Awaitable arrive_and_wait() {
+        return {*this};
+    }
+
+private:
+    SpinLock lock_;
+    size_t count_;
+    size_t remaining_;
+    detail::Waiter* waiters_ = nullptr;
+};
+#endif
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+#include "magio-v3/core/log_file.h"
+
+#include <filesystem>
+
+#include "magio-v3/core/logger.h"
+#include "magio-v3/core/coro_context.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+LogFile::LogFile(std::string path)
+    : LogFile(std::move(path), Options{})
+{ }
+
+LogFile::LogFile(std::string path, Options options)
+    : path_(std::move(path))
+    , options_(options)
+{
+    thread_ = std::thread(&LogFile::run, this);
+    bool opened;
+    {
+        std::unique_lock lk(m_);
+        opened_cv_.wait(lk, [this] {
+            return opened_.has_value();
+        });
+        opened = *opened_;
+    }
+    if (!opened) {
+        thread_.join();
+        M_FATAL("cannot open log file {}", path_);
+    }
+}
+
+LogFile::~LogFile() {
+    {
+        std::lock_guard lk(m_);
+        stopping_ = true;
+    }
+    event_.set();
+    thread_.join();
+}
+
+void LogFile::write(std::string_view lines) {
+    {
+        std::unique_lock lk(m_);
+        if (pending_.size() + lines.size() > options_.buffer_limit && pending_.size() != 0) {
+            if (options_.overflow == Drop) {
+                dropped_ += lines.size();
+                return;
+            }
+            space_cv_.wait(lk, [&] {
+                return pending_.size() + lines.size() <= options_.buffer_limit || pending_.size() == 0;
+            });
+        }
+        pending_.append(lines);
+    }
+    event_.set();
+}
+
+size_t LogFile::dropped() {
+    std::lock_guard lk(m_);
+    return dropped_;
+}
+
+void LogFile::run() {
+    CoroContext ctx(64);
+    // on windows the file is bound to the context of the thread opening it
+    open();
+    {
+        std::lock_guard lk(m_);
+        opened_ = (bool)file_;
+    }
+    opened_cv_.notify_one();
+    if (!file_) {
+        return;
+    }
+
+    ctx.spawn(write_loop());
+    ctx.spawn(tick());
+    ctx.start();
+}
+
+Coro<> LogFile::write_loop() {
+    for (; ;) {
+        event_.reset();
+        bool stopping;
+        {
+            std::lock_guard lk(m_);
+            pending_.swap(writing_);
+            stopping = stopping_;
+        }
+        space_cv_.notify_all();
+
+        if (writing_.size() != 0) {
+            co_await write_out();
+        }
+
+        if (sync_due_ || stopping) {
+            sync_due_ = false;
+            std::error_code ec;
+            co_await file_.sync_data(ec);
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (writing_.size() == 0) {
+            co_await event_.wait();
+        }
+    }
+
+    file_.close();
+    this_context::stop();
+}
+
+Coro<> LogFile::tick() {
+    for (; ;) {
+        co_await this_coro::sleep_for(options_.sync_interval);
+        sync_due_ = true;
+        event_.set();
+    }
+}
+
+Coro<> LogFile::write_out() {
+    bool size_limit = options_.max_size != 0 && size_ != 0 && size_ + writing_.size() > options_.max_size;
+    bool time_limit = options_.rotate_interval.count() != 0 && std::chrono::system_clock::now() >= next_rotate_;
+    if (size_limit || time_limit) {
+        rotate();
+    }
+
+    size_t offset = 0;
+    while (offset < writing_.size()) {
+        std::error_code ec;
+        auto rest = writing_.slice(offset);
+        size_t len = co_await file_.write_at(size_, rest.data(), rest.size(), ec);
+        if (ec || len == 0) {
+            // the logger cannot report its own failure, so it goes to stderr
+            fmt::print(stderr, "cannot write log file {}: {}\n", path_, ec ? ec.message() : "EOF");
+            break;
+        }
+        offset += len;
+        size_ += len;
+    }
+    writing_.clear();
+}
+
+void LogFile::open() {
+    file_.open(path_.c_str(), RandomAccessFile::WriteOnly | RandomAccessFile::Create, 0644);
+    std::error_code ec;
+    size_ = std::filesystem::file_size(path_, ec);
+    if (ec) {
+        size_ = 0;
+    }
+    next_rotate_ = std::chrono::system_clock::now() + options_.rotate_interval;
+}
+
+void LogFile::rotate() {
+    file_.sync_data();
+    file_.close();
+
+    // app.log -> app.log.20240101-120000, a counter is added if it already exists
+    auto tm = fmt::localtime(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+    std::string rotated = fmt::format("{}.{:%Y%m%d-%H%M%S}", path_, tm);
+    std::error_code ec;
+    for (size_t i = 1; std::filesystem::exists(rotated, ec); ++i) {
+        rotated = fmt::format("{}.{:%Y%m%d-%H%M%S}.{}", path_, tm, i);
+    }
+    std::filesystem::rename(path_, rotated, ec);
+    if (ec) {
+        fmt::print(stderr, "cannot rotate log file {}: {}\n", path_, ec.message());
+    }
+
+    open();
+}
+#endif
+
+}
@@ -0,0 +1,96 @@
+#ifndef MAGIO_CORE_LOG_FILE_H_
+#define MAGIO_CORE_LOG_FILE_H_
+
+#include <mutex>
+#include <thread>
+#include <string>
+#include <chrono>
+#include <optional>
+#include <condition_variable>
+
+#include "magio-v3/core/file.h"
+#include "magio-v3/core/event.h"
+#include "magio-v3/core/buffer.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+// Log sink appending to a file from its own thread and context, so writes never block the caller.
+// Lines are aggregated in a buffer until the file thread takes them.
+// Use it through a shared_ptr so it outlives the logger flusher:
+//     auto file = std::make_shared<LogFile>("app.log");
+//     Logger::start_async([file](std::string_view lines) { file->write(lines); });
+class LogFile: Noncopyable {
+public:
+    enum Overflow {
+        // discard lines while the buffer is full
+        Drop,
+        // wait until the file thread takes the buffer
+        Block
+    };
+
+    struct Options {
+        // rotate once the file would grow beyond it, 0 disables
+        size_t max_size = 64 * 1024 * 1024;
+        // rotate at least every interval, 0 disables
+        std::chrono::seconds rotate_interval{0};
+        // fdatasync at most every interval
+        std::chrono::milliseconds sync_interval{1000};
+        size_t buffer_limit = 4 * 1024 * 1024;
+        Overflow overflow = Block;
+    };
+
+    LogFile(std::string path);
+
+    LogFile(std::string path, Options options);
+
+    // Writes out the rest of the buffer, then stops the file thread
+    ~LogFile();
+
+    void write(std::string_view lines);
+
+    // the number of bytes discarded by the Drop policy
+    size_t dropped();
+
+private:
+    void run();
+
+    Coro<> write_loop();
+
+    Coro<> tick();
+
+    Coro<> write_out();
+
+    // open and rotate run on the file thread only
+    void open();
+
+    void rotate();
+
+    std::string path_;
+    Options options_;
+
+    std::mutex m_;
+    std::condition_variable space_cv_;
+    Buffer<> pending_;
+    size_t dropped_ = 0;
+    bool stopping_ = false;
+    // set by the file thread once it has tried to open the file
+    std::optional<bool> opened_;
+    std::condition_variable opened_cv_;
+    // set when pending_ has data or the file thread has to stop
+    detail::Event event_;
+
+    // only touched by the file thread
+    Buffer<> writing_;
+    RandomAccessFile file_;
+    size_t size_ = 0;
+    bool sync_due_ = false;
+    std::chrono::system_clock::time_point next_rotate_;
+
+    std::thread thread_;
+};
+#endif
+
+}
+
+#endif
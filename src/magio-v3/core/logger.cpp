@@ -0,0 +1,220 @@
+#include "magio-v3/core/logger.h"
+
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+
+namespace magio {
+
+namespace {
+
+struct AsyncLogState {
+    ~AsyncLogState() {
+        Logger::stop_async();
+    }
+
+    std::mutex m;
+    // wakes the flusher
+    std::condition_variable cv;
+    std::condition_variable flushed_cv;
+    std::vector<std::shared_ptr<detail::LogRing>> rings;
+    std::thread flusher;
+    bool stopping = false;
+    bool urgent = false;
+    size_t flush_requests = 0;
+    size_t flushed = 0;
+    // drain passes done by the flusher, for writers waiting for room
+    size_t passes = 0;
+    std::chrono::milliseconds interval;
+
+    // the flusher and oversized records both write to the sink
+    std::mutex sink_m;
+    std::function<void(std::string_view)> sink;
+};
+
+AsyncLogState& async_state() {
+    static AsyncLogState state;
+    return state;
+}
+
+// the flusher cannot wait for itself
+thread_local bool OnFlusher = false;
+
+}
+
+namespace detail {
+
+std::shared_ptr<LogRing> register_log_ring() {
+    auto ring = std::make_shared<LogRing>(CurrentThread::get_id());
+    auto& state = async_state();
+    std::lock_guard lk(state.m);
+    state.rings.push_back(ring);
+    return ring;
+}
+
+}
+
+void Logger::start_async(std::function<void(std::string_view)> sink, std::chrono::milliseconds flush_interval) {
+    // constructed after the logger, so destroyed and stopped before it
+    ins();
+    auto& state = async_state();
+    std::lock_guard lk(state.m);
+    if (state.flusher.joinable()) {
+        return;
+    }
+
+    state.sink = sink ? std::move(sink) : default_sink;
+    state.interval = flush_interval;
+    state.flusher = std::thread(&Logger::flush_loop);
+    ins().async_.store(true, std::memory_order_release);
+}
+
+void Logger::stop_async() {
+    if (!ins().async_.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    auto& state = async_state();
+    {
+        std::lock_guard lk(state.m);
+        state.stopping = true;
+    }
+    state.cv.notify_one();
+    state.flusher.join();
+    state.stopping = false;
+    // the sink may own resources like a LogFile
+    state.sink = nullptr;
+}
+
+void Logger::flush() {
+    if (!ins().async_.load(std::memory_order_acquire) || OnFlusher) {
+        return;
+    }
+
+    auto& state = async_state();
+    std::unique_lock lk(state.m);
+    size_t request = ++state.flush_requests;
+    state.cv.notify_one();
+    state.flushed_cv.wait(lk, [&] {
+        return state.flushed >= request;
+    });
+}
+
+bool Logger::flush_for(std::chrono::milliseconds timeout) {
+    if (OnFlusher) {
+        return false;
+    }
+    if (!ins().async_.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    auto& state = async_state();
+    std::unique_lock lk(state.m);
+    size_t request = ++state.flush_requests;
+    state.cv.notify_one();
+    return state.flushed_cv.wait_for(lk, timeout, [&] {
+        return state.flushed >= request;
+    });
+}
+
+bool Logger::wait_for_ring() {
+    if (OnFlusher) {
+        return false;
+    }
+
+    auto& state = async_state();
+    std::unique_lock lk(state.m);
+    if (!ins().async_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    size_t pass = state.passes;
+    state.urgent = true;
+    state.cv.notify_one();
+    // the last pass of stop_async counts as well
+    state.flushed_cv.wait(lk, [&] {
+        return state.passes != pass;
+    });
+    return true;
+}
+
+void Logger::write_oversized(const detail::LogSite& site, fmt::string_view fmt, fmt::format_args args) {
+    if (OnFlusher) {
+        // logged from the sink, which already holds sink_m
+        return;
+    }
+
+    fmt::memory_buffer out;
+    append_prefix([&](std::string_view str) {
+        out.append(str.data(), str.data() + str.size());
+    }, site, CurrentThread::get_id(), std::chrono::system_clock::now(), local_time);
+    fmt::vformat_to(std::back_inserter(out), fmt, args);
+    out.push_back('\n');
+
+    // keep the order with what is already in the ring
+    flush();
+    auto& state = async_state();
+    std::lock_guard lk(state.sink_m);
+    state.sink({out.data(), out.size()});
+}
+
+bool Logger::drain(detail::LogRing& ring, fmt::memory_buffer& out, detail::LogTimeCache& time_cache) {
+    return ring.consume([&](const detail::LogRecord& record) {
+        append_prefix([&](std::string_view str) {
+            out.append(str.data(), str.data() + str.size());
+        }, *record.site, ring.thread_id(), record.time, time_cache);
+
+        if (record.format) {
+            record.format(record.payload(), out, record.fmt);
+        } else {
+            out.append(record.payload(), record.payload() + record.payload_size);
+        }
+        out.push_back('\n');
+    });
+}
+
+void Logger::flush_loop() {
+    auto& state = async_state();
+    fmt::memory_buffer out;
+    detail::LogTimeCache time_cache;
+    std::vector<std::shared_ptr<detail::LogRing>> rings;
+    OnFlusher = true;
+
+    std::unique_lock lk(state.m);
+    for (; ;) {
+        bool stopping = state.stopping;
+        size_t request = state.flush_requests;
+        rings = state.rings;
+        lk.unlock();
+
+        for (auto& ring : rings) {
+            drain(*ring, out, time_cache);
+        }
+        if (out.size() != 0) {
+            std::lock_guard sink_lk(state.sink_m);
+            state.sink({out.data(), out.size()});
+            out.clear();
+        }
+
+        lk.lock();
+        // rings of exited threads, once their last records are written
+        std::erase_if(state.rings, [](auto& ring) {
+            return ring->abandoned() && ring->empty();
+        });
+        rings.clear();
+
+        // requests made while stopping are not waited for
+        state.flushed = stopping ? state.flush_requests : request;
+        ++state.passes;
+        state.flushed_cv.notify_all();
+        if (stopping) {
+            break;
+        }
+
+        state.cv.wait_for(lk, state.interval, [&] {
+            return state.stopping || state.urgent || state.flush_requests != request;
+        });
+        state.urgent = false;
+    }
+}
+
+}
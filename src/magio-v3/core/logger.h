@@ -1,10 +1,17 @@
 #ifndef MAGIO_CORE_LOGGER_H_
 #define MAGIO_CORE_LOGGER_H_
 
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
 #include "magio-v3/core/buffer.h"
+#include "magio-v3/core/noncopyable.h"
 #include "magio-v3/core/current_thread.h"
 
 #include "fmt/chrono.h"
+#include "fmt/format.h"
 
 namespace magio {
 
@@ -18,6 +25,313 @@ enum class LogLevel {
     Off
 };
 
+namespace detail {
+
+// Formatting the date is expensive, it is done once per second
+class LogTimeCache {
+public:
+    void update(std::chrono::system_clock::time_point tp) {
+        auto sec = std::chrono::system_clock::to_time_t(tp);
+        if (sec == sec_) {
+            return;
+        }
+
+        sec_ = sec;
+        auto tm = fmt::localtime(sec);
+        fmt::format_to_n(date_, sizeof(date_), "{:%Y-%m-%d} ", tm);
+        fmt::format_to_n(time_, sizeof(time_), "{:%H:%M:%S} ", tm);
+    }
+
+    std::string_view date() const {
+        return {date_, sizeof(date_)};
+    }
+
+    std::string_view time() const {
+        return {time_, sizeof(time_)};
+    }
+
+private:
+    std::time_t sec_ = -1;
+    char date_[11];
+    char time_[9];
+};
+
+// "f:<file> l:<line> " of a log call, rendered at compile time
+template<size_t N>
+struct LogSiteText {
+    char data[N + 16] = {};
+    size_t file_end = 0;
+    size_t end = 0;
+};
+
+template<size_t N>
+consteval LogSiteText<N> render_log_site(const char(& file)[N], int line) {
+    LogSiteText<N> text;
+    size_t pos = 0;
+    auto put = [&](char c) {
+        text.data[pos++] = c;
+    };
+
+    put('f');
+    put(':');
+    for (size_t i = 0; i + 1 < N; ++i) {
+        put(file[i]);
+    }
+    put(' ');
+    text.file_end = pos;
+
+    char digits[12];
+    size_t num = 0;
+    do {
+        digits[num++] = '0' + line % 10;
+        line /= 10;
+    } while (line);
+    put('l');
+    put(':');
+    while (num) {
+        put(digits[--num]);
+    }
+    put(' ');
+    text.end = pos;
+    return text;
+}
+
+constexpr std::string_view level_name(LogLevel level) {
+    switch (level) {
+    case LogLevel::Trace:
+        return "trace ";
+    case LogLevel::Debug:
+        return "debug ";
+    case LogLevel::Info:
+        return "info ";
+    case LogLevel::Warn:
+        return "warn ";
+    case LogLevel::Error:
+        return "error ";
+    case LogLevel::Fatal:
+        return "fatal ";
+    default:
+        return "";
+    }
+}
+
+// Everything about a log call known at compile time, one static instance per call
+struct LogSite {
+    LogLevel level;
+    std::string_view level_part;
+    // file_part and line_part are adjacent
+    std::string_view file_part;
+    std::string_view line_part;
+};
+
+// How an argument is copied into a log record and read back on the flusher thread.
+// Only values that do not refer to the caller's memory are copied as they are,
+// the record of any other argument is formatted on the caller thread.
+template<typename T>
+struct LogArg {
+    static constexpr bool kSerializable = 
+        std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_same_v<T, const void*> || std::is_same_v<T, void*>;
+
+    static size_t size(const T&) {
+        return sizeof(T);
+    }
+
+    static char* encode(char* p, const T& val) {
+        std::memcpy(p, &val, sizeof(T));
+        return p + sizeof(T);
+    }
+
+    static T decode(const char*& p) {
+        T val;
+        std::memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+};
+
+template<typename Rep, typename Per>
+struct LogArg<std::chrono::duration<Rep, Per>> {
+    static constexpr bool kSerializable = LogArg<Rep>::kSerializable;
+
+    static size_t size(const std::chrono::duration<Rep, Per>& dur) {
+        return LogArg<Rep>::size(dur.count());
+    }
+
+    static char* encode(char* p, const std::chrono::duration<Rep, Per>& dur) {
+        return LogArg<Rep>::encode(p, dur.count());
+    }
+
+    static std::chrono::duration<Rep, Per> decode(const char*& p) {
+        return std::chrono::duration<Rep, Per>(LogArg<Rep>::decode(p));
+    }
+};
+
+struct LogStringArg {
+    static constexpr bool kSerializable = true;
+
+    static size_t size(std::string_view str) {
+        return sizeof(size_t) + str.size();
+    }
+
+    static char* encode(char* p, std::string_view str) {
+        size_t len = str.size();
+        std::memcpy(p, &len, sizeof(len));
+        std::memcpy(p + sizeof(len), str.data(), len);
+        return p + sizeof(len) + len;
+    }
+
+    static std::string_view decode(const char*& p) {
+        size_t len;
+        std::memcpy(&len, p, sizeof(len));
+        std::string_view str(p + sizeof(len), len);
+        p += sizeof(len) + len;
+        return str;
+    }
+};
+
+template<>
+struct LogArg<std::string>: LogStringArg { };
+
+template<>
+struct LogArg<std::string_view>: LogStringArg { };
+
+template<>
+struct LogArg<const char*>: LogStringArg { 
+    static size_t size(const char* str) {
+        return LogStringArg::size(str ? str : "");
+    }
+
+    static char* encode(char* p, const char* str) {
+        return LogStringArg::encode(p, str ? str : "");
+    }
+};
+
+template<>
+struct LogArg<char*>: LogArg<const char*> { };
+
+struct LogRecord {
+    static constexpr uint32_t kPadding = -1;
+
+    // of the whole record, aligned to 8
+    uint32_t size;
+    // kPadding marks the space left at the end of the ring
+    uint32_t payload_size;
+    const LogSite* site;
+    // nullptr if the payload is the formatted message
+    void(* format)(const char* payload, fmt::memory_buffer& out, fmt::string_view fmt);
+    fmt::string_view fmt;
+    std::chrono::system_clock::time_point time;
+
+    const char* payload() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+};
+
+template<typename...T>
+inline void format_log_record(const char* payload, fmt::memory_buffer& out, fmt::string_view fmt) {
+    // braced initialization decodes the arguments in order
+    std::tuple<decltype(LogArg<std::decay_t<T>>::decode(payload))...> args{LogArg<std::decay_t<T>>::decode(payload)...};
+    std::apply([&](auto&...args) {
+        fmt::vformat_to(std::back_inserter(out), fmt, fmt::make_format_args(args...));
+    }, args);
+}
+
+// Single producer single consumer ring of log records, one per logging thread
+class LogRing: Noncopyable {
+public:
+    static constexpr size_t kCapacity = 1 << 20;
+
+    LogRing(size_t thread_id)
+        : thread_id_(thread_id), buf_(new char[kCapacity])
+    { }
+
+    // Returns the space of a record of size bytes or nullptr if the ring is full
+    char* reserve(size_t size) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t pos = tail & (kCapacity - 1);
+        size_t contiguous = kCapacity - pos;
+        size_t need = size <= contiguous ? size : size + contiguous;
+        if (kCapacity - (tail - head_.load(std::memory_order_acquire)) < need) {
+            return nullptr;
+        }
+
+        if (size > contiguous) {
+            auto pad = reinterpret_cast<LogRecord*>(buf_.get() + pos);
+            pad->size = contiguous;
+            pad->payload_size = LogRecord::kPadding;
+            tail_.store(tail + contiguous, std::memory_order_release);
+            pos = 0;
+        }
+        return buf_.get() + pos;
+    }
+
+    void commit(size_t size) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    template<typename Func>
+    bool consume(Func&& func) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+
+        while (head != tail) {
+            auto record = reinterpret_cast<const LogRecord*>(buf_.get() + (head & (kCapacity - 1)));
+            if (record->payload_size != LogRecord::kPadding) {
+                func(*record);
+            }
+            head += record->size;
+        }
+        head_.store(head, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t thread_id() const {
+        return thread_id_;
+    }
+
+    // Called by the owning thread as it exits, after its last record
+    void abandon() {
+        abandoned_.store(true, std::memory_order_release);
+    }
+
+    bool abandoned() const {
+        return abandoned_.load(std::memory_order_acquire);
+    }
+
+private:
+    size_t thread_id_;
+    std::unique_ptr<char[]> buf_;
+    std::atomic<bool> abandoned_{false};
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// Creates the ring of the calling thread and hands it to the flusher
+std::shared_ptr<LogRing> register_log_ring();
+
+// The ring of the calling thread, abandoned when the thread exits
+struct LocalLogRing {
+    std::shared_ptr<LogRing> ring = register_log_ring();
+
+    ~LocalLogRing() {
+        ring->abandon();
+    }
+};
+
+inline LogRing& local_log_ring() {
+    thread_local LocalLogRing local;
+    return *local.ring;
+}
+
+}
+
 class Logger {
     Logger() = default;
 
@@ -40,97 +354,172 @@ public:
     }
 
     static void set_level(LogLevel level) {
-        ins().level_ = level;
+        level_.store((int)level, std::memory_order_relaxed);
     }
 
     static void set_pattern(LogPattern pattern) {
-        ins().pattern_= pattern;
+        pattern_.store(pattern, std::memory_order_relaxed);
     }
 
+    // Checked by the log macros before the arguments are evaluated
+    static bool enabled(LogLevel level) {
+        return (int)level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Formatting and output move to a background thread, which writes the lines in batches to sink.
+    // The output set by set_output is not used until stop_async.
+    static void start_async(std::function<void(std::string_view)> sink = default_sink, 
+                            std::chrono::milliseconds flush_interval = std::chrono::milliseconds(10));
+
+    // Writes out everything logged so far and joins the background thread
+    static void stop_async();
+
+    // Blocks until everything logged so far is written out, does nothing on the flusher thread
+    static void flush();
+
+    // Like flush, but gives up after timeout. Returns whether everything was written out
+    static bool flush_for(std::chrono::milliseconds timeout);
+
     template <typename... T>
-    static void write(const char* file, int line, LogLevel level, fmt::format_string<T...> fmt, T&&... args) {
-        if ((int)ins().level_ > (int)level) {
+    static void write(const detail::LogSite& site, fmt::format_string<T...> fmt, T&&... args) {
+        if (ins().async_.load(std::memory_order_acquire)) {
+            push_record<T...>(site, fmt, args...);
             return;
         }
 
-        build_fmt_str(file, line, level, fmt);
+        build_fmt_str(site, fmt);
         ins().output_fn_(local_fmt.slice(), fmt::make_format_args(args...));
     }
 
     template <typename... T>
-    static void console_write(const char* file, int line, LogLevel level, fmt::format_string<T...> fmt, T&&... args) {
-        if ((int)ins().level_ > (int)level) {
+    static void console_write(const detail::LogSite& site, fmt::format_string<T...> fmt, T&&... args) {
+        if (!enabled(site.level)) {
             return;
         }
 
-        build_fmt_str(file, line, level, fmt);
+        // bounded, the flusher may be stuck in a sink waiting for this very thread
+        flush_for(kConsoleFlushTimeout);
+        build_fmt_str(site, fmt);
         fmt::vprint(local_fmt.slice(), fmt::make_format_args(args...));
+        // M_FATAL terminates right after, which does not flush stdout
+        std::fflush(stdout);
     }
 
     static void default_output(std::string_view fmt, fmt::format_args args) {
         fmt::vprint(fmt, args);
     }
 
+    static void default_sink(std::string_view lines) {
+        std::fwrite(lines.data(), 1, lines.size(), stdout);
+        std::fflush(stdout);
+    }
+
 private:
-    static void build_fmt_str(const char* file, int line, LogLevel level, fmt::string_view fmt) {
-        local_fmt.clear();
-        
-        if (ins().pattern_ & Level) {
-            switch (level) {
-            case LogLevel::Trace:
-                local_fmt.append("trace ");
-                break;
-            case LogLevel::Debug:
-                local_fmt.append("debug ");
-                break;
-            case LogLevel::Info:
-                local_fmt.append("info ");
-                break;
-            case LogLevel::Warn:
-                local_fmt.append("warn ");
-                break;
-            case LogLevel::Error:
-                local_fmt.append("error ");
-                break;
-            case LogLevel::Fatal:
-                local_fmt.append("fatal ");
-                break;
-            default:
-                break;
-            }
-        }
+    template <typename... T>
+    static void push_record(const detail::LogSite& site, fmt::string_view fmt, T&... args) {
+        constexpr bool serializable = (detail::LogArg<std::decay_t<T>>::kSerializable && ...);
 
-        auto date_n_time = fmt::localtime(std::chrono::system_clock::now());
-        if (ins().pattern_ & Date) {
-            local_fmt.append_format("{:%Y-%m-%d} ", fmt::make_format_args(date_n_time));
+        std::string_view formatted;
+        size_t payload_size = 0;
+        if constexpr (serializable) {
+            payload_size = (detail::LogArg<std::decay_t<T>>::size(args) + ... + 0);
+        } else {
+            local_record.clear();
+            fmt::vformat_to(std::back_inserter(local_record), fmt, fmt::make_format_args(args...));
+            formatted = {local_record.data(), local_record.size()};
+            payload_size = formatted.size();
         }
 
-        if (ins().pattern_ & Time) {
-            local_fmt.append_format("{:%H:%M:%S} ", fmt::make_format_args(date_n_time));
+        size_t size = (sizeof(detail::LogRecord) + payload_size + 7) & ~size_t(7);
+        if (size > detail::LogRing::kCapacity / 4) {
+            // too large for the ring, written out directly
+            write_oversized(site, fmt, fmt::make_format_args(args...));
+            return;
         }
 
-        if (ins().pattern_ & File) {
-            local_fmt.append("f:");
-            local_fmt.append(file);
-            local_fmt.append(" ");
+        auto& ring = detail::local_log_ring();
+        char* p;
+        while (!(p = ring.reserve(size))) {
+            if (!wait_for_ring()) {
+                // nobody is left to make room
+                return;
+            }
         }
 
-        if (ins().pattern_ & Line) {
-            local_fmt.append("l:");
-            local_fmt.append(std::to_string(line));
-            local_fmt.append(" ");
-        }
+        auto record = new (p) detail::LogRecord{
+            .size = (uint32_t)size,
+            .payload_size = (uint32_t)payload_size,
+            .site = &site,
+            .format = nullptr,
+            .fmt = fmt,
+            .time = std::chrono::system_clock::now()
+        };
+        p += sizeof(detail::LogRecord);
 
-        if (ins().pattern_ & ThreadId) {
-            local_fmt.append("id:");
-            local_fmt.append(std::to_string(CurrentThread::get_id()));
-            local_fmt.append(" ");
+        if constexpr (serializable) {
+            record->format = &detail::format_log_record<T...>;
+            ((p = detail::LogArg<std::decay_t<T>>::encode(p, args)), ...);
+        } else {
+            std::memcpy(p, formatted.data(), formatted.size());
         }
+        ring.commit(size);
+    }
+
+    // Wakes the flusher and waits until it has drained the rings once.
+    // Returns false without waiting on the flusher thread itself or once the flusher is stopped
+    static bool wait_for_ring();
+
+    static void write_oversized(const detail::LogSite& site, fmt::string_view fmt, fmt::format_args args);
 
+    // Appends the formatted records of ring to out
+    static bool drain(detail::LogRing& ring, fmt::memory_buffer& out, detail::LogTimeCache& time_cache);
+
+    static void flush_loop();
+
+    static void build_fmt_str(const detail::LogSite& site, fmt::string_view fmt) {
+        local_fmt.clear();
+        append_prefix([](std::string_view str) {
+            local_fmt.append(str);
+        }, site, CurrentThread::get_id(), std::chrono::system_clock::now(), local_time);
         local_fmt.append({fmt.data(), fmt.size()});
         local_fmt.append("\n");
     }
 
+    template<typename Append>
+    static void append_prefix(Append&& append, const detail::LogSite& site, size_t thread_id,
+                              std::chrono::system_clock::time_point time, detail::LogTimeCache& time_cache) {
+        int pattern = pattern_.load(std::memory_order_relaxed);
+        if (pattern & Level) {
+            append(site.level_part);
+        }
+
+        if (pattern & (Date | Time)) {
+            time_cache.update(time);
+            if (pattern & Date) {
+                append(time_cache.date());
+            }
+
+            if (pattern & Time) {
+                append(time_cache.time());
+            }
+        }
+
+        if ((pattern & (File | Line)) == (File | Line)) {
+            append({site.file_part.data(), site.file_part.size() + site.line_part.size()});
+        } else if (pattern & File) {
+            append(site.file_part);
+        } else if (pattern & Line) {
+            append(site.line_part);
+        }
+
+        if (pattern & ThreadId) {
+            fmt::format_int str(thread_id);
+            append("id:");
+            append({str.data(), str.size()});
+            append(" ");
+        }
+    }
+
     static Logger& ins() {
         static Logger logger;
         return logger;
@@ -138,26 +527,53 @@ private:
 
     inline static thread_local detail::FormatBuffer local_fmt;
     inline static thread_local detail::SmallBuffer local_buffer;
+    inline static thread_local detail::LogTimeCache local_time;
+    inline static thread_local std::string local_record;
     
-    LogLevel level_ = LogLevel::Debug;
-    int pattern_ = Level | Date | Time | File | Line | ThreadId;
+    // how long errors wait for the lines logged before them
+    static constexpr std::chrono::milliseconds kConsoleFlushTimeout{1000};
+
+    inline static std::atomic<int> level_{(int)LogLevel::Debug};
+    inline static std::atomic<int> pattern_{Level | Date | Time | File | Line | ThreadId};
+
     void(* output_fn_)(std::string_view, fmt::format_args) = default_output;
+    std::atomic<bool> async_{false};
 };
 
-#define M_TRACE(FMT, ...) \
-    do { ::magio::Logger::write(__FILE__, __LINE__, ::magio::LogLevel::Trace, FMT, __VA_ARGS__); } while(0)
-#define M_DEBUG(FMT, ...) \
-    do { ::magio::Logger::write(__FILE__, __LINE__, ::magio::LogLevel::Debug, FMT, __VA_ARGS__); } while(0)
-#define M_INFO(FMT, ...) \
-    do { ::magio::Logger::write(__FILE__, __LINE__, ::magio::LogLevel::Info, FMT, __VA_ARGS__); } while(0)
-#define M_WARN(FMT, ...) \
-    do { ::magio::Logger::write(__FILE__, __LINE__, ::magio::LogLevel::Warn, FMT, __VA_ARGS__); } while(0)
-#define M_ERROR(FMT, ...) \
-    do { ::magio::Logger::write(__FILE__, __LINE__, ::magio::LogLevel::Error, FMT, __VA_ARGS__); } while(0)
+// Log calls below this level are compiled out, the value is a LogLevel
+#ifndef MAGIO_LOG_LEVEL
+#define MAGIO_LOG_LEVEL 0
+#endif
+
+#define MAGIO_LOG_SITE(LEVEL) \
+    static constexpr auto magio_log_text = ::magio::detail::render_log_site(__FILE__, __LINE__); \
+    static constexpr ::magio::detail::LogSite magio_log_site{ \
+        LEVEL, \
+        ::magio::detail::level_name(LEVEL), \
+        {magio_log_text.data, magio_log_text.file_end}, \
+        {magio_log_text.data + magio_log_text.file_end, magio_log_text.end - magio_log_text.file_end} \
+    }
+
+// The arguments are only evaluated when the level is enabled
+#define MAGIO_LOG(LEVEL, FMT, ...) \
+    do { \
+        if constexpr ((int)LEVEL >= MAGIO_LOG_LEVEL) { \
+            if (::magio::Logger::enabled(LEVEL)) { \
+                MAGIO_LOG_SITE(LEVEL); \
+                ::magio::Logger::write(magio_log_site, FMT, __VA_ARGS__); \
+            } \
+        } \
+    } while(0)
+
+#define M_TRACE(FMT, ...) MAGIO_LOG(::magio::LogLevel::Trace, FMT, __VA_ARGS__)
+#define M_DEBUG(FMT, ...) MAGIO_LOG(::magio::LogLevel::Debug, FMT, __VA_ARGS__)
+#define M_INFO(FMT, ...) MAGIO_LOG(::magio::LogLevel::Info, FMT, __VA_ARGS__)
+#define M_WARN(FMT, ...) MAGIO_LOG(::magio::LogLevel::Warn, FMT, __VA_ARGS__)
+#define M_ERROR(FMT, ...) MAGIO_LOG(::magio::LogLevel::Error, FMT, __VA_ARGS__)
 #define M_FATAL(FMT, ...) \
-    do { ::magio::Logger::console_write(__FILE__, __LINE__, ::magio::LogLevel::Fatal, FMT, __VA_ARGS__); std::terminate(); } while(0)
+    do { MAGIO_LOG_SITE(::magio::LogLevel::Fatal); ::magio::Logger::console_write(magio_log_site, FMT, __VA_ARGS__); std::terminate(); } while(0)
 #define M_SYS_ERROR(FMT, ...) \
-    do { ::magio::Logger::console_write(__FILE__, __LINE__, ::magio::LogLevel::Error, FMT, __VA_ARGS__); } while(0)
+    do { MAGIO_LOG_SITE(::magio::LogLevel::Error); ::magio::Logger::console_write(magio_log_site, FMT, __VA_ARGS__); } while(0)
 }
 
 #endif
\ No newline at end of file
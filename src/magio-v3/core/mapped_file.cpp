@@ -0,0 +1,251 @@
+#include "magio-v3/core/mapped_file.h"
+
+#include <algorithm>
+
+#include "magio-v3/core/error.h"
+#include "magio-v3/core/coro_context.h"
+#include "magio-v3/core/io_context.h"
+
+#ifdef _WIN32
+
+#elif defined (__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace magio {
+
+namespace {
+
+constexpr size_t kPrefetchChunk = 1024 * 1024;
+
+size_t page_size() {
+#ifdef _WIN32
+    static const size_t size = [] {
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return (size_t)info.dwPageSize;
+    }();
+#elif defined (__linux__)
+    static const size_t size = (size_t)::sysconf(_SC_PAGESIZE);
+#endif
+    return size;
+}
+
+#ifdef __linux__
+int to_madvise(MappedFile::Advice advice) {
+    switch (advice) {
+    case MappedFile::Sequential:
+        return MADV_SEQUENTIAL;
+    case MappedFile::Random:
+        return MADV_RANDOM;
+    case MappedFile::WillNeed:
+        return MADV_WILLNEED;
+    case MappedFile::DontNeed:
+        return MADV_DONTNEED;
+    case MappedFile::HugePage:
+        return MADV_HUGEPAGE;
+    default:
+        return MADV_NORMAL;
+    }
+}
+#endif
+
+}
+
+MappedFile::MappedFile() {
+    reset();
+}
+
+MappedFile::MappedFile(const char* path, std::error_code& ec)
+    : MappedFile()
+{
+    open(path, ec);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : addr_(other.addr_)
+    , size_(other.size_)
+#ifdef _WIN32
+    , mapping_(other.mapping_)
+#endif
+{
+    other.reset();
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        addr_ = other.addr_;
+        size_ = other.size_;
+#ifdef _WIN32
+        mapping_ = other.mapping_;
+#endif
+        other.reset();
+    }
+    return *this;
+}
+
+void MappedFile::open(const char* path, std::error_code& ec) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        ec = SYSTEM_ERROR_CODE;
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size)) {
+        ec = SYSTEM_ERROR_CODE;
+        ::CloseHandle(file);
+        return;
+    }
+    if (size.QuadPart == 0) {
+        // an empty file cannot be mapped, it is an empty view
+        ::CloseHandle(file);
+        return;
+    }
+    HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (!mapping) {
+        ec = SYSTEM_ERROR_CODE;
+        return;
+    }
+    void* addr = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!addr) {
+        ec = SYSTEM_ERROR_CODE;
+        ::CloseHandle(mapping);
+        return;
+    }
+    mapping_ = mapping;
+    addr_ = (const std::byte*)addr;
+    size_ = (size_t)size.QuadPart;
+#elif defined (__linux__)
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ec = SYSTEM_ERROR_CODE;
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        ec = SYSTEM_ERROR_CODE;
+        ::close(fd);
+        return;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+    void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file alive
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        ec = SYSTEM_ERROR_CODE;
+        return;
+    }
+    addr_ = (const std::byte*)addr;
+    size_ = (size_t)st.st_size;
+#endif
+}
+
+void MappedFile::close() {
+    if (!addr_) {
+        return;
+    }
+#ifdef _WIN32
+    ::UnmapViewOfFile(addr_);
+    ::CloseHandle(mapping_);
+#elif defined (__linux__)
+    ::munmap((void*)addr_, size_);
+#endif
+    reset();
+}
+
+std::span<const std::byte> MappedFile::view(size_t offset, size_t len) const {
+    offset = std::min(offset, size_);
+    return {addr_ + offset, std::min(len, size_ - offset)};
+}
+
+void MappedFile::advise(size_t offset, size_t len, Advice advice, std::error_code& ec) {
+    auto range = page_range(offset, len);
+    if (range.empty()) {
+        return;
+    }
+#ifdef _WIN32
+    // only the readahead hint has a counterpart
+    if (advice == WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY entry{(void*)range.data(), range.size()};
+        if (!::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &entry, 0)) {
+            ec = SYSTEM_ERROR_CODE;
+        }
+    }
+#elif defined (__linux__)
+    if (::madvise((void*)range.data(), range.size(), to_madvise(advice)) == -1) {
+        ec = SYSTEM_ERROR_CODE;
+    }
+#endif
+}
+
+#ifdef MAGIO_USE_CORO
+Coro<> MappedFile::prefetch(size_t offset, size_t len, std::error_code& ec) {
+#ifdef _WIN32
+    // PrefetchVirtualMemory only queues the reads
+    advise(offset, len, WillNeed, ec);
+    co_return;
+#elif defined (__linux__)
+    auto range = page_range(offset, len);
+    // the kernel reads at most one readahead window per call, typically 128KB to a few MB,
+    // so a large range is advised in chunks
+    for (size_t pos = 0; pos < range.size(); pos += kPrefetchChunk) {
+        auto chunk = range.subspan(pos, std::min(kPrefetchChunk, range.size() - pos));
+        ResumeHandle rhandle;
+        IoContext ioc{
+            .handle = -1,
+            .buf = io_buf((char*)chunk.data(), chunk.size()),
+            .ptr = &rhandle,
+            .cb = completion_callback
+        };
+
+        co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+            rhandle.handle = h;
+            this_context::get_service().advise_memory(ioc, MADV_WILLNEED);
+        });
+
+        if (rhandle.ec) {
+            ec = rhandle.ec;
+            co_return;
+        }
+    }
+#endif
+}
+#endif
+
+std::span<const std::byte> MappedFile::page_range(size_t offset, size_t len) const {
+    auto v = view(offset, len);
+    if (v.empty()) {
+        return {};
+    }
+    size_t page = page_size();
+    size_t begin = v.data() - addr_;
+    size_t first = begin / page * page;
+    // the mapping covers the whole last page, so rounding up stays inside it
+    size_t last = (begin + v.size() + page - 1) / page * page;
+    return {addr_ + first, last - first};
+}
+
+void MappedFile::reset() {
+    addr_ = nullptr;
+    size_ = 0;
+#ifdef _WIN32
+    mapping_ = nullptr;
+#endif
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef MAGIO_CORE_MAPPED_FILE_H_
+#define MAGIO_CORE_MAPPED_FILE_H_
+
+#include <span>
+#include <cstddef>
+#include <system_error>
+
+#include "magio-v3/core/noncopyable.h"
+
+namespace magio {
+
+template<typename>
+class Coro;
+
+// A whole file mapped read only, reads are views into the page cache instead of copies.
+// Touching a page that is not resident faults on the thread that touches it,
+// so prefetch the ranges about to be read from a context
+class MappedFile: Noncopyable {
+public:
+    enum Advice {
+        Normal,
+        // aggressive readahead, pages behind the reader are dropped early
+        Sequential,
+        // no readahead
+        Random,
+        // start reading the range in
+        WillNeed,
+        // the range can be dropped from memory
+        DontNeed,
+        // back the range with huge pages where the filesystem supports it
+        HugePage
+    };
+
+    MappedFile();
+
+    MappedFile(const char* path, std::error_code& ec);
+
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Maps the file as it is now, later growth is not visible
+    void open(const char* path, std::error_code& ec);
+
+    void close();
+
+    std::span<const std::byte> data() const {
+        return {addr_, size_};
+    }
+
+    // The range clamped to the end of the file
+    std::span<const std::byte> view(size_t offset, size_t len) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    // The range is widened to whole pages
+    void advise(size_t offset, size_t len, Advice advice, std::error_code& ec);
+
+    void advise(Advice advice, std::error_code& ec) {
+        advise(0, size_, advice, ec);
+    }
+
+#ifdef MAGIO_USE_CORO
+    // Starts reading the range into the page cache from the io service rather than the context thread,
+    // completes once the readahead is queued, not once it is done
+    [[nodiscard]]
+    Coro<void> prefetch(size_t offset, size_t len, std::error_code& ec);
+#endif
+
+    operator bool() const {
+        return addr_ != nullptr;
+    }
+
+private:
+    // page aligned range covering [offset, offset + len) within the mapping
+    std::span<const std::byte> page_range(size_t offset, size_t len) const;
+
+    void reset();
+
+    const std::byte* addr_;
+    size_t size_;
+#ifdef _WIN32
+    void* mapping_;
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "magio-v3/core/metrics.h"
+
+#include <algorithm>
+
+#include "magio-v3/core/logger.h"
+
+namespace magio {
+
+namespace metrics {
+
+namespace {
+
+struct CounterField {
+    const char* name;
+    const char* help;
+    const Counter ContextMetrics::* member;
+    // nanosecond counters are exported in seconds
+    double scale;
+};
+
+struct GaugeField {
+    const char* name;
+    const char* help;
+    const Gauge ContextMetrics::* member;
+};
+
+struct HistogramField {
+    const char* name;
+    const char* help;
+    const Histogram ContextMetrics::* member;
+};
+
+struct AllocField {
+    const char* name;
+    const char* help;
+    const Counter (ContextMetrics::* counters)[kAllocCategories];
+    const Gauge (ContextMetrics::* gauges)[kAllocCategories];
+};
+
+const CounterField kCounterFields[] = {
+    {"magio_loop_iterations_total", "Event loop iterations", &ContextMetrics::loop_iterations, 1},
+    {"magio_resumed_total", "Coroutines resumed from the run queue", &ContextMetrics::resumed, 1},
+    {"magio_timers_fired_total", "Expired timers run", &ContextMetrics::timers_fired, 1},
+    {"magio_remote_wakeups_total", "Coroutines queued from other threads", &ContextMetrics::remote_wakeups, 1},
+    {"magio_resume_seconds_total", "Time spent resuming coroutines", &ContextMetrics::resume_ns, 1e-9},
+    {"magio_timer_seconds_total", "Time spent running timers", &ContextMetrics::timer_ns, 1e-9},
+    {"magio_poll_seconds_total", "Time spent polling the io service, blocked or not", &ContextMetrics::poll_ns, 1e-9},
+    {"magio_io_polls_total", "Polls of the io service that entered the kernel", &ContextMetrics::polls, 1},
+    {"magio_io_sqes_submitted_total", "Submission queue entries submitted", &ContextMetrics::sqes_submitted, 1},
+    {"magio_io_cqes_reaped_total", "Completions reaped", &ContextMetrics::cqes_reaped, 1},
+};
+
+const GaugeField kGaugeFields[] = {
+    {"magio_run_queue", "Coroutines the last loop iteration took from the run queue", &ContextMetrics::run_queue},
+    {"magio_timers_pending", "Timers queued, cancelled ones included until they expire", &ContextMetrics::timers_pending},
+    {"magio_io_in_flight", "Io operations submitted and not completed", &ContextMetrics::io_in_flight},
+};
+
+const HistogramField kHistogramFields[] = {
+    {"magio_resumed_per_iteration", "Coroutines resumed per loop iteration", &ContextMetrics::resumed_per_iteration},
+    {"magio_io_cqes_per_poll", "Completions reaped per poll", &ContextMetrics::cqes_per_poll},
+};
+
+const AllocField kAllocFields[] = {
+    {"magio_allocations_total", "Library allocations through the context's allocator", &ContextMetrics::allocations, nullptr},
+    {"magio_allocated_bytes_total", "Bytes allocated through the context's allocator", &ContextMetrics::allocated_bytes, nullptr},
+    {"magio_allocated_live_bytes", "Bytes allocated through the context's allocator and not freed yet", nullptr, &ContextMetrics::live_bytes},
+};
+
+void write_header(std::string& out, std::string_view name, std::string_view help, std::string_view type) {
+    fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+// labels is empty or like context="0"
+void write_histogram(std::string& out, std::string_view name, std::string_view labels, const Histogram& h) {
+    std::string_view sep = labels.empty() ? "" : ",";
+    // buckets past the highest used one add nothing but lines
+    size_t last = 0;
+    for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+        if (h.bucket(i)) {
+            last = i;
+        }
+    }
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= last; ++i) {
+        cumulative += h.bucket(i);
+        fmt::format_to(std::back_inserter(out), "{}_bucket{{{}{}le=\"{}\"}} {}\n",
+            name, labels, sep, Histogram::upper_bound(i), cumulative);
+    }
+    fmt::format_to(std::back_inserter(out), "{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, sep, h.count());
+    std::string braces = labels.empty() ? "" : fmt::format("{{{}}}", labels);
+    fmt::format_to(std::back_inserter(out), "{}_sum{} {}\n{}_count{} {}\n", name, braces, h.sum(), name, braces, h.count());
+}
+
+}
+
+Registry& Registry::global() {
+    // never destroyed, contexts with static storage unregister after it would be
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help) {
+    return custom(name, help, &Custom::counter, "counter");
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help) {
+    return custom(name, help, &Custom::gauge, "gauge");
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help) {
+    return custom(name, help, &Custom::histogram, "histogram");
+}
+
+size_t Registry::add_context(const ContextMetrics* metrics) {
+    std::lock_guard lk(m_);
+    size_t id = next_id_++;
+    contexts_.emplace_back(id, metrics);
+    return id;
+}
+
+void Registry::remove_context(const ContextMetrics* metrics) {
+    std::lock_guard lk(m_);
+    std::erase_if(contexts_, [metrics](auto& ctx) {
+        return ctx.second == metrics;
+    });
+}
+
+void Registry::for_each_context(const std::function<void(size_t, const ContextMetrics&)>& func) const {
+    std::lock_guard lk(m_);
+    for (auto& [id, metrics] : contexts_) {
+        func(id, *metrics);
+    }
+}
+
+std::string Registry::to_prometheus() const {
+    std::lock_guard lk(m_);
+    std::string out;
+    for (auto& field : kCounterFields) {
+        write_header(out, field.name, field.help, "counter");
+        for (auto& [id, metrics] : contexts_) {
+            uint64_t value = (metrics->*field.member).value();
+            if (field.scale == 1) {
+                fmt::format_to(std::back_inserter(out), "{}{{context=\"{}\"}} {}\n", field.name, id, value);
+            } else {
+                fmt::format_to(std::back_inserter(out), "{}{{context=\"{}\"}} {:.9f}\n", field.name, id, value * field.scale);
+            }
+        }
+    }
+    for (auto& field : kGaugeFields) {
+        write_header(out, field.name, field.help, "gauge");
+        for (auto& [id, metrics] : contexts_) {
+            fmt::format_to(std::back_inserter(out), "{}{{context=\"{}\"}} {}\n", field.name, id, (metrics->*field.member).value());
+        }
+    }
+    for (auto& field : kHistogramFields) {
+        write_header(out, field.name, field.help, "histogram");
+        for (auto& [id, metrics] : contexts_) {
+            write_histogram(out, field.name, fmt::format("context=\"{}\"", id), metrics->*field.member);
+        }
+    }
+    for (auto& field : kAllocFields) {
+        write_header(out, field.name, field.help, field.counters ? "counter" : "gauge");
+        for (auto& [id, metrics] : contexts_) {
+            for (size_t c = 0; c < kAllocCategories; ++c) {
+                int64_t value = field.counters ? (int64_t)(metrics->*field.counters)[c].value() : (metrics->*field.gauges)[c].value();
+                fmt::format_to(std::back_inserter(out), "{}{{context=\"{}\",category=\"{}\"}} {}\n",
+                    field.name, id, alloc_category_name((AllocCategory)c), value);
+            }
+        }
+    }
+
+    for (auto& [name, c] : customs_) {
+        if (c.counter) {
+            write_header(out, name, c.help, "counter");
+            fmt::format_to(std::back_inserter(out), "{} {}\n", name, c.counter->value());
+        } else if (c.gauge) {
+            write_header(out, name, c.help, "gauge");
+            fmt::format_to(std::back_inserter(out), "{} {}\n", name, c.gauge->value());
+        } else {
+            write_header(out, name, c.help, "histogram");
+            write_histogram(out, name, "", *c.histogram);
+        }
+    }
+    return out;
+}
+
+template<typename T>
+T& Registry::custom(const std::string& name, const std::string& help, std::unique_ptr<T> Custom::* member, const char* kind) {
+    std::lock_guard lk(m_);
+    auto [it, created] = customs_.try_emplace(name, Custom{.help = help});
+    auto& metric = it->second.*member;
+    if (created) {
+        metric = std::make_unique<T>();
+    } else if (!metric) {
+        M_FATAL("metric {} is not a {}", name, kind);
+    }
+    return *metric;
+}
+
+}
+
+}
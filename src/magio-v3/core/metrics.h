@@ -0,0 +1,167 @@
+#ifndef MAGIO_CORE_METRICS_H_
+#define MAGIO_CORE_METRICS_H_
+
+#include <bit>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "magio-v3/core/allocator.h"
+#include "magio-v3/core/noncopyable.h"
+
+namespace magio {
+
+namespace metrics {
+
+// Metrics use relaxed atomics, a reader on another thread may see a slightly stale value but never a torn one
+
+class Counter: Noncopyable {
+public:
+    void add(uint64_t n = 1) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge: Noncopyable {
+public:
+    void set(int64_t value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    void add(int64_t n) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Power of two buckets, bucket i counts the values i bits wide, so its upper bound is 2^i - 1.
+// Coarser than magio::Histogram but small enough to export every bucket
+class Histogram: Noncopyable {
+public:
+    static constexpr size_t kBuckets = 65;
+
+    void record(uint64_t value) {
+        buckets_[std::bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t bucket(size_t i) const {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    uint64_t sum() const {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (auto& b : buckets_) {
+            n += b.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    static uint64_t upper_bound(size_t i) {
+        return i >= 64 ? UINT64_MAX : (uint64_t(1) << i) - 1;
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets]{};
+    std::atomic<uint64_t> sum_{0};
+};
+
+// What one CoroContext does, written by its thread and readable from any
+struct ContextMetrics {
+    Counter loop_iterations;
+    // coroutines resumed from the run queue
+    Counter resumed;
+    Counter timers_fired;
+    // coroutines queued from other threads, each one wakes the io service up
+    Counter remote_wakeups;
+    Counter resume_ns;
+    Counter timer_ns;
+    // includes the time blocked waiting for io
+    Counter poll_ns;
+    // coroutines the last iteration took from the run queue
+    Gauge run_queue;
+    // including cancelled timers that have not expired yet
+    Gauge timers_pending;
+    Histogram resumed_per_iteration;
+
+    // filled by the io service
+    Counter polls;
+    Counter sqes_submitted;
+    Counter cqes_reaped;
+    Gauge io_in_flight;
+    Histogram cqes_per_poll;
+
+    // by AllocCategory, only counted while the context has an allocator
+    Counter allocations[kAllocCategories];
+    Counter allocated_bytes[kAllocCategories];
+    Gauge live_bytes[kAllocCategories];
+};
+
+class Registry: Noncopyable {
+public:
+    // The registry every CoroContext registers with
+    static Registry& global();
+
+    // The metric of that name, created on first use, it lives as long as the registry.
+    // The name must be a valid prometheus metric name and stay with one kind of metric
+    Counter& counter(const std::string& name, const std::string& help);
+
+    Gauge& gauge(const std::string& name, const std::string& help);
+
+    Histogram& histogram(const std::string& name, const std::string& help);
+
+    // Returns the id the context is labelled with
+    size_t add_context(const ContextMetrics* metrics);
+
+    void remove_context(const ContextMetrics* metrics);
+
+    // func(id, metrics) for every context, none of them goes away meanwhile
+    void for_each_context(const std::function<void(size_t, const ContextMetrics&)>& func) const;
+
+    // Everything in the prometheus text exposition format
+    std::string to_prometheus() const;
+
+private:
+    struct Custom {
+        std::string help;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    template<typename T>
+    T& custom(const std::string& name, const std::string& help, std::unique_ptr<T> Custom::* member, const char* kind);
+
+    mutable std::mutex m_;
+    size_t next_id_ = 0;
+    std::vector<std::pair<size_t, const ContextMetrics*>> contexts_;
+    std::map<std::string, Custom> customs_;
+};
+
+}
+
+}
+
+#endif
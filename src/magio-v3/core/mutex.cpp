@@ -3,25 +3,21 @@
 namespace magio {
 
 #ifdef MAGIO_USE_CORO
-void Mutex::LockAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
-    if (co_mutex_.flag_.test_and_set(std::memory_order_acquire)) {
-        std::lock_guard lk(co_mutex_.mutex_);
-        co_mutex_.queue_.push_back({LocalContext, prev_h});
-    } else {
-        prev_h.resume();
-    }
-}
-
-void Mutex::LockAwaitable::await_resume() {
-
-}
-
-void Mutex::GuardAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
-    if (co_mutex_.flag_.test_and_set(std::memory_order_acquire)) {
-        std::lock_guard lk(co_mutex_.mutex_);
-        co_mutex_.queue_.push_back({LocalContext, prev_h});
-    } else {
-        prev_h.resume();
+bool Mutex::LockAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    ctx_ = LocalContext;
+    handle_ = prev_h;
+    std::uintptr_t state = co_mutex_.state_.load(std::memory_order_acquire);
+    for (; ;) {
+        if (state == kUnlocked) {
+            if (co_mutex_.state_.compare_exchange_weak(state, kLocked, std::memory_order_acquire, std::memory_order_acquire)) {
+                return false;
+            }
+        } else {
+            next_ = reinterpret_cast<LockAwaitable*>(state);
+            if (co_mutex_.state_.compare_exchange_weak(state, reinterpret_cast<std::uintptr_t>(this), std::memory_order_release, std::memory_order_acquire)) {
+                return true;
+            }
+        }
     }
 }
 
@@ -30,31 +26,44 @@ LockGuard Mutex::GuardAwaitable::await_resume() {
 }
 
 Mutex::Mutex()
-    : flag_()
+    : state_(kUnlocked)
 { }
 
 Mutex::GuardAwaitable Mutex::lock_guard() {
     return {*this};
 }
 
+bool Mutex::try_lock() {
+    std::uintptr_t state = kUnlocked;
+    return state_.compare_exchange_strong(state, kLocked, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
 Mutex::LockAwaitable Mutex::lock() {
     return {*this};
 }
 
+// The lock is handed to the oldest waiter without being released, so nobody can barge in
 void Mutex::unlock() {
-    Entry entry;
-    {
-        std::lock_guard lk(mutex_);
-        if (!queue_.empty()) {
-            entry = queue_.front();
-            queue_.pop_front();
-        } else {
-            flag_.clear(std::memory_order_release);
+    LockAwaitable* head = waiters_;
+    if (!head) {
+        std::uintptr_t state = kLocked;
+        if (state_.compare_exchange_strong(state, kUnlocked, std::memory_order_release, std::memory_order_relaxed)) {
+            return;
         }
+
+        // take the waiters pushed since, the stack is reversed into FIFO order
+        state = state_.exchange(kLocked, std::memory_order_acquire);
+        auto waiter = reinterpret_cast<LockAwaitable*>(state);
+        do {
+            auto next = waiter->next_;
+            waiter->next_ = head;
+            head = waiter;
+            waiter = next;
+        } while (waiter);
     }
-    if (entry.h) {
-        entry.ctx->queue_in_context(entry.h);
-    }
+
+    waiters_ = head->next_;
+    head->ctx_->queue_in_context(head->handle_);
 }
 
 void Condition::notify_one() {
@@ -81,6 +90,102 @@ void Condition::notify_all() {
         entry.ctx->queue_in_context(entry.h);
     }
 }
+
+bool SharedMutex::LockAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    ctx_ = LocalContext;
+    handle_ = prev_h;
+
+    std::lock_guard lk(co_mutex_.lock_);
+    std::uintptr_t state = co_mutex_.state_.load(std::memory_order_relaxed);
+    for (; ;) {
+        bool free = shared_ ? !(state & (kWriter | kWaiting)) : state == 0;
+        if (free) {
+            std::uintptr_t locked = shared_ ? state + kReader : kWriter;
+            if (co_mutex_.state_.compare_exchange_weak(state, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return false;
+            }
+        } else if ((state & kWaiting) || co_mutex_.state_.compare_exchange_weak(state, state | kWaiting, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    if (co_mutex_.tail_) {
+        co_mutex_.tail_->next_ = this;
+    } else {
+        co_mutex_.head_ = this;
+    }
+    co_mutex_.tail_ = this;
+    return true;
+}
+
+SharedLockGuard SharedMutex::LockAwaitable::await_resume() {
+    return {co_mutex_, shared_};
+}
+
+SharedMutex::LockAwaitable SharedMutex::lock_guard() {
+    return {*this, false};
+}
+
+SharedMutex::LockAwaitable SharedMutex::shared_lock_guard() {
+    return {*this, true};
+}
+
+bool SharedMutex::try_lock() {
+    std::uintptr_t state = 0;
+    return state_.compare_exchange_strong(state, kWriter, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+bool SharedMutex::try_lock_shared() {
+    std::uintptr_t state = state_.load(std::memory_order_relaxed);
+    while (!(state & (kWriter | kWaiting))) {
+        if (state_.compare_exchange_weak(state, state + kReader, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SharedMutex::unlock() {
+    if (state_.fetch_sub(kWriter, std::memory_order_acq_rel) & kWaiting) {
+        dispatch();
+    }
+}
+
+void SharedMutex::unlock_shared() {
+    std::uintptr_t state = state_.fetch_sub(kReader, std::memory_order_acq_rel);
+    if ((state & kWaiting) && (state & ~(kWriter | kWaiting)) == kReader) {
+        dispatch();
+    }
+}
+
+// Called by the last holder when there are waiters, kWaiting keeps everyone else off the fast paths
+void SharedMutex::dispatch() {
+    LockAwaitable* woken = nullptr;
+    {
+        std::lock_guard lk(lock_);
+        std::uintptr_t state = 0;
+        do {
+            LockAwaitable* waiter = head_;
+            head_ = waiter->next_;
+            waiter->next_ = woken;
+            woken = waiter;
+            state += waiter->shared_ ? kReader : kWriter;
+        } while (head_ && head_->shared_ && woken->shared_);
+
+        if (head_) {
+            state |= kWaiting;
+        } else {
+            tail_ = nullptr;
+        }
+        state_.store(state, std::memory_order_release);
+    }
+
+    while (woken) {
+        auto next = woken->next_;
+        woken->ctx_->queue_in_context(woken->handle_);
+        woken = next;
+    }
+}
 #endif
 
 }
\ No newline at end of file
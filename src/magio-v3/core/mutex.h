@@ -1,8 +1,11 @@
 #ifndef MAGIO_CORE_MUTEX_H_
 #define MAGIO_CORE_MUTEX_H_
 
+#include <deque>
 #include <atomic>
+#include <cstdint>
 
+#include "magio-v3/core/spin_lock.h"
 #include "magio-v3/core/coro_context.h"
 
 namespace magio {
@@ -21,39 +24,33 @@ class Mutex: Noncopyable {
 
 public:
     class LockAwaitable: Noncopyable {
+        friend class Mutex;
+
     public:
         LockAwaitable(Mutex& m)
             : co_mutex_(m) 
         { }
 
         bool await_ready() { 
-            return false; 
+            return co_mutex_.try_lock(); 
         }
 
-        void await_suspend(std::coroutine_handle<> prev_h);
+        bool await_suspend(std::coroutine_handle<> prev_h);
 
-        void await_resume();
+        void await_resume() { }
 
-    private:
+    protected:
         Mutex& co_mutex_;
+        CoroContext* ctx_ = nullptr;
+        std::coroutine_handle<> handle_;
+        LockAwaitable* next_ = nullptr;
     };
 
-    class GuardAwaitable: Noncopyable {
+    class GuardAwaitable: public LockAwaitable {
     public:
-        GuardAwaitable(Mutex& m)
-            : co_mutex_(m) 
-        { }
-
-        bool await_ready() { 
-            return false; 
-        }
-
-        void await_suspend(std::coroutine_handle<> prev_h);
+        using LockAwaitable::LockAwaitable;
 
         LockGuard await_resume();
-
-    private:
-        Mutex& co_mutex_;
     };
 
     Mutex();
@@ -61,20 +58,23 @@ public:
     [[nodiscard]]
     GuardAwaitable lock_guard();
 
-private:
-    struct Entry {
-        CoroContext* ctx;
-        std::coroutine_handle<> h;
-    };
+    // Takes the lock without suspending if it is free, release it with unlock()
+    bool try_lock();
+
+    // Releases a lock taken by try_lock(), guards release theirs on their own
+    void unlock();
 
+private:
     [[nodiscard]]
     LockAwaitable lock();
-    
-    void unlock();
 
-    std::atomic_flag flag_;
-    std::mutex mutex_;
-    std::deque<Entry> queue_;
+    // kUnlocked, kLocked or the top of a stack of waiters pushed while locked
+    static constexpr std::uintptr_t kUnlocked = 1;
+    static constexpr std::uintptr_t kLocked = 0;
+
+    std::atomic<std::uintptr_t> state_;
+    // waiters in FIFO order, only touched by the owner
+    LockAwaitable* waiters_ = nullptr;
 };
 
 class LockGuard: Noncopyable {
@@ -126,6 +126,89 @@ private:
     std::mutex m_;
     std::deque<Entry> queue_;
 };
+
+class SharedLockGuard;
+
+// Many readers or one writer. Waiters are granted in FIFO order, consecutive readers at once,
+// and new readers queue behind a waiting writer so writers are not starved.
+class SharedMutex: Noncopyable {
+    friend class SharedLockGuard;
+
+public:
+    class LockAwaitable: Noncopyable {
+        friend class SharedMutex;
+
+    public:
+        LockAwaitable(SharedMutex& m, bool shared)
+            : co_mutex_(m), shared_(shared)
+        { }
+
+        bool await_ready() {
+            return shared_ ? co_mutex_.try_lock_shared() : co_mutex_.try_lock();
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h);
+
+        SharedLockGuard await_resume();
+
+    private:
+        SharedMutex& co_mutex_;
+        bool shared_;
+        CoroContext* ctx_ = nullptr;
+        std::coroutine_handle<> handle_;
+        LockAwaitable* next_ = nullptr;
+    };
+
+    SharedMutex() = default;
+
+    [[nodiscard]]
+    LockAwaitable lock_guard();
+
+    [[nodiscard]]
+    LockAwaitable shared_lock_guard();
+
+    // Take the lock without suspending if possible, release it with unlock() or unlock_shared()
+    bool try_lock();
+
+    bool try_lock_shared();
+
+    void unlock();
+
+    void unlock_shared();
+
+private:
+    void dispatch();
+
+    // the reader count lives above the two flags
+    static constexpr std::uintptr_t kWriter = 1;
+    static constexpr std::uintptr_t kWaiting = 2;
+    static constexpr std::uintptr_t kReader = 4;
+
+    std::atomic<std::uintptr_t> state_{0};
+    // guards the waiter queue, only taken when a waiter exists
+    SpinLock lock_;
+    LockAwaitable* head_ = nullptr;
+    LockAwaitable* tail_ = nullptr;
+};
+
+class SharedLockGuard: Noncopyable {
+public:
+    SharedLockGuard(SharedMutex& mutex, bool shared)
+        : mutex_(mutex), shared_(shared)
+    { }
+
+    ~SharedLockGuard() {
+        if (shared_) {
+            mutex_.unlock_shared();
+        } else {
+            mutex_.unlock();
+        }
+    }
+
+private:
+    SharedMutex& mutex_;
+    bool shared_;
+};
 #endif
 
 }
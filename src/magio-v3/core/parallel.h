@@ -0,0 +1,294 @@
+#ifndef MAGIO_CORE_PARALLEL_H_
+#define MAGIO_CORE_PARALLEL_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include "magio-v3/core/thread_pool.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+namespace detail {
+
+// Shared by the workers of one fork_join, lives in the awaiting coroutine frame
+struct ForkJoinState {
+    ForkJoinState(size_t size, size_t workers)
+        : size(size), workers(workers), running(workers)
+    { }
+
+    // Guided self-scheduling: every claim takes a share of what is left,
+    // so chunks start large and shrink towards the end to balance the tail.
+    bool claim(size_t& first, size_t& last) {
+        size_t cur = next.load(std::memory_order_relaxed);
+        for (; ;) {
+            if (cur >= size) {
+                return false;
+            }
+            size_t chunk = std::max<size_t>(1, (size - cur) / (2 * workers));
+            if (next.compare_exchange_weak(cur, cur + chunk, std::memory_order_relaxed)) {
+                first = cur;
+                last = cur + chunk;
+                return true;
+            }
+        }
+    }
+
+    size_t size;
+    size_t workers;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> running;
+    std::atomic_flag failed;
+    std::exception_ptr eptr;
+    CoroContext* ctx = nullptr;
+    std::coroutine_handle<> handle;
+};
+
+// Runs func(worker, first, last) over the index range [0, size) on the pool.
+// The awaiting coroutine is suspended until every chunk is done, then resumed in its own context.
+template<typename Func>
+inline Coro<> fork_join(ThreadPool& pool, size_t size, Func& func) {
+    if (size == 0) {
+        co_return;
+    }
+
+    ForkJoinState state(size, std::min(size, pool.thread_num()));
+    state.ctx = LocalContext;
+
+    co_await GetCoroutineHandle([&](std::coroutine_handle<> h) {
+        state.handle = h;
+        for (size_t i = 0; i < state.workers; ++i) {
+            pool.execute([&state, &func, i] {
+                try {
+                    size_t first, last;
+                    while (state.claim(first, last)) {
+                        func(i, first, last);
+                    }
+                } catch(...) {
+                    if (!state.failed.test_and_set()) {
+                        state.eptr = std::current_exception();
+                    }
+                    state.next.store(state.size, std::memory_order_relaxed);
+                }
+
+                if (state.running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    state.ctx->queue_in_context(state.handle);
+                }
+            });
+        }
+    });
+
+    if (state.eptr) {
+        std::rethrow_exception(state.eptr);
+    }
+}
+
+// The k sorted runs of [0, n) are [run_bound(i), run_bound(i + 1))
+inline size_t run_bound(size_t n, size_t k, size_t i) {
+    return n / k * i + std::min(i, n % k);
+}
+
+// Scratch space of parallel_sort, left uninitialized so that the first merge round constructs it on the pool.
+// Remembers the range every unit of that round constructed, to destroy them whatever happens next
+template<typename T>
+class SortBuffer: Noncopyable {
+public:
+    SortBuffer(size_t n, size_t units)
+        : data_(std::allocator<T>().allocate(n)), n_(n), built_(units)
+    { }
+
+    ~SortBuffer() {
+        for (auto [lo, hi] : built_) {
+            std::destroy(data_ + lo, data_ + hi);
+        }
+        std::allocator<T>().deallocate(data_, n_);
+    }
+
+    T* data() {
+        return data_;
+    }
+
+    void built(size_t unit, size_t lo, size_t hi) {
+        built_[unit] = {lo, hi};
+    }
+
+private:
+    T* data_;
+    size_t n_;
+    std::vector<std::pair<size_t, size_t>> built_;
+};
+
+// Like std::merge of moved elements into uninitialized memory, destroys what it constructed when it throws
+template<typename Iter, typename T, typename Comp>
+inline void uninitialized_merge(Iter a, Iter a_end, Iter b, Iter b_end, T* out, Comp& comp) {
+    T* cur = out;
+    try {
+        for (; a != a_end && b != b_end; ++cur) {
+            if (comp(*b, *a)) {
+                std::construct_at(cur, std::move(*b));
+                ++b;
+            } else {
+                std::construct_at(cur, std::move(*a));
+                ++a;
+            }
+        }
+        cur = std::uninitialized_move(a, a_end, cur);
+        std::uninitialized_move(b, b_end, cur);
+    } catch (...) {
+        std::destroy(out, cur);
+        throw;
+    }
+}
+
+// Merges adjacent pairs of runs from src into dst.
+// Every merge is cut into pieces by binary search, so all k units of a round are the same size.
+// With a buffer, dst is its uninitialized storage and the round constructs it
+template<typename SrcIter, typename DstIter, typename Comp, typename T = void>
+inline Coro<> merge_round(ThreadPool& pool, SrcIter src, DstIter dst, size_t n, size_t k, size_t width, Comp& comp, SortBuffer<T>* buffer = nullptr) {
+    auto merge_piece = [&](size_t, size_t first, size_t last) {
+        for (size_t unit = first; unit < last; ++unit) {
+            size_t pieces = 2 * width;
+            size_t pair = unit / pieces;
+            size_t piece = unit % pieces;
+
+            size_t a0 = run_bound(n, k, pair * pieces);
+            size_t b0 = run_bound(n, k, pair * pieces + width);
+            size_t b1 = run_bound(n, k, (pair + 1) * pieces);
+            size_t alen = b0 - a0;
+
+            size_t alo = a0 + alen * piece / pieces;
+            size_t ahi = a0 + alen * (piece + 1) / pieces;
+            size_t blo = piece == 0
+                ? b0
+                : std::lower_bound(src + b0, src + b1, src[alo], comp) - src;
+            size_t bhi = piece + 1 == pieces
+                ? b1
+                : std::lower_bound(src + b0, src + b1, src[ahi], comp) - src;
+
+            size_t out = alo + (blo - b0);
+            if constexpr (!std::is_void_v<T>) {
+                if (buffer) {
+                    uninitialized_merge(src + alo, src + ahi, src + blo, src + bhi, dst + out, comp);
+                    buffer->built(unit, out, out + (ahi - alo) + (bhi - blo));
+                    continue;
+                }
+            }
+            std::merge(
+                std::make_move_iterator(src + alo), std::make_move_iterator(src + ahi),
+                std::make_move_iterator(src + blo), std::make_move_iterator(src + bhi),
+                dst + out,
+                comp
+            );
+        }
+    };
+
+    co_await fork_join(pool, k, merge_piece);
+}
+
+}
+
+// Calls func(elem) for every element of [first, last) on the pool
+template<typename Iter, typename Func>
+[[nodiscard]]
+inline Coro<> parallel_for(ThreadPool& pool, Iter first, Iter last, Func func) {
+    auto body = [&](size_t, size_t lo, size_t hi) {
+        std::for_each(first + lo, first + hi, func);
+    };
+
+    co_await detail::fork_join(pool, last - first, body);
+}
+
+// Writes func(elem) of every element of [first, last) to d_first, returns the end of the output
+template<typename Iter, typename OutIter, typename Func>
+[[nodiscard]]
+inline Coro<OutIter> parallel_transform(ThreadPool& pool, Iter first, Iter last, OutIter d_first, Func func) {
+    auto body = [&](size_t, size_t lo, size_t hi) {
+        std::transform(first + lo, first + hi, d_first + lo, func);
+    };
+
+    co_await detail::fork_join(pool, last - first, body);
+    co_return d_first + (last - first);
+}
+
+// Like std::reduce, op must be associative and commutative
+template<typename Iter, typename T, typename BinaryOp = std::plus<>>
+[[nodiscard]]
+inline Coro<T> parallel_reduce(ThreadPool& pool, Iter first, Iter last, T init, BinaryOp op = {}) {
+    std::vector<std::optional<T>> partial(std::min<size_t>(last - first, pool.thread_num()));
+    auto body = [&](size_t worker, size_t lo, size_t hi) {
+        auto it = first + lo;
+        T local(*it);
+        for (++it; it != first + hi; ++it) {
+            local = op(std::move(local), *it);
+        }
+
+        auto& acc = partial[worker];
+        if (acc) {
+            acc = op(std::move(*acc), std::move(local));
+        } else {
+            acc.emplace(std::move(local));
+        }
+    };
+
+    co_await detail::fork_join(pool, last - first, body);
+    for (auto& acc : partial) {
+        if (acc) {
+            init = op(std::move(init), std::move(*acc));
+        }
+    }
+    co_return init;
+}
+
+// Sorts runs on every worker, then merges them pairwise in parallel rounds through a temporary buffer.
+template<typename Iter, typename Comp = std::less<>>
+[[nodiscard]]
+inline Coro<> parallel_sort(ThreadPool& pool, Iter first, Iter last, Comp comp = {}) {
+    using ValueType = typename std::iterator_traits<Iter>::value_type;
+
+    size_t n = last - first;
+    size_t k = 1;
+    while (k * 2 <= pool.thread_num() && n / (k * 2) >= 2048) {
+        k *= 2;
+    }
+
+    auto sort_run = [&](size_t, size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            std::sort(first + detail::run_bound(n, k, i), first + detail::run_bound(n, k, i + 1), comp);
+        }
+    };
+    co_await detail::fork_join(pool, k, sort_run);
+
+    if (k == 1) {
+        co_return;
+    }
+
+    // the first round moves every element into it
+    detail::SortBuffer<ValueType> buffer(n, k);
+    co_await detail::merge_round(pool, first, buffer.data(), n, k, 1, comp, &buffer);
+    bool in_buffer = true;
+    for (size_t width = 2; width < k; width *= 2) {
+        if (in_buffer) {
+            co_await detail::merge_round(pool, buffer.data(), first, n, k, width, comp);
+        } else {
+            co_await detail::merge_round(pool, first, buffer.data(), n, k, width, comp);
+        }
+        in_buffer = !in_buffer;
+    }
+
+    if (in_buffer) {
+        auto move_back = [&](size_t, size_t lo, size_t hi) {
+            std::move(buffer.data() + lo, buffer.data() + hi, first + lo);
+        };
+        co_await detail::fork_join(pool, n, move_back);
+    }
+}
+#endif
+
+}
+
+#endif
@@ -54,17 +54,17 @@ Coro<size_t> ReadablePipe::read(char *buf, size_t len, std::error_code &ec) {
 
 void ReadablePipe::read(char *buf, size_t len, std::function<void (std::error_code, size_t)>&& cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
-    auto ioc = new IoContext{
+    auto ioc = detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = decltype(IoContext::handle)(handle_),
         .buf = io_buf(buf, len),
-        .ptr = new Cb(std::move(cb)),
+        .ptr = detail::make<Cb>(AllocCategory::Io, std::move(cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete cb;
-            delete ioc;
+            detail::destroy(cb, AllocCategory::Io);
+            detail::destroy(ioc, AllocCategory::Io);
         }
-    };
+    });
 
     this_context::get_service().read_file(*ioc, 0);
 }
@@ -122,17 +122,17 @@ Coro<size_t> WritablePipe::write(const char *msg, size_t len, std::error_code &e
 
 void WritablePipe::write(const char *msg, size_t len, std::function<void (std::error_code, size_t)> &&cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
-    auto ioc = new IoContext{
+    auto ioc = detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = decltype(IoContext::handle)(handle_),
         .buf = io_buf((char*)msg, len),
-        .ptr = new Cb(std::move(cb)),
+        .ptr = detail::make<Cb>(AllocCategory::Io, std::move(cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete cb;
-            delete ioc;
+            detail::destroy(cb, AllocCategory::Io);
+            detail::destroy(ioc, AllocCategory::Io);
         }
-    };
+    });
 
     this_context::get_service().write_file(*ioc, 0);
 }
@@ -0,0 +1,320 @@
+#include "magio-v3/core/scan.h"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAGIO_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define MAGIO_SCAN_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define MAGIO_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace magio {
+
+namespace {
+
+constexpr size_t npos = std::string_view::npos;
+
+// sad sums stay below 2^16 if the byte counters are flushed every 255 blocks
+constexpr size_t kMaxBlocks = 255;
+
+inline unsigned ctz(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+size_t count_scalar(const char* p, size_t len, char ch) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        n += p[i] == ch;
+    }
+    return n;
+}
+
+size_t find_scalar(const char* p, size_t len, char ch) {
+    auto pos = (const char*)std::memchr(p, ch, len);
+    return pos ? pos - p : npos;
+}
+
+size_t find_any_scalar(const char* p, size_t len, std::string_view set) {
+    bool table[256] = {};
+    for (char ch : set) {
+        table[(unsigned char)ch] = true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (table[(unsigned char)p[i]]) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+// above this many needles one compare per needle costs more than the table lookup
+constexpr size_t kMaxSimdSet = 8;
+
+#ifdef MAGIO_SCAN_SSE2
+size_t count_sse2(const char* p, size_t len, char ch) {
+    const __m128i needle = _mm_set1_epi8(ch);
+    const __m128i zero = _mm_setzero_si128();
+    size_t n = 0;
+    size_t i = 0;
+    while (len - i >= 16) {
+        // matches are -1, subtracting them counts per byte lane
+        __m128i acc = zero;
+        size_t blocks = std::min((len - i) / 16, kMaxBlocks);
+        for (size_t b = 0; b < blocks; ++b, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        __m128i sums = _mm_sad_epu8(acc, zero);
+        n += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+    return n + count_scalar(p + i, len - i, ch);
+}
+
+size_t find_sse2(const char* p, size_t len, char ch) {
+    const __m128i needle = _mm_set1_epi8(ch);
+    size_t i = 0;
+    for (; len - i >= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (mask) {
+            return i + ctz(mask);
+        }
+    }
+    size_t pos = find_scalar(p + i, len - i, ch);
+    return pos == npos ? npos : i + pos;
+}
+
+size_t find_any_sse2(const char* p, size_t len, std::string_view set) {
+    __m128i needles[kMaxSimdSet];
+    for (size_t k = 0; k < set.size(); ++k) {
+        needles[k] = _mm_set1_epi8(set[k]);
+    }
+    size_t i = 0;
+    for (; len - i >= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i eq = _mm_cmpeq_epi8(v, needles[0]);
+        for (size_t k = 1; k < set.size(); ++k) {
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, needles[k]));
+        }
+        uint32_t mask = _mm_movemask_epi8(eq);
+        if (mask) {
+            return i + ctz(mask);
+        }
+    }
+    size_t pos = find_any_scalar(p + i, len - i, set);
+    return pos == npos ? npos : i + pos;
+}
+#endif
+
+#ifdef MAGIO_SCAN_AVX2
+bool has_avx2() {
+    static const bool value = __builtin_cpu_supports("avx2");
+    return value;
+}
+
+__attribute__((target("avx2")))
+size_t count_avx2(const char* p, size_t len, char ch) {
+    const __m256i needle = _mm256_set1_epi8(ch);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t n = 0;
+    size_t i = 0;
+    while (len - i >= 32) {
+        __m256i acc = zero;
+        size_t blocks = std::min((len - i) / 32, kMaxBlocks);
+        for (size_t b = 0; b < blocks; ++b, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, zero);
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        n += (size_t)_mm_cvtsi128_si32(half) + (size_t)_mm_extract_epi16(half, 4);
+    }
+    return n + count_sse2(p + i, len - i, ch);
+}
+
+__attribute__((target("avx2")))
+size_t find_avx2(const char* p, size_t len, char ch) {
+    const __m256i needle = _mm256_set1_epi8(ch);
+    size_t i = 0;
+    for (; len - i >= 32; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (mask) {
+            return i + ctz(mask);
+        }
+    }
+    size_t pos = find_sse2(p + i, len - i, ch);
+    return pos == npos ? npos : i + pos;
+}
+
+__attribute__((target("avx2")))
+size_t find_any_avx2(const char* p, size_t len, std::string_view set) {
+    __m256i needles[kMaxSimdSet];
+    for (size_t k = 0; k < set.size(); ++k) {
+        needles[k] = _mm256_set1_epi8(set[k]);
+    }
+    size_t i = 0;
+    for (; len - i >= 32; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i eq = _mm256_cmpeq_epi8(v, needles[0]);
+        for (size_t k = 1; k < set.size(); ++k) {
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, needles[k]));
+        }
+        uint32_t mask = _mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + ctz(mask);
+        }
+    }
+    size_t pos = find_any_sse2(p + i, len - i, set);
+    return pos == npos ? npos : i + pos;
+}
+#endif
+
+#ifdef MAGIO_SCAN_NEON
+// 4 bits per byte, the usual substitute for movemask
+inline uint64_t neon_mask(uint8x16_t eq) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+size_t count_neon(const char* p, size_t len, char ch) {
+    const uint8x16_t needle = vdupq_n_u8((uint8_t)ch);
+    size_t n = 0;
+    size_t i = 0;
+    while (len - i >= 16) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        size_t blocks = std::min((len - i) / 16, kMaxBlocks);
+        for (size_t b = 0; b < blocks; ++b, i += 16) {
+            uint8x16_t v = vld1q_u8((const uint8_t*)(p + i));
+            acc = vsubq_u8(acc, vceqq_u8(v, needle));
+        }
+        n += vaddlvq_u8(acc);
+    }
+    return n + count_scalar(p + i, len - i, ch);
+}
+
+size_t find_neon(const char* p, size_t len, char ch) {
+    const uint8x16_t needle = vdupq_n_u8((uint8_t)ch);
+    size_t i = 0;
+    for (; len - i >= 16; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(p + i));
+        uint64_t mask = neon_mask(vceqq_u8(v, needle));
+        if (mask) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+    size_t pos = find_scalar(p + i, len - i, ch);
+    return pos == npos ? npos : i + pos;
+}
+
+size_t find_any_neon(const char* p, size_t len, std::string_view set) {
+    uint8x16_t needles[kMaxSimdSet];
+    for (size_t k = 0; k < set.size(); ++k) {
+        needles[k] = vdupq_n_u8((uint8_t)set[k]);
+    }
+    size_t i = 0;
+    for (; len - i >= 16; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(p + i));
+        uint8x16_t eq = vceqq_u8(v, needles[0]);
+        for (size_t k = 1; k < set.size(); ++k) {
+            eq = vorrq_u8(eq, vceqq_u8(v, needles[k]));
+        }
+        uint64_t mask = neon_mask(eq);
+        if (mask) {
+            return i + __builtin_ctzll(mask) / 4;
+        }
+    }
+    size_t pos = find_any_scalar(p + i, len - i, set);
+    return pos == npos ? npos : i + pos;
+}
+#endif
+
+}
+
+size_t count_byte(std::string_view data, char ch) {
+#ifdef MAGIO_SCAN_AVX2
+    if (has_avx2()) {
+        return count_avx2(data.data(), data.size(), ch);
+    }
+#endif
+#if defined(MAGIO_SCAN_SSE2)
+    return count_sse2(data.data(), data.size(), ch);
+#elif defined(MAGIO_SCAN_NEON)
+    return count_neon(data.data(), data.size(), ch);
+#else
+    return count_scalar(data.data(), data.size(), ch);
+#endif
+}
+
+size_t find_byte(std::string_view data, char ch) {
+#ifdef MAGIO_SCAN_AVX2
+    if (has_avx2()) {
+        return find_avx2(data.data(), data.size(), ch);
+    }
+#endif
+#if defined(MAGIO_SCAN_SSE2)
+    return find_sse2(data.data(), data.size(), ch);
+#elif defined(MAGIO_SCAN_NEON)
+    return find_neon(data.data(), data.size(), ch);
+#else
+    return find_scalar(data.data(), data.size(), ch);
+#endif
+}
+
+size_t find_any_of(std::string_view data, std::string_view set) {
+    if (set.empty()) {
+        return npos;
+    }
+    if (set.size() == 1) {
+        return find_byte(data, set[0]);
+    }
+    if (set.size() > kMaxSimdSet) {
+        return find_any_scalar(data.data(), data.size(), set);
+    }
+#ifdef MAGIO_SCAN_AVX2
+    if (has_avx2()) {
+        return find_any_avx2(data.data(), data.size(), set);
+    }
+#endif
+#if defined(MAGIO_SCAN_SSE2)
+    return find_any_sse2(data.data(), data.size(), set);
+#elif defined(MAGIO_SCAN_NEON)
+    return find_any_neon(data.data(), data.size(), set);
+#else
+    return find_any_scalar(data.data(), data.size(), set);
+#endif
+}
+
+const char* scan_isa() {
+#ifdef MAGIO_SCAN_AVX2
+    if (has_avx2()) {
+        return "avx2";
+    }
+#endif
+#if defined(MAGIO_SCAN_SSE2)
+    return "sse2";
+#elif defined(MAGIO_SCAN_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+}
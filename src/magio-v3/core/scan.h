@@ -0,0 +1,25 @@
+#ifndef MAGIO_CORE_SCAN_H_
+#define MAGIO_CORE_SCAN_H_
+
+#include <string_view>
+
+namespace magio {
+
+// Byte scanning over AVX2, SSE2 or NEON, whichever the cpu has, with a scalar fallback.
+// AVX2 is picked at runtime so the library does not need to be built with -mavx2
+
+// The number of times ch occurs in data
+size_t count_byte(std::string_view data, char ch);
+
+// The position of the first ch, or npos
+size_t find_byte(std::string_view data, char ch);
+
+// The position of the first byte that is one of set, or npos
+size_t find_any_of(std::string_view data, std::string_view set);
+
+// The instruction set used by the functions above, e.g. "avx2"
+const char* scan_isa();
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "magio-v3/core/semaphore.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+bool Semaphore::AcquireAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    if (sem_.count_.fetch_sub(1, std::memory_order_acquire) > 0) {
+        return false;
+    }
+
+    std::lock_guard lk(sem_.lock_);
+    if (sem_.pending_ != 0) {
+        --sem_.pending_;
+        return false;
+    }
+
+    waiter_.ctx = LocalContext;
+    waiter_.handle = prev_h;
+    waiter_.next = nullptr;
+    if (sem_.tail_) {
+        sem_.tail_->next = &waiter_;
+    } else {
+        sem_.head_ = &waiter_;
+    }
+    sem_.tail_ = &waiter_;
+    return true;
+}
+
+bool Semaphore::try_acquire() {
+    std::ptrdiff_t count = count_.load(std::memory_order_relaxed);
+    while (count > 0) {
+        if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Semaphore::release(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (count_.fetch_add(1, std::memory_order_release) >= 0) {
+            continue;
+        }
+
+        detail::Waiter* waiter = nullptr;
+        {
+            std::lock_guard lk(lock_);
+            if (head_) {
+                waiter = head_;
+                head_ = waiter->next;
+                if (!head_) {
+                    tail_ = nullptr;
+                }
+            } else {
+                ++pending_;
+            }
+        }
+        if (waiter) {
+            waiter->ctx->queue_in_context(waiter->handle);
+        }
+    }
+}
+#endif
+
+}
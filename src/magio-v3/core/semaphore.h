@@ -0,0 +1,62 @@
+#ifndef MAGIO_CORE_SEMAPHORE_H_
+#define MAGIO_CORE_SEMAPHORE_H_
+
+#include <cstddef>
+
+#include "magio-v3/core/event.h"
+#include "magio-v3/core/spin_lock.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+// Counting semaphore, e.g. to limit the number of outbound connections.
+// Waiters are resumed in FIFO order.
+class Semaphore: Noncopyable {
+public:
+    class AcquireAwaitable: Noncopyable {
+    public:
+        AcquireAwaitable(Semaphore& sem)
+            : sem_(sem)
+        { }
+
+        bool await_ready() {
+            return sem_.try_acquire();
+        }
+
+        bool await_suspend(std::coroutine_handle<> prev_h);
+
+        void await_resume() { }
+
+    private:
+        Semaphore& sem_;
+        detail::Waiter waiter_;
+    };
+
+    explicit Semaphore(size_t count)
+        : count_(count)
+    { }
+
+    [[nodiscard]]
+    AcquireAwaitable acquire() {
+        return {*this};
+    }
+
+    bool try_acquire();
+
+    void release(size_t n = 1);
+
+private:
+    // negative when coroutines are queued or about to be
+    std::atomic<std::ptrdiff_t> count_;
+    // guards the members below, only taken when the count is negative
+    SpinLock lock_;
+    // releases that arrived before the coroutine they wake was queued
+    size_t pending_ = 0;
+    detail::Waiter* head_ = nullptr;
+    detail::Waiter* tail_ = nullptr;
+};
+#endif
+
+}
+
+#endif
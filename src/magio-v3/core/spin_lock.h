@@ -0,0 +1,65 @@
+#ifndef MAGIO_CORE_SPIN_LOCK_H_
+#define MAGIO_CORE_SPIN_LOCK_H_
+
+#include <atomic>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#include "magio-v3/core/noncopyable.h"
+
+namespace magio {
+
+// For critical sections of a few instructions, usable with std::lock_guard
+class SpinLock: Noncopyable {
+    // pauses double every round until the waiter starts yielding its core
+    static constexpr size_t kPauseRounds = 6;
+
+public:
+    void lock() {
+        size_t round = 0;
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            while (flag_.test(std::memory_order_relaxed)) {
+                backoff(round++);
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !flag_.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock() {
+        flag_.clear(std::memory_order_release);
+    }
+
+private:
+    static void backoff(size_t round) {
+        if (round >= kPauseRounds) {
+            std::this_thread::yield();
+            return;
+        }
+        for (size_t i = 0; i < ((size_t)1 << round); ++i) {
+            pause();
+        }
+    }
+
+    // Tells the cpu this is a spin-wait loop, which lets a hyperthread sibling run
+    static void pause() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    std::atomic_flag flag_;
+};
+
+}
+
+#endif
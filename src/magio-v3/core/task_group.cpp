@@ -0,0 +1,87 @@
+#include "magio-v3/core/task_group.h"
+
+#include "magio-v3/core/logger.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+TaskGroup::TaskGroup()
+    : ctx_(LocalContext)
+{
+    if (ctx_ == nullptr) {
+        M_FATAL("{}", "TaskGroup must be created in a context");
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    cancel();
+    // children still running must not touch the group any more
+    for (Node* node = head_; node; node = node->next) {
+        node->group = nullptr;
+    }
+}
+
+Coro<> TaskGroup::wait() {
+    if (running_ != 0) {
+        co_await GetCoroutineHandle([this](std::coroutine_handle<> h) {
+            waiter_ = h;
+        });
+    }
+
+    if (eptr_) {
+        std::rethrow_exception(std::exchange(eptr_, nullptr));
+    }
+}
+
+void TaskGroup::cancel() {
+    cancelled_ = true;
+    for (Node* node = head_; node; node = node->next) {
+        cancel_node(node);
+    }
+}
+
+void TaskGroup::complete(Node* node, std::exception_ptr eptr) {
+    TaskGroup* group = node->group;
+    if (!group) {
+        release(node);
+        return;
+    }
+
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        group->head_ = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    }
+    release(node);
+    --group->running_;
+
+    if (eptr && !group->eptr_) {
+        group->eptr_ = eptr;
+        group->cancel();
+    }
+
+    if (group->running_ == 0 && group->waiter_) {
+        std::exchange(group->waiter_, nullptr).resume();
+    }
+}
+
+void TaskGroup::release(Node* node) {
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        detail::destroy(node, AllocCategory::Frame);
+    }
+}
+
+void TaskGroup::cancel_node(Node* node) {
+    detail::cancel_task(*node, [node] {
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+        return [node] {
+            release(node);
+        };
+    });
+}
+#endif
+
+}
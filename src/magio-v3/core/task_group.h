@@ -0,0 +1,77 @@
+#ifndef MAGIO_CORE_TASK_GROUP_H_
+#define MAGIO_CORE_TASK_GROUP_H_
+
+#include "magio-v3/core/coro_context.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+// Owns the coroutines spawned through it.
+// When one of them throws, or the group is destroyed, the remaining ones are cancelled:
+// their in-flight io completes with operation_canceled, new io fails immediately and sleeps end early.
+// A group must be used in the context it was created in, its coroutines may move to other ones.
+class TaskGroup: Noncopyable {
+public:
+    TaskGroup();
+
+    ~TaskGroup();
+
+    template<typename T>
+    void spawn(Coro<T> coro, std::source_location loc = std::source_location::current()) {
+        auto node = detail::make<Node>(AllocCategory::Frame);
+        node->group = this;
+        node->cancelled = cancelled_;
+        node->next = head_;
+        if (head_) {
+            head_->prev = node;
+        }
+        head_ = node;
+        ++running_;
+
+        coro.handle().promise().cancel_state = node;
+        ctx_->spawn(coro, [node](std::exception_ptr eptr, auto&&) {
+            complete(node, eptr);
+        }, loc);
+    }
+
+    // Waits for all spawned coroutines, then rethrows the first exception if any
+    [[nodiscard]]
+    Coro<> wait();
+
+    void cancel();
+
+    bool is_cancelled() const {
+        return cancelled_;
+    }
+
+    size_t running() const {
+        return running_;
+    }
+
+private:
+    struct Node: detail::CancelState {
+        TaskGroup* group = nullptr;
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        // the child and the cancellations running in other contexts
+        std::atomic<size_t> refs{1};
+    };
+
+    static void complete(Node* node, std::exception_ptr eptr);
+
+    static void release(Node* node);
+
+    void cancel_node(Node* node);
+
+    CoroContext* ctx_;
+    Node* head_ = nullptr;
+    size_t running_ = 0;
+    bool cancelled_ = false;
+    std::exception_ptr eptr_;
+    std::coroutine_handle<> waiter_;
+};
+#endif
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define MAGIO_CORE_THIS_CONTEXT_H_
 
 #include <chrono>
+#include <source_location>
 
 #include "magio-v3/core/unit.h"
 #include "magio-v3/core/io_service.h"
@@ -52,19 +53,22 @@ void start();
 
 void stop();
 
+void shutdown(const TimerClock::time_point& deadline);
+
 void execute(Task&& task);
 
 void dispatch(Task&& task);
 
 #ifdef MAGIO_USE_CORO
+// loc is where the task was spawned from, for magio::trace
 template<typename T>
-void spawn(Coro<T> coro);
+void spawn(Coro<T> coro, std::source_location loc = std::source_location::current());
 
 template<typename T>
 void spawn(Coro<T> coro, detail::UseCoro);
 
 template<typename T>
-void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler);
+void spawn(Coro<T> coro, CoroCompletionHandler<T>&& handler, std::source_location loc = std::source_location::current());
 
 void wake_in_context(std::coroutine_handle<> h);
 
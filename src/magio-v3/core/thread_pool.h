@@ -45,6 +45,10 @@ public:
 
     void execute(Task&& task) override;
 
+    size_t thread_num() const {
+        return threads_.size();
+    }
+
     template<typename Cb, typename Func, typename...Args>
     void async(Cb&& cb, Func&& func, Args&&...args) {
         auto ctx = LocalContext;
@@ -6,6 +6,7 @@
 #include <chrono>
 #include <functional>
 
+#include "magio-v3/core/allocator.h"
 #include "magio-v3/core/noncopyable.h"
 
 namespace magio {
@@ -14,13 +15,15 @@ using TimerClock = std::chrono::steady_clock;
 using TimerTask = std::function<void(bool)>;
 
 struct TimerData {
-    TimerData(TimerClock::time_point tp, TimerTask&& f)
-        : dead_line(tp), task(std::move(f)) 
+    TimerData(TimerClock::time_point tp, TimerTask&& f, size_t* live)
+        : dead_line(tp), task(std::move(f)), live(live)
     { }
 
     bool flag = true;
     TimerClock::time_point dead_line;
     TimerTask task;
+    // the live count of the owning queue, which outlives the data
+    size_t* live;
 };
 
 class TimerHandle {
@@ -28,10 +31,12 @@ public:
     TimerHandle(const std::shared_ptr<TimerData>& p)
         : pdata_(p) { }
 
+    // false if the timer has already fired or been cancelled
     bool cancel() {
         auto p = pdata_.lock();
-        if (p) {
+        if (p && p->flag) {
             p->flag = false;
+            --*p->live;
             p->task(false);
             return true;
         }
@@ -55,22 +60,27 @@ class TimerQueue: Noncopyable {
 public:
     using QueueType = std::priority_queue<
         std::shared_ptr<TimerData>,
-        std::vector<std::shared_ptr<TimerData>>,
+        std::vector<std::shared_ptr<TimerData>, detail::CategoryAllocator<std::shared_ptr<TimerData>, AllocCategory::Timer>>,
         TimerCompare
     >;
 
     ~TimerQueue() {
         while (!timers_.empty()) {
-            timers_.top()->task(false);
+            // cancelled ones have been told already
+            if (timers_.top()->flag) {
+                timers_.top()->task(false);
+            }
             timers_.pop();
         }
     }
 
-    void get_expired(std::vector<TimerTask>& result) {
+    template<typename Vector>
+    void get_expired(Vector& result) {
         auto current_tp = TimerClock::now();
 
         for (; !timers_.empty() && current_tp >= timers_.top()->dead_line;) {
             if (timers_.top()->flag == true) {
+                --live_;
                 result.push_back(std::move(timers_.top()->task));
             }
             timers_.pop();
@@ -78,7 +88,8 @@ public:
     }
 
     TimerHandle push(const TimerClock::time_point& tp, TimerTask&& task) {
-        auto ptimer = std::make_shared<TimerData>(tp, std::move(task));
+        auto ptimer = std::allocate_shared<TimerData>(detail::CategoryAllocator<TimerData, AllocCategory::Timer>{}, tp, std::move(task), &live_);
+        ++live_;
         TimerHandle handle(ptimer);
         timers_.emplace(std::move(ptimer));
         return handle;
@@ -88,8 +99,18 @@ public:
         return timers_.empty();
     }
 
+    size_t size() const {
+        return timers_.size();
+    }
+
+    // timers neither fired nor cancelled, size() counts cancelled ones until their deadline
+    size_t live() const {
+        return live_;
+    }
+
 private:
     QueueType timers_;
+    size_t live_ = 0;
 };
 
 }
@@ -0,0 +1,575 @@
+#include "magio-v3/core/trace.h"
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "magio-v3/core/logger.h"
+#include "magio-v3/core/spin_lock.h"
+#include "magio-v3/core/io_context.h"
+#include "magio-v3/core/coro_context.h"
+#include "magio-v3/core/current_thread.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace magio {
+
+namespace detail {
+
+// Intrusive list of the spawned coroutines alive, the lock is only contended
+// when a coroutine finishes on another thread than the one it started on.
+// Taken before the chain_lock of a root
+struct RootList {
+    SpinLock lock;
+    CoroTrace* head = nullptr;
+};
+
+}
+
+namespace trace {
+
+namespace {
+
+struct Event {
+    const SpawnSite* site;
+    uint64_t task;
+    uint64_t coro;
+    int64_t begin;
+    int64_t end;
+};
+
+struct ThreadTrace {
+    size_t thread_id = CurrentThread::get_id();
+    // the innermost resume on this thread, only touched by the thread itself
+    detail::CoroTrace* current = nullptr;
+
+    // read by the watchdog, when the outermost resume began or zero
+    std::atomic<int64_t> running_since{0};
+    std::atomic<const SpawnSite*> running_site{nullptr};
+    std::atomic<uint64_t> running_task{0};
+    std::atomic<uint64_t> running_coro{0};
+
+    // ring of the last resumes, allocated on the first one
+    SpinLock lock;
+    std::vector<Event> events;
+    size_t next = 0;
+
+    detail::RootList roots;
+};
+
+struct State {
+    std::mutex m;
+    // threads that exit keep their events until the next start
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+    std::unordered_map<std::string, const SpawnSite*> sites;
+    Options options;
+    bool stopping = false;
+    std::condition_variable cv;
+    std::thread watchdog;
+
+    // separate from m, execute() creates a coroutine which may register its thread
+    std::mutex contexts_m;
+    std::vector<CoroContext*> contexts;
+};
+
+std::atomic<bool> g_enabled{false};
+std::atomic<size_t> g_events_per_thread{0};
+#ifdef __linux__
+// written by the signal handler of dump_stacks_on, read by the thread dumping
+int g_dump_pipe[2] = {-1, -1};
+#endif
+
+State& state() {
+    // never destroyed, threads may still resume coroutines while statics go away
+    static State* state = new State;
+    return *state;
+}
+
+ThreadTrace& local() {
+    static thread_local ThreadTrace* local = nullptr;
+    if (!local) {
+        auto tt = std::make_shared<ThreadTrace>();
+        auto& s = state();
+        std::lock_guard lk(s.m);
+        s.threads.push_back(tt);
+        local = tt.get();
+    }
+    return *local;
+}
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(ThreadTrace& tt, const Event& event) {
+    std::lock_guard lk(tt.lock);
+    if (tt.events.size() < g_events_per_thread.load(std::memory_order_relaxed)) {
+        tt.events.push_back(event);
+    } else if (!tt.events.empty()) {
+        tt.events[tt.next] = event;
+        tt.next = (tt.next + 1) % tt.events.size();
+    }
+}
+
+void log_stall(const Stall& stall) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(stall.running).count();
+    if (stall.site) {
+        auto& loc = stall.site->location;
+        M_ERROR("coroutine {} of task {} has been running on thread {} for {}ms, the task was spawned at {}:{} in {}",
+            stall.coro, stall.task, stall.thread_id, ms, loc.file_name(), loc.line(), loc.function_name());
+    } else {
+        M_ERROR("coroutine {} of task {} has been running on thread {} for {}ms, the task was not spawned",
+            stall.coro, stall.task, stall.thread_id, ms);
+    }
+}
+
+// Reports every resume once, when it has run for longer than the threshold
+void watch() {
+    auto& s = state();
+    auto threshold = s.options.stall_threshold;
+    auto on_stall = s.options.on_stall ? s.options.on_stall : log_stall;
+    std::chrono::nanoseconds period = std::max<std::chrono::nanoseconds>(threshold / 4, std::chrono::milliseconds(1));
+    std::unordered_map<ThreadTrace*, int64_t> reported;
+
+    std::unique_lock lk(s.m);
+    while (!s.cv.wait_for(lk, period, [&s] { return s.stopping; })) {
+        auto threads = s.threads;
+        lk.unlock();
+        int64_t t = now();
+        for (auto& tt : threads) {
+            int64_t since = tt->running_since.load(std::memory_order_acquire);
+            if (since == 0 || since == reported[tt.get()] || t - since < threshold.count()) {
+                continue;
+            }
+            reported[tt.get()] = since;
+            Stall stall{
+                .thread_id = tt->thread_id,
+                .site = tt->running_site.load(std::memory_order_relaxed),
+                .task = tt->running_task.load(std::memory_order_relaxed),
+                .coro = tt->running_coro.load(std::memory_order_relaxed),
+                .running = std::chrono::nanoseconds(t - since),
+            };
+            on_stall(stall);
+        }
+        lk.lock();
+    }
+}
+
+const char* operation_name(Operation op) {
+    switch (op) {
+    case Operation::WakeUp: return "WakeUp";
+    case Operation::ReadFile: return "ReadFile";
+    case Operation::WriteFile: return "WriteFile";
+    case Operation::ReadFileVectored: return "ReadFileVectored";
+    case Operation::Accept: return "Accept";
+    case Operation::Connect: return "Connect";
+    case Operation::Receive: return "Receive";
+    case Operation::Send: return "Send";
+    case Operation::Cancel: return "Cancel";
+    case Operation::OpenFile: return "OpenFile";
+    case Operation::StatFile: return "StatFile";
+    case Operation::CloseFile: return "CloseFile";
+    case Operation::SyncFile: return "SyncFile";
+    case Operation::AllocateFile: return "AllocateFile";
+    case Operation::SyncFileRange: return "SyncFileRange";
+    case Operation::AdviseMemory: return "AdviseMemory";
+    }
+    return "Unknown";
+}
+
+// One line per coroutine, from the root down to the one suspended on something else than a coroutine
+void append_stack(std::string& out, const detail::CoroTrace& root, int64_t t) {
+    if (root.site) {
+        auto& loc = root.site->location;
+        fmt::format_to(std::back_inserter(out), "task {} spawned at {}:{} in {}\n",
+            root.task, loc.file_name(), loc.line(), loc.function_name());
+    } else if (root.task != root.coro) {
+        fmt::format_to(std::back_inserter(out), "task {}, spawned internally\n", root.task);
+    } else {
+        fmt::format_to(std::back_inserter(out), "task {}\n", root.task);
+    }
+
+    for (auto frame = &root; frame; frame = frame->awaiting) {
+        if (frame->suspended_at == 0) {
+            fmt::format_to(std::back_inserter(out), "    coro {} running\n", frame->coro);
+            continue;
+        }
+        auto& loc = frame->await_site;
+        fmt::format_to(std::back_inserter(out), "    coro {} suspended for {:.3f}s at {}:{} in {}",
+            frame->coro, (t - frame->suspended_at) / 1e9, loc.file_name(), loc.line(), loc.function_name());
+        if (!frame->awaiting && frame->pending_io) {
+            fmt::format_to(std::back_inserter(out), ", waiting for {}", operation_name(frame->pending_io->op));
+        }
+        out += "\n";
+    }
+}
+
+void append_escaped(std::string& out, std::string_view str) {
+    for (char ch : str) {
+        switch (ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            if ((unsigned char)ch < 0x20) {
+                fmt::format_to(std::back_inserter(out), "\\u{:04x}", (int)ch);
+            } else {
+                out += ch;
+            }
+        }
+    }
+}
+
+}
+
+void start(Options options) {
+#ifndef MAGIO_TRACE
+    M_WARN("{}", "magio is built without MAGIO_TRACE, coroutines are not traced");
+#endif
+    auto& s = state();
+    std::lock_guard lk(s.m);
+    if (g_enabled.load(std::memory_order_relaxed)) {
+        M_FATAL("{}", "Tracing has already been started");
+    }
+    for (auto& tt : s.threads) {
+        std::lock_guard tlk(tt->lock);
+        tt->events.clear();
+        tt->next = 0;
+    }
+    s.options = std::move(options);
+    s.stopping = false;
+    g_events_per_thread.store(s.options.events_per_thread, std::memory_order_relaxed);
+    g_enabled.store(true, std::memory_order_relaxed);
+    if (s.options.stall_threshold.count() > 0) {
+        s.watchdog = std::thread(watch);
+    }
+}
+
+void stop() {
+    auto& s = state();
+    std::thread watchdog;
+    {
+        std::lock_guard lk(s.m);
+        g_enabled.store(false, std::memory_order_relaxed);
+        s.stopping = true;
+        watchdog = std::move(s.watchdog);
+    }
+    s.cv.notify_all();
+    if (watchdog.joinable()) {
+        watchdog.join();
+    }
+}
+
+std::string chrome_trace(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    int64_t from = std::chrono::duration_cast<std::chrono::nanoseconds>(begin.time_since_epoch()).count();
+    int64_t to = std::chrono::duration_cast<std::chrono::nanoseconds>(end.time_since_epoch()).count();
+
+    std::vector<std::pair<size_t, Event>> events;
+    {
+        auto& s = state();
+        std::lock_guard lk(s.m);
+        for (auto& tt : s.threads) {
+            std::lock_guard tlk(tt->lock);
+            for (auto& event : tt->events) {
+                if (event.end > from && event.begin < to) {
+                    events.emplace_back(tt->thread_id, event);
+                }
+            }
+        }
+    }
+
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    for (auto& [tid, event] : events) {
+        out += first ? "\n" : ",\n";
+        first = false;
+        out += "{\"name\":\"";
+        if (event.site) {
+            auto& loc = event.site->location;
+            append_escaped(out, loc.file_name());
+            fmt::format_to(std::back_inserter(out), ":{}", loc.line());
+        } else {
+            out += "coroutine";
+        }
+        // ts and dur are in microseconds
+        fmt::format_to(std::back_inserter(out), "\",\"cat\":\"coro\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{},",
+            event.begin / 1000.0, (event.end - event.begin) / 1000.0, tid);
+        fmt::format_to(std::back_inserter(out), "\"args\":{{\"task\":{},\"coro\":{}", event.task, event.coro);
+        if (event.site) {
+            out += ",\"function\":\"";
+            append_escaped(out, event.site->location.function_name());
+            out += "\"";
+        }
+        out += "}}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+std::string stacks() {
+    auto& tt = local();
+    int64_t t = now();
+    std::string out;
+    std::lock_guard lk(tt.roots.lock);
+    for (auto root = tt.roots.head; root; root = root->next_root) {
+        // coroutines of the chain may be resumed on other threads, e.g. after this_coro::resume_on
+        std::lock_guard chain_lk(root->chain_lock);
+        append_stack(out, *root, t);
+    }
+    return out;
+}
+
+void dump_stacks() {
+    auto& s = state();
+    std::lock_guard lk(s.contexts_m);
+    for (auto ctx : s.contexts) {
+        ctx->execute([] {
+            auto str = stacks();
+            M_INFO("async stacks of thread {}:\n{}", CurrentThread::get_id(), str.empty() ? "no tasks\n" : str);
+        });
+    }
+}
+
+void dump_stacks_on(int signo) {
+#ifndef MAGIO_TRACE
+    M_WARN("{}", "magio is built without MAGIO_TRACE, there are no stacks to dump");
+#endif
+#ifdef _WIN32
+    // windows runs handlers on a thread of their own, which may lock, and resets them to the default
+    static void(*handler)(int) = [](int signo) {
+        std::signal(signo, handler);
+        dump_stacks();
+    };
+    std::signal(signo, handler);
+#elif defined (__linux__)
+    // the handler may only write to a pipe, a thread blocked on reading it does the dump
+    static std::once_flag once;
+    std::call_once(once, [] {
+        if (-1 == ::pipe(g_dump_pipe)) {
+            M_SYS_ERROR("cannot create the pipe of dump_stacks_on: {}", std::error_code(errno, std::system_category()).message());
+            return;
+        }
+        std::thread([] {
+            for (; ;) {
+                char ch;
+                ssize_t r = ::read(g_dump_pipe[0], &ch, 1);
+                if (r == 1) {
+                    dump_stacks();
+                } else if (r == -1 && errno != EINTR) {
+                    return;
+                }
+            }
+        }).detach();
+    });
+    std::signal(signo, [](int) {
+        int saved = errno;
+        char ch = 0;
+        [[maybe_unused]] auto r = ::write(g_dump_pipe[1], &ch, 1);
+        errno = saved;
+    });
+#endif
+}
+
+const SpawnSite* intern(const std::source_location& location) {
+    // file names of one translation unit share a pointer
+    using Key = std::tuple<const char*, uint_least32_t, uint_least32_t>;
+    static thread_local std::map<Key, const SpawnSite*> cache;
+
+    Key key{location.file_name(), location.line(), location.column()};
+    if (auto it = cache.find(key); it != cache.end()) {
+        return it->second;
+    }
+
+    auto& s = state();
+    std::lock_guard lk(s.m);
+    auto [it, created] = s.sites.try_emplace(fmt::format("{}:{}:{}", location.file_name(), location.line(), location.column()));
+    if (created) {
+        it->second = new SpawnSite{location};
+    }
+    cache.emplace(key, it->second);
+    return it->second;
+}
+
+}
+
+namespace detail {
+
+void init_trace(CoroTrace& trace, uint64_t coro) {
+    trace.coro = coro;
+    if (auto creator = trace::local().current) {
+        trace.site = creator->site;
+        trace.task = creator->task;
+    } else {
+        trace.task = coro;
+    }
+}
+
+void set_spawn_site(CoroTrace& trace, const std::source_location& location) {
+    trace.root = true;
+    trace.chain_root = &trace;
+    if (location.line() != 0) {
+        trace.site = trace::intern(location);
+        trace.task = trace.coro;
+    }
+}
+
+namespace {
+
+// Locks the chain trace is part of, if any
+class ChainGuard: Noncopyable {
+public:
+    ChainGuard(CoroTrace& trace)
+        : lock_(trace.chain_root ? &trace.chain_root->chain_lock : nullptr)
+    {
+        if (lock_) {
+            lock_->lock();
+        }
+    }
+
+    ~ChainGuard() {
+        if (lock_) {
+            lock_->unlock();
+        }
+    }
+
+private:
+    SpinLock* lock_;
+};
+
+void unlink_root(CoroTrace& trace) {
+    auto roots = trace.roots;
+    std::lock_guard lk(roots->lock);
+    if (trace.prev_root) {
+        trace.prev_root->next_root = trace.next_root;
+    } else {
+        roots->head = trace.next_root;
+    }
+    if (trace.next_root) {
+        trace.next_root->prev_root = trace.prev_root;
+    }
+    trace.prev_root = nullptr;
+    trace.next_root = nullptr;
+    trace.roots = nullptr;
+}
+
+}
+
+void set_trace_io(CoroTrace& trace, IoContext& ioc) {
+    ChainGuard lk(trace);
+    trace.pending_io = &ioc;
+}
+
+void await_trace(CoroTrace& awaiter, CoroTrace& awaited) {
+    // set before awaited first runs, which happens after a handover to the run queue
+    awaited.chain_root = awaiter.chain_root;
+    ChainGuard lk(awaiter);
+    awaiter.awaiting = &awaited;
+}
+
+void begin_resume(CoroTrace& trace) {
+    auto& tt = trace::local();
+    trace.resumer = tt.current;
+    tt.current = &trace;
+    {
+        ChainGuard lk(trace);
+        trace.suspended_at = 0;
+        trace.pending_io = nullptr;
+        trace.awaiting = nullptr;
+    }
+    if (trace.root && trace.roots != &tt.roots) {
+        // resumed for the first time, or on another thread after this_coro::resume_on
+        if (trace.roots) {
+            unlink_root(trace);
+        }
+        std::lock_guard lk(tt.roots.lock);
+        trace.roots = &tt.roots;
+        trace.next_root = tt.roots.head;
+        if (tt.roots.head) {
+            tt.roots.head->prev_root = &trace;
+        }
+        tt.roots.head = &trace;
+    }
+    if (!trace::g_enabled.load(std::memory_order_relaxed)) {
+        trace.resumed_at = 0;
+        return;
+    }
+
+    trace.resumed_at = trace::now();
+    tt.running_site.store(trace.site, std::memory_order_relaxed);
+    tt.running_task.store(trace.task, std::memory_order_relaxed);
+    tt.running_coro.store(trace.coro, std::memory_order_relaxed);
+    if (!trace.resumer) {
+        tt.running_since.store(trace.resumed_at, std::memory_order_release);
+    }
+}
+
+void end_resume(CoroTrace& trace, const std::source_location& site) {
+    auto& tt = trace::local();
+    tt.current = trace.resumer;
+    {
+        ChainGuard lk(trace);
+        trace.await_site = site;
+        trace.suspended_at = trace::now();
+    }
+    if (trace.resumed_at == 0) {
+        return;
+    }
+
+    if (trace::g_enabled.load(std::memory_order_relaxed)) {
+        trace::record(tt, {trace.site, trace.task, trace.coro, trace.resumed_at, trace.suspended_at});
+    }
+    if (auto resumer = trace.resumer) {
+        tt.running_site.store(resumer->site, std::memory_order_relaxed);
+        tt.running_task.store(resumer->task, std::memory_order_relaxed);
+        tt.running_coro.store(resumer->coro, std::memory_order_relaxed);
+    } else {
+        tt.running_since.store(0, std::memory_order_relaxed);
+    }
+}
+
+void end_trace(CoroTrace& trace) {
+    end_resume(trace, trace.await_site);
+    if (!trace.root && trace.chain_root) {
+        // the frame is destroyed before its awaiter resumes, stacks() must not reach it meanwhile
+        ChainGuard lk(trace);
+        for (auto frame = trace.chain_root; frame; frame = frame->awaiting) {
+            if (frame->awaiting == &trace) {
+                frame->awaiting = nullptr;
+                break;
+            }
+        }
+    }
+    if (trace.roots) {
+        unlink_root(trace);
+    }
+}
+
+void add_context(CoroContext* ctx) {
+    auto& s = trace::state();
+    std::lock_guard lk(s.contexts_m);
+    s.contexts.push_back(ctx);
+}
+
+void remove_context(CoroContext* ctx) {
+    auto& s = trace::state();
+    std::lock_guard lk(s.contexts_m);
+    std::erase(s.contexts, ctx);
+}
+
+}
+
+}
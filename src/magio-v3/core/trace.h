@@ -0,0 +1,217 @@
+#ifndef MAGIO_CORE_TRACE_H_
+#define MAGIO_CORE_TRACE_H_
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <coroutine>
+#include <functional>
+#include <source_location>
+
+#include "magio-v3/core/spin_lock.h"
+
+namespace magio {
+
+class CoroContext;
+
+struct IoContext;
+
+namespace trace {
+
+// Where a task was spawned. Interned, the pointer stays valid for the life of the process
+struct SpawnSite {
+    std::source_location location;
+};
+
+struct Stall {
+    size_t thread_id;
+    // nullptr for coroutines that did not come from a spawn
+    const SpawnSite* site;
+    // the id of the coroutine the task was spawned with
+    uint64_t task;
+    // the coroutine running when the stall was noticed
+    uint64_t coro;
+    std::chrono::nanoseconds running;
+};
+
+struct Options {
+    // A resume running longer than this is reported, zero leaves the watchdog off
+    std::chrono::nanoseconds stall_threshold{0};
+    // Called on the watchdog thread, stalls are logged as errors without it
+    std::function<void(const Stall&)> on_stall;
+    // Resumes kept per thread, the oldest ones are overwritten
+    size_t events_per_thread = 64 * 1024;
+};
+
+// Coroutines are only instrumented when magio is built with MAGIO_TRACE (xmake f --trace=y),
+// otherwise start logs a warning and nothing is recorded.
+// Every resume of a coroutine up to its next suspension is recorded with the site of the
+// spawn its task came from, the watchdog flags resumes that keep a thread for too long
+void start(Options options = {});
+
+void stop();
+
+// Resumes that overlap [begin, end) as Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev
+std::string chrome_trace(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+const SpawnSite* intern(const std::source_location& location);
+
+// The async stacks of the tasks spawned in the calling thread's context: every spawned coroutine
+// that is still alive, followed by the chain of coroutines it awaits, each with where it is suspended,
+// for how long and the io operation it waits for. Empty without MAGIO_TRACE.
+// A chain is read under the lock of its root, so parts of it may run on other threads meanwhile
+std::string stacks();
+
+// Every context logs its stacks() from its own thread the next time its loop runs
+void dump_stacks();
+
+// Calls dump_stacks() whenever the process receives signo, e.g. SIGUSR1 for kill -USR1 <pid>.
+// A helper thread sleeps until then
+void dump_stacks_on(int signo);
+
+}
+
+namespace detail {
+
+struct RootList;
+
+// Per coroutine, lives in the promise
+struct CoroTrace {
+    const trace::SpawnSite* site = nullptr;
+    uint64_t task = 0;
+    uint64_t coro = 0;
+    int64_t resumed_at = 0;
+    // the resume this one runs inside of, if it was resumed directly by another coroutine
+    CoroTrace* resumer = nullptr;
+
+    // while suspended, written under chain_root->chain_lock since stacks() reads them from any thread
+    int64_t suspended_at = 0;
+    std::source_location await_site;
+    IoContext* pending_io = nullptr;
+    // the coroutine this one awaits
+    CoroTrace* awaiting = nullptr;
+
+    // the root whose chain of awaited coroutines this one is part of, nullptr if none
+    CoroTrace* chain_root = nullptr;
+    SpinLock chain_lock;
+
+    // spawned coroutines are listed by the thread they run on
+    bool root = false;
+    RootList* roots = nullptr;
+    CoroTrace* prev_root = nullptr;
+    CoroTrace* next_root = nullptr;
+};
+
+// Set while a coroutine is suspending on io, so the io service can tell it what it waits for
+inline thread_local CoroTrace* SuspendingTrace = nullptr;
+
+void set_trace_io(CoroTrace& trace, IoContext& ioc);
+
+// Called by the io services for every operation they start, compiled out without MAGIO_TRACE
+inline void set_pending_io(IoContext& ioc) {
+#ifdef MAGIO_TRACE
+    if (SuspendingTrace) {
+        set_trace_io(*SuspendingTrace, ioc);
+    }
+#endif
+}
+
+// A new coroutine belongs to the task of the coroutine creating it
+void init_trace(CoroTrace& trace, uint64_t coro);
+
+// Makes the coroutine a root, a default constructed location keeps the task it was created in
+void set_spawn_site(CoroTrace& trace, const std::source_location& location);
+
+// awaiter suspends until awaited finishes, which joins its chain
+void await_trace(CoroTrace& awaiter, CoroTrace& awaited);
+
+void begin_resume(CoroTrace& trace);
+
+// The coroutine suspends at site
+void end_resume(CoroTrace& trace, const std::source_location& site);
+
+// The coroutine reached its final suspend
+void end_trace(CoroTrace& trace);
+
+void add_context(CoroContext* ctx);
+
+void remove_context(CoroContext* ctx);
+
+template<typename Awaitable>
+decltype(auto) get_awaiter(Awaitable&& a) {
+    if constexpr (requires { std::forward<Awaitable>(a).operator co_await(); }) {
+        return std::forward<Awaitable>(a).operator co_await();
+    } else if constexpr (requires { operator co_await(std::forward<Awaitable>(a)); }) {
+        return operator co_await(std::forward<Awaitable>(a));
+    } else {
+        return std::forward<Awaitable>(a);
+    }
+}
+
+// Wraps every co_await of a traced coroutine, the resume ends before the coroutine is handed over
+// since it may run on another thread or finish before await_suspend returns
+template<typename Awaiter>
+struct TracedAwaiter {
+    // a reference when the operand is an awaiter itself
+    Awaiter awaiter;
+    CoroTrace& trace;
+    std::source_location site;
+    bool ready = false;
+
+    bool await_ready() {
+        ready = awaiter.await_ready();
+        return ready;
+    }
+
+    template<typename Promise>
+    auto await_suspend(std::coroutine_handle<Promise> h) {
+        end_resume(trace, site);
+        try {
+            return awaiter.await_suspend(h);
+        } catch (...) {
+            // the coroutine goes on running
+            begin_resume(trace);
+            throw;
+        }
+    }
+
+    decltype(auto) await_resume() {
+        if (!ready) {
+            begin_resume(trace);
+        }
+        return awaiter.await_resume();
+    }
+};
+
+template<typename Awaitable>
+auto traced(Awaitable&& a, CoroTrace& trace, const std::source_location& site) {
+    using Awaiter = decltype(get_awaiter(std::forward<Awaitable>(a)));
+    return TracedAwaiter<Awaiter>{get_awaiter(std::forward<Awaitable>(a)), trace, site};
+}
+
+class TracedInitialSuspend {
+public:
+    TracedInitialSuspend(CoroTrace& trace)
+        : trace_(trace)
+    { }
+
+    bool await_ready() {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<>) { }
+
+    void await_resume() {
+        begin_resume(trace_);
+    }
+
+private:
+    CoroTrace& trace_;
+};
+
+}
+
+}
+
+#endif
@@ -2,40 +2,73 @@
 #define MAGIO_CORE_WAIT_GROUP_H_
 
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 
+#include "magio-v3/core/event.h"
+
 namespace magio {
 
+// wait() blocks the calling thread, coroutines should co_await async_wait() instead
 class WaitGroup {
 public:
-    WaitGroup(size_t task_num)
+    WaitGroup(size_t task_num = 0)
         : wait_num_(task_num)
+#ifdef MAGIO_USE_CORO
+        , event_(task_num == 0)
+#endif
     { }
 
-    void done() {
-        std::lock_guard lk(m_);
-        if (wait_num_ == 0) {
-            return;
+    void add(size_t n = 1) {
+        if (wait_num_.fetch_add(n, std::memory_order_relaxed) == 0) {
+#ifdef MAGIO_USE_CORO
+            event_.reset();
+#endif
         }
+    }
+
+    void done() {
+        size_t num = wait_num_.load(std::memory_order_relaxed);
+        do {
+            if (num == 0) {
+                return;
+            }
+        } while (!wait_num_.compare_exchange_weak(num, num - 1, std::memory_order_acq_rel, std::memory_order_relaxed));
 
-        --wait_num_;
-        if (wait_num_ == 0) {
-            cv_.notify_all();
+        if (num == 1) {
+            {
+                std::lock_guard lk(m_);
+                cv_.notify_all();
+            }
+#ifdef MAGIO_USE_CORO
+            event_.set();
+#endif
         }
     }
 
     void wait() {
         std::unique_lock lk(m_);
         cv_.wait(lk, [this] {
-            return wait_num_ == 0;
+            return wait_num_.load(std::memory_order_acquire) == 0;
         });
     }
+
+#ifdef MAGIO_USE_CORO
+    [[nodiscard]]
+    detail::Event::Awaitable async_wait() {
+        return event_.wait();
+    }
+#endif
+
 private:
     std::mutex m_;
-    size_t wait_num_;
+    std::atomic<size_t> wait_num_;
     std::condition_variable cv_;
+#ifdef MAGIO_USE_CORO
+    detail::Event event_;
+#endif
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
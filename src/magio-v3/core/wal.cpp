@@ -0,0 +1,326 @@
+#include "magio-v3/core/wal.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MAGIO_WAL_SSE42
+#include <nmmintrin.h>
+#endif
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+namespace {
+
+constexpr size_t kWalReadSize = 64 * 1024;
+
+// castagnoli, reflected
+constexpr uint32_t kCrc32cPoly = 0x82f63b78;
+
+constexpr std::array<uint32_t, 256> make_crc_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc >> 1) ^ (crc & 1 ? kCrc32cPoly : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr auto kCrcTable = make_crc_table();
+
+uint32_t crc32c_scalar(uint32_t crc, const char* p, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        crc = kCrcTable[(crc ^ (unsigned char)p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef MAGIO_WAL_SSE42
+bool has_sse42() {
+    static const bool value = __builtin_cpu_supports("sse4.2");
+    return value;
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const char* p, size_t len) {
+    uint64_t crc64 = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = (uint32_t)crc64;
+    for (; len != 0; ++p, --len) {
+        crc = _mm_crc32_u8(crc, (unsigned char)*p);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const char* p, size_t len) {
+#ifdef MAGIO_WAL_SSE42
+    if (has_sse42()) {
+        return crc32c_sse42(crc, p, len);
+    }
+#endif
+    return crc32c_scalar(crc, p, len);
+}
+
+void store32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = (char)(v >> (8 * i));
+    }
+}
+
+uint32_t load32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        v |= (uint32_t)(unsigned char)p[i] << (8 * i);
+    }
+    return v;
+}
+
+uint32_t record_crc(std::string_view payload) {
+    char len[4];
+    store32(len, (uint32_t)payload.size());
+    uint32_t crc = crc32c(~0u, len, sizeof(len));
+    return ~crc32c(crc, payload.data(), payload.size());
+}
+
+}
+
+void Wal::CommitAwaitable::await_suspend(std::coroutine_handle<> prev_h) {
+    commit.ctx = LocalContext;
+    commit.handle = prev_h;
+}
+
+Wal::Wal()
+    : Wal(Options{})
+{ }
+
+Wal::Wal(Options options)
+    : options_(options)
+{ }
+
+Coro<> Wal::open(const char* path, std::error_code& ec) {
+    co_await file_.open(path, RandomAccessFile::ReadWrite | RandomAccessFile::Create, ec, 0644);
+    if (ec) {
+        co_return;
+    }
+
+    WalReader reader;
+    co_await reader.open(path, ec);
+    while (!ec) {
+        auto record = co_await reader.next(ec);
+        if (!record) {
+            break;
+        }
+    }
+    uint64_t end = reader.offset();
+
+    FileStat st;
+    if (!ec) {
+        st = co_await file_.stat(ec);
+    }
+    if (!ec && st.size > end) {
+        // drops a torn tail and the space preallocated by the last run
+        std::filesystem::resize_file(path, end, ec);
+    }
+    if (ec) {
+        file_.close();
+        co_return;
+    }
+
+    next_offset_ = end;
+    allocated_ = end;
+    failed_.clear();
+}
+
+Coro<uint64_t> Wal::append(std::string_view record, std::error_code& ec) {
+    if (failed_) {
+        ec = failed_;
+        co_return 0;
+    }
+    if (!file_) {
+        ec = std::make_error_code(std::errc::bad_file_descriptor);
+        co_return 0;
+    }
+    if (record.size() > kMaxWalRecord) {
+        ec = std::make_error_code(std::errc::message_size);
+        co_return 0;
+    }
+
+    if (pending_.size() == 0) {
+        group_start_ = TimerClock::now();
+    }
+    uint64_t offset = end();
+    auto span = pending_.prepare(kWalHeaderSize + record.size());
+    store32(span.data(), (uint32_t)record.size());
+    store32(span.data() + 4, record_crc(record));
+    std::memcpy(span.data() + kWalHeaderSize, record.data(), record.size());
+    pending_.commit(kWalHeaderSize + record.size());
+    ++stats_.records;
+    stats_.bytes += kWalHeaderSize + record.size();
+
+    Commit commit;
+    if (tail_) {
+        tail_->next = &commit;
+    } else {
+        head_ = &commit;
+    }
+    tail_ = &commit;
+    if (pending_.size() >= options_.max_batch_bytes) {
+        window_.set();
+    }
+
+    if (flushing_) {
+        co_await CommitAwaitable{commit};
+        if (!commit.lead) {
+            ec = commit.ec;
+            co_return offset;
+        }
+        // the group before was the last one in flight, this group is ours to write
+        commit.handle = nullptr;
+    } else {
+        flushing_ = true;
+        idle_.reset();
+    }
+
+    co_await lead();
+    ec = commit.ec;
+    co_return offset;
+}
+
+Coro<> Wal::close(std::error_code& ec) {
+    co_await idle_.wait();
+    co_await file_.close(ec);
+}
+
+Coro<> Wal::lead() {
+    co_await wait_window();
+
+    pending_.swap(writing_);
+    Commit* group = head_;
+    head_ = tail_ = nullptr;
+    uint64_t offset = next_offset_;
+    next_offset_ += writing_.size();
+
+    std::error_code ec = failed_;
+    if (!ec) {
+        co_await write_group(offset, ec);
+        if (ec) {
+            failed_ = ec;
+        }
+    }
+    writing_.clear();
+    ++stats_.groups;
+
+    while (group) {
+        // the commit may be gone as soon as it is queued
+        Commit* next = group->next;
+        group->ec = ec;
+        // the leader itself is not suspended
+        if (group->handle) {
+            group->ctx->queue_in_context(group->handle);
+        }
+        group = next;
+    }
+
+    if (head_) {
+        // records appended while this group was written, the oldest of them writes them
+        head_->lead = true;
+        head_->ctx->queue_in_context(head_->handle);
+    } else {
+        flushing_ = false;
+        idle_.set();
+    }
+}
+
+Coro<> Wal::wait_window() {
+    if (options_.max_delay.count() == 0) {
+        co_return;
+    }
+
+    auto deadline = group_start_ + options_.max_delay;
+    while (pending_.size() < options_.max_batch_bytes && TimerClock::now() < deadline) {
+        window_.reset();
+        auto timer = this_context::expires_until(deadline, [this](bool flag) {
+            if (flag) {
+                window_.set();
+            }
+        });
+        co_await window_.wait();
+        timer.cancel();
+    }
+}
+
+Coro<> Wal::write_group(uint64_t offset, std::error_code& ec) {
+    size_t len = writing_.size();
+    if (options_.preallocate_size != 0 && offset + len > allocated_) {
+        uint64_t grow = std::max<uint64_t>(options_.preallocate_size, offset + len - allocated_);
+        std::error_code alloc_ec;
+        co_await file_.allocate(allocated_, grow, alloc_ec);
+        if (alloc_ec) {
+            // the filesystem cannot do it, a full disk still shows up in the write
+            options_.preallocate_size = 0;
+        } else {
+            allocated_ += grow;
+        }
+    }
+
+    size_t wr = co_await file_.write_and_sync_at(offset, writing_.data(), len, ec);
+    if (!ec && wr != len) {
+        ec = std::make_error_code(std::errc::io_error);
+    }
+}
+
+WalReader::WalReader()
+    : reader_(file_, kWalReadSize)
+{ }
+
+Coro<> WalReader::open(const char* path, std::error_code& ec) {
+    co_await file_.open(path, File::ReadOnly, ec);
+}
+
+Coro<std::optional<std::string_view>> WalReader::next(std::error_code& ec) {
+    if (done_) {
+        co_return std::nullopt;
+    }
+
+    auto header = co_await reader_.read_exact(kWalHeaderSize, ec);
+    if (ec || header.size() < kWalHeaderSize) {
+        corrupted_ = !ec && header.size() != 0;
+        done_ = true;
+        co_return std::nullopt;
+    }
+    uint32_t len = load32(header.data());
+    uint32_t crc = load32(header.data() + 4);
+    if (len == 0 && crc == 0) {
+        // preallocated space
+        done_ = true;
+        co_return std::nullopt;
+    }
+    if (len > kMaxWalRecord) {
+        corrupted_ = true;
+        done_ = true;
+        co_return std::nullopt;
+    }
+
+    auto payload = co_await reader_.read_exact(len, ec);
+    if (ec || payload.size() < len || record_crc(payload) != crc) {
+        corrupted_ = !ec;
+        done_ = true;
+        co_return std::nullopt;
+    }
+    offset_ += kWalHeaderSize + len;
+    co_return payload;
+}
+#endif
+
+}
@@ -0,0 +1,155 @@
+#ifndef MAGIO_CORE_WAL_H_
+#define MAGIO_CORE_WAL_H_
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+#include "magio-v3/core/file.h"
+#include "magio-v3/core/event.h"
+#include "magio-v3/core/buffer.h"
+#include "magio-v3/core/buf_stream.h"
+
+namespace magio {
+
+#ifdef MAGIO_USE_CORO
+// Records are framed as [len u32][crc32c u32][payload], little endian,
+// the crc covers the length too so a zeroed or preallocated region never reads as a record
+constexpr size_t kWalHeaderSize = 8;
+
+constexpr size_t kMaxWalRecord = 64 * 1024 * 1024;
+
+// Append only log with group commit. Records appended while a group is being written and synced
+// form the next group, which costs one write_at and one fdatasync however many records it holds.
+// Every coroutine of a group resumes once its records are durable.
+// All calls must come from the context that opened the log
+class Wal: Noncopyable {
+public:
+    struct Options {
+        // a group is written once it holds this many bytes...
+        size_t max_batch_bytes = 1024 * 1024;
+        // ...or once its first record has waited this long, 0 writes a group as soon as the previous one is durable
+        std::chrono::microseconds max_delay{0};
+        // disk space reserved ahead of the end of the log, so syncs do not have to update the file size, 0 disables
+        size_t preallocate_size = 16 * 1024 * 1024;
+    };
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t groups = 0;
+        uint64_t bytes = 0;
+    };
+
+    Wal();
+
+    explicit Wal(Options options);
+
+    // Creates the log or finds the end of an existing one, a torn or corrupt tail is cut off.
+    // Replay the records with WalReader before opening
+    [[nodiscard]]
+    Coro<void> open(const char* path, std::error_code& ec);
+
+    // Returns the offset of the record in the log once it is durable.
+    // After a failed write or sync every append fails with the same error
+    [[nodiscard]]
+    Coro<uint64_t> append(std::string_view record, std::error_code& ec);
+
+    // Waits for the groups in flight, then closes the file
+    [[nodiscard]]
+    Coro<void> close(std::error_code& ec);
+
+    // the offset the next record is written at
+    uint64_t end() const {
+        return next_offset_ + pending_.size();
+    }
+
+    Stats stats() const {
+        return stats_;
+    }
+
+private:
+    // a coroutine waiting for its group
+    struct Commit {
+        CoroContext* ctx = nullptr;
+        std::coroutine_handle<> handle;
+        std::error_code ec;
+        // woken to write the next group rather than because its record is durable
+        bool lead = false;
+        Commit* next = nullptr;
+    };
+
+    struct CommitAwaitable {
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> prev_h);
+
+        void await_resume() { }
+
+        Commit& commit;
+    };
+
+    // Writes the pending group, then hands over to the first coroutine of the next one
+    Coro<void> lead();
+
+    Coro<void> wait_window();
+
+    Coro<void> write_group(uint64_t offset, std::error_code& ec);
+
+    Options options_;
+    RandomAccessFile file_;
+    std::error_code failed_;
+
+    // the group being formed, it starts at next_offset_
+    Buffer<> pending_;
+    Commit* head_ = nullptr;
+    Commit* tail_ = nullptr;
+    TimerClock::time_point group_start_;
+    uint64_t next_offset_ = 0;
+
+    Buffer<> writing_;
+    uint64_t allocated_ = 0;
+    bool flushing_ = false;
+    // set when the max_delay window of the pending group should end
+    detail::Event window_;
+    // set when no group is in flight
+    detail::Event idle_{true};
+    Stats stats_;
+};
+
+// Streams the records of a log from the start, stopping at the end of the file
+// or at the first torn or corrupt record, which is where Wal::open continues the log
+class WalReader: Noncopyable {
+public:
+    WalReader();
+
+    [[nodiscard]]
+    Coro<void> open(const char* path, std::error_code& ec);
+
+    // The next record, valid until the following call, or nullopt at the end of the log
+    [[nodiscard]]
+    Coro<std::optional<std::string_view>> next(std::error_code& ec);
+
+    // the offset just past the last good record
+    uint64_t offset() const {
+        return offset_;
+    }
+
+    // true if the log ended on bytes that are not a record rather than on the end of the file or zeroes
+    bool corrupted() const {
+        return corrupted_;
+    }
+
+private:
+    File file_;
+    BufReader<File> reader_;
+    uint64_t offset_ = 0;
+    bool done_ = false;
+    bool corrupted_ = false;
+};
+#endif
+
+}
+
+#endif
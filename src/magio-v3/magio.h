@@ -3,10 +3,27 @@
 
 #include "magio-v3/core/logger.h"
 #include "magio-v3/core/file.h"
+#include "magio-v3/core/mapped_file.h"
+#include "magio-v3/core/log_file.h"
 #include "magio-v3/core/pipe.h"
+#include "magio-v3/core/buf_stream.h"
+#include "magio-v3/core/scan.h"
+#include "magio-v3/core/dir_walker.h"
+#include "magio-v3/core/wal.h"
+#include "magio-v3/core/histogram.h"
+#include "magio-v3/core/allocator.h"
+#include "magio-v3/core/metrics.h"
+#include "magio-v3/core/trace.h"
 #include "magio-v3/core/mutex.h"
+#include "magio-v3/core/latch.h"
+#include "magio-v3/core/channel.h"
+#include "magio-v3/core/semaphore.h"
+#include "magio-v3/core/wait_group.h"
 #include "magio-v3/core/thread_pool.h"
+#include "magio-v3/core/parallel.h"
+#include "magio-v3/core/task_group.h"
 #include "magio-v3/core/coro_context_pool.h"
 #include "magio-v3/net/acceptor.h"
+#include "magio-v3/net/metrics_server.h"
 
 #endif
\ No newline at end of file
@@ -34,6 +34,15 @@ void Acceptor::bind_and_listen(const EndPoint &ep, std::error_code& ec) {
         return;
     }
 
+#ifdef __linux__
+    // connections the server closed first linger in TIME_WAIT on the port,
+    // they must not keep a restarted server from binding it
+    listener_.set_option(SocketOption::ReuseAddress, 1, ec);
+    if (ec) {
+        return;
+    }
+#endif
+
     listener_.bind(ep, ec);
     if (ec) {
         return;
@@ -86,10 +95,10 @@ Coro<std::pair<Socket, EndPoint>> Acceptor::accept(std::error_code& ec) {
 
 void Acceptor::accept(std::function<void (std::error_code, Socket, EndPoint)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, Socket, EndPoint)>;
-    auto ioc = new IoContext;
-    ioc->buf.buf = new char[128];
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io);
+    ioc->buf.buf = static_cast<char*>(magio::detail::allocate(128, AllocCategory::Buffer));
     ioc->buf.len = 128;
-    ioc->ptr = new Cb(std::move(completion_cb));
+    ioc->ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb));
     ioc->cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
         auto cb = (Cb*)ptr;
         if (ec) {
@@ -106,9 +115,9 @@ void Acceptor::accept(std::function<void (std::error_code, Socket, EndPoint)> &&
             );
         }
 
-        delete [] ioc->buf.buf;
-        delete cb;
-        delete ioc;
+        magio::detail::deallocate(ioc->buf.buf, 128, AllocCategory::Buffer);
+        magio::detail::destroy(cb, AllocCategory::Io);
+        magio::detail::destroy(ioc, AllocCategory::Io);
     };
 
     auto listener_h = listener_.handle();
@@ -3,10 +3,16 @@
 
 #include "magio-v3/core/logger.h"
 #include "magio-v3/core/error.h"
+#include "magio-v3/core/trace.h"
+#include "magio-v3/core/metrics.h"
 #include "magio-v3/core/io_context.h"
+#include "magio-v3/core/cancellation.h"
+#include "magio-v3/core/this_context.h"
 #include "magio-v3/net/socket.h"
 
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <sys/eventfd.h>
 
@@ -37,6 +43,12 @@ IoUring::IoUring(unsigned entries) {
     };
     std::memset(&wake_up_ctx_->remote_addr, 1, sizeof(void*));
 
+    cancel_ctx_ = new IoContext;
+    cancel_ctx_->op = Operation::Cancel;
+    cancel_ctx_->handle = -1;
+    cancel_ctx_->ptr = nullptr;
+    cancel_ctx_->cb = [](std::error_code ec, IoContext* ioc, void* p) { };
+
     prep_wake_up();
 }
 
@@ -45,32 +57,135 @@ IoUring::~IoUring() {
         ::close(wake_up_ctx_->handle);
         ::io_uring_queue_exit(p_io_uring_);
         delete wake_up_ctx_;
+        delete cancel_ctx_;
         delete p_io_uring_;
         wake_up_ctx_ = nullptr;
+        cancel_ctx_ = nullptr;
         p_io_uring_ = nullptr;
     }
 }
 
 void IoUring::read_file(IoContext &ioc, size_t offset) {
-    ++io_num_;
-    ioc.op = Operation::ReadFile;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::ReadFile);
+    if (!sqe) {
+        return;
+    }
     ::io_uring_prep_read(sqe, ioc.handle, ioc.buf.buf, ioc.buf.len, offset);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
 void IoUring::write_file(IoContext &ioc, size_t offset) {
-    ++io_num_;
-    ioc.op = Operation::WriteFile;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::WriteFile);
+    if (!sqe) {
+        return;
+    }
     ::io_uring_prep_write(sqe, ioc.handle, ioc.buf.buf, ioc.buf.len, offset);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
-void IoUring::connect(IoContext &ioc) {
+void IoUring::read_file_vectored(IoContext& ioc, size_t offset) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::ReadFileVectored);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_readv(sqe, ioc.handle, (const iovec*)ioc.buf.buf, ioc.buf.len, offset);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::open_file(IoContext& ioc, int flags, int mode) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::OpenFile);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_openat(sqe, ioc.handle, ioc.buf.buf, flags, mode);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::stat_file(IoContext& ioc, void* stat_buf) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::StatFile);
+    if (!sqe) {
+        return;
+    }
+    int flags = ioc.buf.buf[0] == '\0' ? AT_EMPTY_PATH : 0;
+    ::io_uring_prep_statx(sqe, ioc.handle, ioc.buf.buf, flags, STATX_BASIC_STATS, (struct statx*)stat_buf);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::close_file(IoContext& ioc) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::CloseFile);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_close(sqe, ioc.handle);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::sync_file(IoContext& ioc, bool data_only) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::SyncFile);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_fsync(sqe, ioc.handle, data_only ? IORING_FSYNC_DATASYNC : 0);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::allocate_file(IoContext& ioc, size_t offset, size_t len) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::AllocateFile);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_fallocate(sqe, ioc.handle, 0, offset, len);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::sync_file_range(IoContext& ioc, size_t offset, size_t len) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::SyncFileRange);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_sync_file_range(sqe, ioc.handle, len, offset, SYNC_FILE_RANGE_WRITE);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::write_and_sync_file(IoContext& write_ioc, IoContext& sync_ioc, size_t offset, bool data_only) {
+    // the linked pair has to go out in the same submission
+    make_room(2);
+    io_uring_sqe* sqe = prep_sqe(write_ioc, Operation::WriteFile);
+    if (!sqe) {
+        // the write completes as cancelled, so does the sync
+        ++io_num_;
+        sync_ioc.op = Operation::Cancel;
+        sqe = get_sqe();
+        ::io_uring_prep_nop(sqe);
+        ::io_uring_sqe_set_data(sqe, &sync_ioc);
+        return;
+    }
+    ::io_uring_prep_write(sqe, write_ioc.handle, write_ioc.buf.buf, write_ioc.buf.len, offset);
+    ::io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+    ::io_uring_sqe_set_data(sqe, &write_ioc);
+
+    // a short write breaks the link as well
     ++io_num_;
-    ioc.op = Operation::Connect;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    sync_ioc.op = Operation::SyncFile;
+    sqe = get_sqe();
+    ::io_uring_prep_fsync(sqe, sync_ioc.handle, data_only ? IORING_FSYNC_DATASYNC : 0);
+    ::io_uring_sqe_set_data(sqe, &sync_ioc);
+}
+
+void IoUring::advise_memory(IoContext& ioc, int advice) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::AdviseMemory);
+    if (!sqe) {
+        return;
+    }
+    ::io_uring_prep_madvise(sqe, ioc.buf.buf, ioc.buf.len, advice);
+    ::io_uring_sqe_set_data(sqe, &ioc);
+}
+
+void IoUring::connect(IoContext &ioc) {
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Connect);
+    if (!sqe) {
+        return;
+    }
     ::io_uring_prep_connect(
         sqe, ioc.handle, (sockaddr*)&ioc.remote_addr, ioc.addr_len
     );
@@ -78,56 +193,120 @@ void IoUring::connect(IoContext &ioc) {
 }
 
 void IoUring::accept(Socket &listener, IoContext &ioc) {
-    ++io_num_;
-    ioc.op = Operation::Accept;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Accept);
+    if (!sqe) {
+        return;
+    }
+    // the length is read before it is written, an uninitialized one fails the accept with EINVAL
+    ioc.addr_len = sizeof(ioc.remote_addr6);
     ::io_uring_prep_accept(
         sqe, listener.handle(), (sockaddr*)&ioc.remote_addr, 
-        (socklen_t*)ioc.buf.buf, 0
+        &ioc.addr_len, 0
     );
     ::io_uring_sqe_set_data(sqe, &ioc);
+    accepts_.push(&ioc);
 }
 
 void IoUring::send(IoContext &ioc) {
-    ++io_num_;
-    ioc.op = Operation::Send;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Send);
+    if (!sqe) {
+        return;
+    }
     ::io_uring_prep_send(sqe, ioc.handle, ioc.buf.buf, ioc.buf.len, 0);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
 void IoUring::receive(IoContext &ioc) {
-    ++io_num_;
-    ioc.op = Operation::Receive;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Receive);
+    if (!sqe) {
+        return;
+    }
     ::io_uring_prep_recv(sqe, ioc.handle, ioc.buf.buf, ioc.buf.len, 0);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
 void IoUring::send_to(IoContext &ioc) {
-    ++io_num_;
-    ioc.op = Operation::Send;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Send);
+    if (!sqe) {
+        return;
+    }
     auto p = (ResumeWithMsg*)ioc.ptr;
     ::io_uring_prep_sendmsg(sqe, ioc.handle, &p->msg, 0);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
 void IoUring::receive_from(IoContext &ioc) {
-    ++io_num_;
-    ioc.op = Operation::Receive;
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = prep_sqe(ioc, Operation::Receive);
+    if (!sqe) {
+        return;
+    }
     auto p = (ResumeWithMsg*)ioc.ptr;
     ::io_uring_prep_recvmsg(sqe, ioc.handle, &p->msg, 0);
     ::io_uring_sqe_set_data(sqe, &ioc);
 }
 
 void IoUring::cancel(IoContext& ioc) {
-    
+    ++io_num_;
+    io_uring_sqe* sqe = get_sqe();
+    ::io_uring_prep_cancel_fd(sqe, ioc.handle, IORING_ASYNC_CANCEL_ALL);
+    ::io_uring_sqe_set_data(sqe, cancel_ctx_);
+}
+
+void IoUring::cancel_one(IoContext& ioc) {
+    ++io_num_;
+    io_uring_sqe* sqe = get_sqe();
+    ::io_uring_prep_cancel(sqe, &ioc, 0);
+    ::io_uring_sqe_set_data(sqe, cancel_ctx_);
+}
+
+void IoUring::stop_accepting() {
+    refuse_accept_ = true;
+    accepts_.for_each([this](IoContext* ioc) {
+        cancel_one(*ioc);
+    });
+}
+
+void IoUring::cancel_all() {
+    refuse_all_ = true;
+    ++io_num_;
+    io_uring_sqe* sqe = get_sqe();
+    // the wake up read is cancelled as well, it is read again when it completes
+    ::io_uring_prep_cancel(sqe, nullptr, IORING_ASYNC_CANCEL_ANY);
+    ::io_uring_sqe_set_data(sqe, cancel_ctx_);
+}
+
+size_t IoUring::in_flight() const {
+    return io_num_;
+}
+
+size_t IoUring::in_kernel() const {
+    return io_num_ - refused_num_;
+}
+
+io_uring_sqe* IoUring::prep_sqe(IoContext& ioc, Operation op) {
+    ++io_num_;
+    ioc.op = op;
+    io_uring_sqe* sqe = get_sqe();
+    magio::detail::set_pending_io(ioc);
+
+    auto state = magio::detail::SuspendingCancel;
+    bool cancelled = state && !state->attach_io(LocalContext, ioc);
+    // a close always goes out, otherwise the descriptor would leak
+    if (op != Operation::CloseFile && (cancelled || refuse_all_ || (refuse_accept_ && op == Operation::Accept))) {
+        ioc.op = Operation::Cancel;
+        ++refused_num_;
+        ::io_uring_prep_nop(sqe);
+        ::io_uring_sqe_set_data(sqe, &ioc);
+        return nullptr;
+    }
+    return sqe;
 }
 
 // invoke all completion
 int IoUring::poll(bool block, std::error_code &ec) {
+    if (metrics_) {
+        metrics_->io_in_flight.set((int64_t)io_num_);
+    }
     if (!block && io_num_ == 0) {
         return 0;
     }
@@ -135,6 +314,10 @@ int IoUring::poll(bool block, std::error_code &ec) {
     int r;
 
     r = ::io_uring_submit_and_wait(p_io_uring_, block);
+    if (metrics_) {
+        metrics_->polls.add();
+        metrics_->sqes_submitted.add(r > 0 ? r : 0);
+    }
     if (-EAGAIN == r) {
         // non block and no completion
         return 0;
@@ -145,7 +328,11 @@ int IoUring::poll(bool block, std::error_code &ec) {
         return -1;
     }
 
-    unsigned count = ::io_uring_peek_batch_cqe(p_io_uring_, cqes_, sizeof(cqes_));
+    unsigned count = ::io_uring_peek_batch_cqe(p_io_uring_, cqes_, kCQEs);
+    if (metrics_) {
+        metrics_->cqes_reaped.add(count);
+        metrics_->cqes_per_poll.record(count);
+    }
     for (unsigned i = 0; i < count; ++i) {
         std::error_code inner_ec;
         void* data = ::io_uring_cqe_get_data(cqes_[i]);
@@ -154,8 +341,18 @@ int IoUring::poll(bool block, std::error_code &ec) {
         if (ioc->op != Operation::WakeUp) {
             --io_num_;
         }
+        if (ioc->op == Operation::Cancel && ioc != cancel_ctx_) {
+            --refused_num_;
+        }
+        if (ioc->op == Operation::Accept) {
+            accepts_.erase(ioc);
+        }
         
-        if (cqes_[i]->res < 0) {
+        if (ioc->op == Operation::WakeUp && cqes_[i]->res == -ECANCELED) {
+            // by cancel_all
+            prep_wake_up();
+            continue;
+        } else if (cqes_[i]->res < 0) {
             inner_ec = make_socket_error_code(-cqes_[i]->res);
             ioc->buf.len = 0;
         } else {
@@ -165,7 +362,8 @@ int IoUring::poll(bool block, std::error_code &ec) {
                 prep_wake_up();
             }
                 break;
-            case Operation::ReadFile: {
+            case Operation::ReadFile:
+            case Operation::ReadFileVectored: {
                 ioc->buf.len = cqes_[i]->res;
             }
                 break;
@@ -193,6 +391,23 @@ int IoUring::poll(bool block, std::error_code &ec) {
                 ioc->buf.len = cqes_[i]->res;
             }
                 break;
+            case Operation::OpenFile: {
+                ioc->handle = cqes_[i]->res;
+            }
+                break;
+            case Operation::StatFile:
+            case Operation::CloseFile:
+            case Operation::SyncFile:
+            case Operation::AllocateFile:
+            case Operation::SyncFileRange:
+            case Operation::AdviseMemory:
+                break;
+            case Operation::Cancel: {
+                // cancel requests and operations of cancelled tasks
+                inner_ec = make_socket_error_code(ECANCELED);
+                ioc->buf.len = 0;
+            }
+                break;
             }
         }
         ioc->cb(inner_ec, ioc, ioc->ptr);
@@ -202,12 +417,27 @@ int IoUring::poll(bool block, std::error_code &ec) {
     return 1;
 }
 
+io_uring_sqe* IoUring::get_sqe() {
+    make_room(1);
+    return ::io_uring_get_sqe(p_io_uring_);
+}
+
+void IoUring::make_room(unsigned n) {
+    // submitted early rather than failing, the rest goes out with the next poll
+    if (::io_uring_sq_space_left(p_io_uring_) < n) {
+        int r = ::io_uring_submit(p_io_uring_);
+        if (metrics_ && r > 0) {
+            metrics_->sqes_submitted.add(r);
+        }
+    }
+}
+
 void IoUring::wake_up() {
     ::write(wake_up_ctx_->handle, &wake_up_ctx_->remote_addr, sizeof(void*));
 }
 
 void IoUring::prep_wake_up() {
-    io_uring_sqe* sqe = ::io_uring_get_sqe(p_io_uring_);
+    io_uring_sqe* sqe = get_sqe();
     ::io_uring_prep_read(sqe, wake_up_ctx_->handle, &wake_up_ctx_->ptr, sizeof(void*), 0);
     ::io_uring_sqe_set_data(sqe, wake_up_ctx_);
 }
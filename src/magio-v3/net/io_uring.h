@@ -3,11 +3,14 @@
 
 #include "magio-v3/core/noncopyable.h"
 #include "magio-v3/core/io_service.h"
+#include "magio-v3/core/io_context.h"
 
 struct io_uring;
 
 struct io_uring_cqe;
 
+struct io_uring_sqe;
+
 namespace magio {
 
 namespace net {
@@ -24,6 +27,24 @@ public:
 
     void write_file(IoContext& ioc, size_t offset) override;
 
+    void read_file_vectored(IoContext& ioc, size_t offset) override;
+
+    void open_file(IoContext& ioc, int flags, int mode) override;
+
+    void stat_file(IoContext& ioc, void* stat_buf) override;
+
+    void close_file(IoContext& ioc) override;
+
+    void sync_file(IoContext& ioc, bool data_only) override;
+
+    void allocate_file(IoContext& ioc, size_t offset, size_t len) override;
+
+    void sync_file_range(IoContext& ioc, size_t offset, size_t len) override;
+
+    void write_and_sync_file(IoContext& write_ioc, IoContext& sync_ioc, size_t offset, bool data_only) override;
+
+    void advise_memory(IoContext& ioc, int advice) override;
+
     void connect(IoContext& ioc) override;
 
     void accept(Socket& listener, IoContext& ioc) override;
@@ -37,6 +58,16 @@ public:
     void receive_from(IoContext& ioc) override;
 
     void cancel(IoContext& ioc) override;
+
+    void cancel_one(IoContext& ioc) override;
+
+    void stop_accepting() override;
+
+    void cancel_all() override;
+
+    size_t in_flight() const override;
+
+    size_t in_kernel() const override;
     
     void relate(void* sock_handle, std::error_code& ec) override;
 
@@ -45,11 +76,27 @@ public:
     void wake_up() override;
 
 private:
+    // returns nullptr if the suspending task has been cancelled, ioc then completes with operation_canceled.
+    // Closes are never refused
+    io_uring_sqe* prep_sqe(IoContext& ioc, Operation op);
+
+    // never nullptr, a full submission queue is submitted first
+    io_uring_sqe* get_sqe();
+
+    void make_room(unsigned n);
+
     void prep_wake_up();
 
     IoContext* wake_up_ctx_;
+    IoContext* cancel_ctx_;
     io_uring_cqe* cqes_[kCQEs];
     size_t io_num_ = 0;
+    // refused operations in io_num_, completed by a nop
+    size_t refused_num_ = 0;
+    // in-flight accepts, for stop_accepting
+    IoList accepts_;
+    bool refuse_accept_ = false;
+    bool refuse_all_ = false;
     io_uring* p_io_uring_ = nullptr;
 };
 
@@ -3,6 +3,8 @@
 
 #include "magio-v3/core/error.h"
 #include "magio-v3/core/logger.h"
+#include "magio-v3/core/trace.h"
+#include "magio-v3/core/metrics.h"
 #include "magio-v3/core/io_context.h"
 #include "magio-v3/net/socket.h"
 
@@ -35,7 +37,29 @@ struct IoCompletionPort::Data {
     LPFN_CONNECTEX connect;
     LPFN_GETACCEPTEXSOCKADDRS get_sock_addr;
 
-    size_t io_num = 0;
+    // operations started and not completed yet, for cancel_all
+    IoList in_flight;
+    bool refuse_accept = false;
+    bool refuse_all = false;
+
+    // false if the operation completed with operation_canceled right away
+    bool start(IoContext& ioc, Operation op) {
+        ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
+        ioc.op = op;
+        if (refuse_all || (refuse_accept && op == Operation::Accept)) {
+            ioc.cb(std::make_error_code(std::errc::operation_canceled), &ioc, ioc.ptr);
+            return false;
+        }
+        in_flight.push(&ioc);
+        magio::detail::set_pending_io(ioc);
+        return true;
+    }
+
+    // completes an operation that failed to start
+    void fail(IoContext& ioc, std::error_code ec) {
+        in_flight.erase(&ioc);
+        ioc.cb(ec, &ioc, ioc.ptr);
+    }
 };
 
 IoCompletionPort::IoCompletionPort() {
@@ -127,9 +151,9 @@ IoCompletionPort::~IoCompletionPort() {
 }
 
 void IoCompletionPort::read_file(IoContext &ioc, size_t offset) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::ReadFile;
+    if (!data_->start(ioc, Operation::ReadFile)) {
+        return;
+    }
     ioc.overlapped.Offset = offset;
 
     BOOL status = ReadFile(
@@ -141,14 +165,14 @@ void IoCompletionPort::read_file(IoContext &ioc, size_t offset) {
     );
     
     if (!status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
 void IoCompletionPort::write_file(IoContext &ioc, size_t offset) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::WriteFile;
+    if (!data_->start(ioc, Operation::WriteFile)) {
+        return;
+    }
     ioc.overlapped.Offset = offset;
 
     BOOL status = WriteFile(
@@ -160,14 +184,53 @@ void IoCompletionPort::write_file(IoContext &ioc, size_t offset) {
     );
     
     if (!status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
+// ReadFileScatter needs page sized, page aligned buffers, RandomAccessFile::read_many does not coalesce on windows
+void IoCompletionPort::read_file_vectored(IoContext& ioc, size_t offset) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+// windows has no overlapped open, stat, close, flush or allocation, RandomAccessFile does them synchronously instead
+void IoCompletionPort::open_file(IoContext& ioc, int flags, int mode) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::stat_file(IoContext& ioc, void* stat_buf) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::close_file(IoContext& ioc) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::sync_file(IoContext& ioc, bool data_only) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::allocate_file(IoContext& ioc, size_t offset, size_t len) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::sync_file_range(IoContext& ioc, size_t offset, size_t len) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
+void IoCompletionPort::write_and_sync_file(IoContext& write_ioc, IoContext& sync_ioc, size_t offset, bool data_only) {
+    write_ioc.cb(std::make_error_code(std::errc::operation_not_supported), &write_ioc, write_ioc.ptr);
+    sync_ioc.cb(std::make_error_code(std::errc::operation_not_supported), &sync_ioc, sync_ioc.ptr);
+}
+
+void IoCompletionPort::advise_memory(IoContext& ioc, int advice) {
+    ioc.cb(std::make_error_code(std::errc::operation_not_supported), &ioc, ioc.ptr);
+}
+
 void IoCompletionPort::connect(IoContext& ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Connect;
+    if (!data_->start(ioc, Operation::Connect)) {
+        return;
+    }
 
     bool status = data_->connect(
         ioc.handle,
@@ -180,20 +243,20 @@ void IoCompletionPort::connect(IoContext& ioc) {
     );
 
     if (!status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
 void IoCompletionPort::accept(Socket &listener, IoContext &ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Accept;
+    if (!data_->start(ioc, Operation::Accept)) {
+        return;
+    }
 
     std::error_code ec;
     SOCKET sock_handle = detail::open_socket(
         listener.ip(), listener.transport(), ec);
     if (ec) {
-        ioc.cb(ec, &ioc, ioc.ptr);
+        data_->fail(ioc, ec);
         return;
     }
     ioc.handle = sock_handle;
@@ -214,15 +277,15 @@ void IoCompletionPort::accept(Socket &listener, IoContext &ioc) {
 
     if (!status && ERROR_IO_PENDING != ::GetLastError()) {
         detail::close_socket(sock_handle);
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
         return;
     }
 }
 
 void IoCompletionPort::send(IoContext &ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Send;
+    if (!data_->start(ioc, Operation::Send)) {
+        return;
+    }
 
     DWORD flag = 0;
     int status = ::WSASend(
@@ -236,14 +299,14 @@ void IoCompletionPort::send(IoContext &ioc) {
     );
 
     if (SOCKET_ERROR == status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
 void IoCompletionPort::receive(IoContext &ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Receive;
+    if (!data_->start(ioc, Operation::Receive)) {
+        return;
+    }
 
     DWORD flag = 0;
     int status = ::WSARecv(
@@ -257,14 +320,14 @@ void IoCompletionPort::receive(IoContext &ioc) {
     );
 
     if (SOCKET_ERROR == status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
 void IoCompletionPort::send_to(IoContext &ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Send;
+    if (!data_->start(ioc, Operation::Send)) {
+        return;
+    }
 
     DWORD flag = 0;
     int status = ::WSASendTo(
@@ -280,14 +343,14 @@ void IoCompletionPort::send_to(IoContext &ioc) {
     );
 
     if (SOCKET_ERROR == status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
 void IoCompletionPort::receive_from(IoContext &ioc) {
-    ++data_->io_num;
-    ZeroMemory(&ioc.overlapped, sizeof(OVERLAPPED));
-    ioc.op = Operation::Receive;
+    if (!data_->start(ioc, Operation::Receive)) {
+        return;
+    }
 
     DWORD flag = 0;
     int status = ::WSARecvFrom(
@@ -303,7 +366,7 @@ void IoCompletionPort::receive_from(IoContext &ioc) {
     );
 
     if (SOCKET_ERROR == status && ERROR_IO_PENDING != ::GetLastError()) {
-        ioc.cb(SYSTEM_ERROR_CODE, &ioc, ioc.ptr);
+        data_->fail(ioc, SYSTEM_ERROR_CODE);
     }
 }
 
@@ -311,11 +374,53 @@ void IoCompletionPort::cancel(IoContext &ioc) {
     ::CancelIoEx((HANDLE)ioc.handle, NULL);
 }
 
+void IoCompletionPort::cancel_one(IoContext &ioc) {
+    ::CancelIoEx((HANDLE)ioc.handle, &ioc.overlapped);
+}
+
+void IoCompletionPort::stop_accepting() {
+    data_->refuse_accept = true;
+    data_->in_flight.for_each([](IoContext* ioc) {
+        if (ioc->op == Operation::Accept) {
+            // AcceptEx is cancelled through the listener
+            auto listener_h = *(SOCKET*)&ioc->buf.buf[120];
+            ::CancelIoEx((HANDLE)listener_h, &ioc->overlapped);
+        }
+    });
+}
+
+void IoCompletionPort::cancel_all() {
+    data_->refuse_all = true;
+    data_->in_flight.for_each([](IoContext* ioc) {
+        if (ioc->op == Operation::Accept) {
+            auto listener_h = *(SOCKET*)&ioc->buf.buf[120];
+            ::CancelIoEx((HANDLE)listener_h, &ioc->overlapped);
+        } else {
+            ::CancelIoEx((HANDLE)ioc->handle, &ioc->overlapped);
+        }
+    });
+}
+
+size_t IoCompletionPort::in_flight() const {
+    return data_->in_flight.size();
+}
+
+size_t IoCompletionPort::in_kernel() const {
+    // refused operations complete before start returns
+    return data_->in_flight.size();
+}
+
 // invoke all
 int IoCompletionPort::poll(bool block, std::error_code &ec) {
-    if (!block && data_->io_num == 0) {
+    if (metrics_) {
+        metrics_->io_in_flight.set((int64_t)data_->in_flight.size());
+    }
+    if (!block && data_->in_flight.size() == 0) {
         return 0;
     }
+    if (metrics_) {
+        metrics_->polls.add();
+    }
 
     ULONG wait_time = block ? ULONG_MAX : 0;
     for (int i = 0; i < 1024; ++i) {
@@ -348,7 +453,10 @@ int IoCompletionPort::poll(bool block, std::error_code &ec) {
             return -1;
         }       
 
-        --data_->io_num;
+        data_->in_flight.erase(ioc);
+        if (metrics_) {
+            metrics_->cqes_reaped.add();
+        }
         switch(ioc->op) {
         case Operation::WakeUp: {
             // Never
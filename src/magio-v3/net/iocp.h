@@ -18,6 +18,24 @@ public:
 
     void write_file(IoContext& ioc, size_t offset) override;
 
+    void read_file_vectored(IoContext& ioc, size_t offset) override;
+
+    void open_file(IoContext& ioc, int flags, int mode) override;
+
+    void stat_file(IoContext& ioc, void* stat_buf) override;
+
+    void close_file(IoContext& ioc) override;
+
+    void sync_file(IoContext& ioc, bool data_only) override;
+
+    void allocate_file(IoContext& ioc, size_t offset, size_t len) override;
+
+    void sync_file_range(IoContext& ioc, size_t offset, size_t len) override;
+
+    void write_and_sync_file(IoContext& write_ioc, IoContext& sync_ioc, size_t offset, bool data_only) override;
+
+    void advise_memory(IoContext& ioc, int advice) override;
+
     void connect(IoContext& ioc) override;
 
     void accept(Socket& listener, IoContext& ioc) override;
@@ -31,6 +49,16 @@ public:
     void receive_from(IoContext& ioc) override;
 
     void cancel(IoContext& ioc) override;
+
+    void cancel_one(IoContext& ioc) override;
+
+    void stop_accepting() override;
+
+    void cancel_all() override;
+
+    size_t in_flight() const override;
+
+    size_t in_kernel() const override;
     
     void relate(void* handle, std::error_code& ec) override;
 
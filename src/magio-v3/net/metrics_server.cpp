@@ -0,0 +1,98 @@
+#include "magio-v3/net/metrics_server.h"
+
+#include "magio-v3/core/metrics.h"
+#include "magio-v3/core/logger.h"
+#include "magio-v3/core/buf_stream.h"
+#include "magio-v3/core/coro_context.h"
+#include "magio-v3/net/acceptor.h"
+
+namespace magio {
+
+namespace net {
+
+#ifdef MAGIO_USE_CORO
+namespace {
+
+// A scraper sends a handful of short headers, anything longer is not one
+constexpr size_t kMaxRequestHeader = 8 * 1024;
+
+Coro<> send_all(Socket& socket, std::string_view msg, std::error_code& ec) {
+    while (!msg.empty()) {
+        size_t wr = co_await socket.send(msg.data(), msg.size(), ec);
+        if (ec || wr == 0) {
+            co_return;
+        }
+        msg.remove_prefix(wr);
+    }
+}
+
+Coro<> handle_scrape(Socket socket) {
+    std::error_code ec;
+    BufReader reader(socket, 1024);
+    std::string_view line = co_await reader.read_until('\n', ec);
+    if (ec || line.empty()) {
+        co_return;
+    }
+    // "GET /metrics HTTP/1.1"
+    bool get = line.starts_with("GET ");
+    std::string_view path = get ? line.substr(4, line.find(' ', 4) - 4) : std::string_view{};
+    bool found = path == "/metrics" || path == "/" || path.starts_with("/metrics?");
+
+    for (size_t header = line.size(); ;) {
+        line = co_await reader.read_until('\n', ec);
+        header += line.size();
+        if (ec || line.empty() || header > kMaxRequestHeader) {
+            co_return;
+        }
+        if (line == "\r\n" || line == "\n") {
+            break;
+        }
+    }
+
+    std::string body;
+    std::string_view status = "200 OK";
+    if (!get) {
+        status = "405 Method Not Allowed";
+    } else if (!found) {
+        status = "404 Not Found";
+    } else {
+        body = metrics::Registry::global().to_prometheus();
+    }
+    std::string response = fmt::format(
+        "HTTP/1.1 {}\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: {}\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "{}", status, body.size(), body
+    );
+    co_await send_all(socket, response, ec);
+    socket.shutdown(Socket::Write);
+}
+
+}
+
+Coro<> serve_metrics(const EndPoint& ep, std::error_code& ec) {
+    Acceptor acceptor;
+    acceptor.bind_and_listen(ep, ec);
+    if (ec) {
+        co_return;
+    }
+    for (; ;) {
+        std::error_code accept_ec;
+        auto [socket, peer] = co_await acceptor.accept(accept_ec);
+        if (accept_ec == std::errc::operation_canceled) {
+            co_return;
+        }
+        if (accept_ec) {
+            M_ERROR("metrics accept error: {}", accept_ec.message());
+            continue;
+        }
+        this_context::spawn(handle_scrape(std::move(socket)));
+    }
+}
+#endif
+
+}
+
+}
@@ -0,0 +1,28 @@
+#ifndef MAGIO_NET_METRICS_SERVER_H_
+#define MAGIO_NET_METRICS_SERVER_H_
+
+#include <system_error>
+
+namespace magio {
+
+template<typename>
+class Coro;
+
+namespace net {
+
+class EndPoint;
+
+#ifdef MAGIO_USE_CORO
+// Serves metrics::Registry::global() over HTTP for prometheus to scrape, GET /metrics,
+// one request per connection. Runs on the calling context until cancelled,
+// returns early with ec set if ep cannot be listened on.
+// Spawn it only where scrapes are wanted, nothing listens otherwise
+[[nodiscard]]
+Coro<void> serve_metrics(const EndPoint& ep, std::error_code& ec);
+#endif
+
+}
+
+}
+
+#endif
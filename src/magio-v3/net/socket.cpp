@@ -287,16 +287,16 @@ Coro<std::pair<size_t, EndPoint>> Socket::receive_from(char* buf, size_t len, st
 void Socket::connect(const EndPoint &ep, std::function<void (std::error_code)> &&completion_cb) {
     using Cb = std::function<void (std::error_code)>;
     check_relation();
-    auto ioc = new IoContext;
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io);
     ioc->handle = handle_;
-    ioc->ptr = new Cb(std::move(completion_cb));
+    ioc->ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb));
     ioc->addr_len = ep.address().addr_len();
     std::memcpy(&ioc->remote_addr, ep.address().addr_in_, ioc->addr_len);
     ioc->cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
         auto cb = (Cb*)ptr;
         (*cb)(ec);
-        delete cb;
-        delete ioc;
+        magio::detail::destroy(cb, AllocCategory::Io);
+        magio::detail::destroy(ioc, AllocCategory::Io);
     };
     this_context::get_service().connect(*ioc);
 }
@@ -304,17 +304,17 @@ void Socket::connect(const EndPoint &ep, std::function<void (std::error_code)> &
 void Socket::receive(char *buf, size_t len, std::function<void (std::error_code, size_t)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
     check_relation();
-    auto ioc = new IoContext{
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = handle_,
         .buf = io_buf(buf, len),
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete ioc;
-            delete cb;
+            magio::detail::destroy(ioc, AllocCategory::Io);
+            magio::detail::destroy(cb, AllocCategory::Io);
         }
-    };
+    });
 
     this_context::get_service().receive(*ioc);
 }
@@ -322,45 +322,45 @@ void Socket::receive(char *buf, size_t len, std::function<void (std::error_code,
 void Socket::send(const char *msg, size_t len, std::function<void (std::error_code, size_t)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
     check_relation();
-    auto ioc = new IoContext{
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = handle_,
         .buf = io_buf((char*)msg, len),
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete ioc;
-            delete cb;
+            magio::detail::destroy(ioc, AllocCategory::Io);
+            magio::detail::destroy(cb, AllocCategory::Io);
         }
-    };
+    });
 
     this_context::get_service().send(*ioc);
 }
 
 void Socket::send_to(const char *msg, size_t len, const EndPoint &ep, std::function<void (std::error_code, size_t)> &&completion_cb) {
     using Cb = std::function<void (std::error_code, size_t)>;
-    auto ioc = new IoContext{
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = handle_,
         .buf = io_buf((char*)msg, len),
         .addr_len = (socklen_t)ep.address().addr_len(),
 #ifdef _WIN32
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(ec, ioc->buf.len);
-            delete cb;
-            delete ioc;
+            magio::detail::destroy(cb, AllocCategory::Io);
+            magio::detail::destroy(ioc, AllocCategory::Io);
         }
 #elif defined (__linux__)
-        .ptr = new CbWithMsg<Cb>{{}, std::move(completion_cb)},
+        .ptr = magio::detail::make<CbWithMsg<Cb>>(AllocCategory::Io, msghdr{}, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cbm = (CbWithMsg<Cb>*)ptr;
             cbm->cb(ec, ioc->buf.len);
-            delete cbm;
-            delete ioc;
+            magio::detail::destroy(cbm, AllocCategory::Io);
+            magio::detail::destroy(ioc, AllocCategory::Io);
         }
 #endif
-    };
+    });
     std::memcpy(&ioc->remote_addr, ep.address().addr_in_, ioc->addr_len);
 
 #ifdef __linux__
@@ -379,12 +379,12 @@ void Socket::send_to(const char *msg, size_t len, const EndPoint &ep, std::funct
 
 void Socket::receive_from(char *buf, size_t len, std::function<void (std::error_code, size_t, EndPoint)>&& completion_cb) {
     using Cb = std::function<void (std::error_code, size_t, EndPoint)>;
-    auto ioc = new IoContext{
+    auto ioc = magio::detail::make<IoContext>(AllocCategory::Io, IoContext{
         .handle = handle_,
         .buf = io_buf(buf, len),
         .addr_len = sizeof(sockaddr_in6),
 #ifdef _WIN32
-        .ptr = new Cb(std::move(completion_cb)),
+        .ptr = magio::detail::make<Cb>(AllocCategory::Io, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cb = (Cb*)ptr;
             (*cb)(
@@ -394,11 +394,11 @@ void Socket::receive_from(char *buf, size_t len, std::function<void (std::error_
                     ::ntohs(ioc->remote_addr.sin_port)
                 )
             );
-            delete cb;
-            delete ioc;
+            magio::detail::destroy(cb, AllocCategory::Io);
+            magio::detail::destroy(ioc, AllocCategory::Io);
         }
 #elif defined (__linux__)
-        .ptr = new CbWithMsg<Cb>{{}, std::move(completion_cb)},
+        .ptr = magio::detail::make<CbWithMsg<Cb>>(AllocCategory::Io, msghdr{}, std::move(completion_cb)),
         .cb = [](std::error_code ec, IoContext* ioc, void* ptr) {
             auto cbm = (CbWithMsg<Cb>*)ptr;
             cbm->cb(
@@ -409,11 +409,11 @@ void Socket::receive_from(char *buf, size_t len, std::function<void (std::error_
                     ::ntohs(ioc->remote_addr.sin_port)
                 )
             );
-            delete cbm;
-            delete ioc;
+            magio::detail::destroy(cbm, AllocCategory::Io);
+            magio::detail::destroy(ioc, AllocCategory::Io);
         }
 #endif
-    };
+    });
 
 #ifdef __linux__
     auto cbm = (CbWithMsg<Cb>*)ioc->ptr;
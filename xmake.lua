@@ -28,6 +28,16 @@ add_packages("fmt")
 
 add_defines("MAGIO_USE_CORO")
 
+-- xmake f --trace=y, see magio-v3/core/trace.h
+option("trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Instrument coroutines for magio::trace")
+    add_defines("MAGIO_TRACE")
+option_end()
+
+add_options("trace")
+
 target("magio-v3")
     set_kind("static")
     add_files("src/magio-v3/core/**.cpp", "src/magio-v3/net/**.cpp")
@@ -41,6 +51,14 @@ for _, dir in ipairs(os.files("examples/v3/*.cpp")) do
         add_deps("magio-v3")
 end
 
+-- benchmarks
+for _, dir in ipairs(os.files("benchmark/*.cpp")) do
+    target(path.basename(dir))
+        set_kind("binary")
+        add_files(dir)
+        add_deps("magio-v3")
+end
+
 --dev
 for _, dir in ipairs(os.files("dev/**.cpp")) do
     target(path.basename(dir))